@@ -28,10 +28,190 @@
 #include <string.h>
 
 #include "wregex.h"
+#include "wrxcfg.h"
 #include "wrx_prnt.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
 
 #define match(p, s)   _match(p, s, __FILE__, __LINE__)
 
+static int dfa_match(const wregex_t *r, const char *s, wregmatch_t subm[], int nsm);
+static int tdfa_match(const wregex_t *r, const char *s, wregmatch_t subm[], int nsm);
+static int jit_match(const wregex_t *r, const char *s, wregmatch_t subm[], int nsm);
+
+/* The other matchers, which must give the same results as wrx_exec() */
+static const struct {
+	const char *name;
+	int (*exec)(const wregex_t *, const char *, wregmatch_t [], int);
+} engines[] = {
+	{"wrx_backtrack", wrx_backtrack},
+	{"wrx_thom", wrx_thom},
+	{"wrx_onepass", wrx_onepass},
+	{"wrx_fixed", wrx_fixed},
+	{"wrx_dfa_match", dfa_match},
+	{"wrx_tdfa_exec", tdfa_match},
+	{"wrx_jit_exec", jit_match}
+};
+
+/* Matchers that only find where the match ends */
+static int lazy_find(const wregex_t *r, const char *s, const char **end);
+static int dfa_find(const wregex_t *r, const char *s, const char **end);
+static int bitpar_find(const wregex_t *r, const char *s, const char **end);
+
+static const struct {
+	const char *name;
+	int (*find)(const wregex_t *, const char *, const char **);
+	int first;	/* Stops at the first match end, which may be before wrx_exec()'s */
+} finders[] = {
+	{"wrx_lazy_exec", lazy_find, 0},
+	{"wrx_dfa_exec", dfa_find, 0},
+	{"wrx_bitpar_exec", bitpar_find, 1}
+};
+
+static int mismatches = 0;
+
+/*
+ *	Reports that p didn't compile, and gives up on the tests
+ */
+static void comp_error(const char *p, int e, int ep) {
+	fprintf(stderr, "\nERROR......: %s\n%s\n%*c\n", wrx_error(e), p, ep + 1, '^');
+	exit(EXIT_FAILURE);
+}
+
+/*
+ *	Returns ptr, or gives up on the tests if it is NULL because there was
+ *	no memory for what
+ */
+static void *mem_or_die(void *ptr, const char *what) {
+	if(!ptr) {
+		fprintf(stderr, "\nERROR......: out of memory (%s)\n", what);
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+
+static int lazy_find(const wregex_t *r, const char *s, const char **end) {
+	wrx_lazy *dfa;
+	int e;
+
+	dfa = mem_or_die(wrx_lazy_new(r, 0), "lazy DFA");
+	e = wrx_lazy_exec(dfa, s, end);
+	wrx_lazy_free(dfa);
+	return e;
+}
+
+/*
+ *	Runs the pattern through each of the engines[] and compares the
+ *	results with those of wrx_exec()
+ */
+static void cross_check(const wregex_t *r, const char *p, const char *s, int e, const wregmatch_t *subm, const char *file, int line) {
+	wregmatch_t *subm2;
+	const char *end;
+	int i, j, e2;
+
+	for(i = 0; i < sizeof engines / sizeof engines[0]; i++) {
+		subm2 = mem_or_die(calloc(sizeof *subm2, r->n_subm), "submatches");
+
+		/* What a previous call could have left in the submatches */
+		for(j = 0; j < r->n_subm; j++)
+			subm2[j].beg = subm2[j].end = s;
+
+		e2 = engines[i].exec(r, s, subm2, r->n_subm);
+
+		if(e2 != e) {
+			printf("[%s:%3d] MISMATCH...: %s() returned %d for \"%s\" =~ \"%s\"\n", file, line, engines[i].name, e2, p, s);
+			mismatches++;
+		} else if(e >= 0) {
+			/* Without a match, the submatches are NULL as well */
+			for(j = 0; j < r->n_subm; j++)
+				if(subm2[j].beg != (e ? subm[j].beg : NULL) || subm2[j].end != (e ? subm[j].end : NULL)) {
+					printf("[%s:%3d] MISMATCH...: %s() subm[%d] differs for \"%s\" =~ \"%s\"\n", file, line, engines[i].name, j, p, s);
+					mismatches++;
+					break;
+				}
+		}
+
+		free(subm2);
+	}
+
+	/* wrx_exec() may use another engine when no submatches are wanted */
+	e2 = wrx_exec(r, s, NULL, 0);
+	if(e2 != e) {
+		printf("[%s:%3d] MISMATCH...: wrx_exec() without submatches returned %d for \"%s\" =~ \"%s\"\n", file, line, e2, p, s);
+		mismatches++;
+	}
+
+	for(i = 0; i < sizeof finders / sizeof finders[0]; i++) {
+		end = NULL;
+		e2 = finders[i].find(r, s, &end);
+
+		if(e2 != e) {
+			printf("[%s:%3d] MISMATCH...: %s() returned %d for \"%s\" =~ \"%s\"\n", file, line, finders[i].name, e2, p, s);
+			mismatches++;
+		} else if(e == 1 && subm[0].end && (finders[i].first ? end > subm[0].end : end != subm[0].end)) {
+			printf("[%s:%3d] MISMATCH...: %s() end differs for \"%s\" =~ \"%s\"\n", file, line, finders[i].name, p, s);
+			mismatches++;
+		}
+	}
+}
+
+static int bitpar_find(const wregex_t *r, const char *s, const char **end) {
+	wrx_bitpar *bp;
+	int e;
+
+	bp = mem_or_die(wrx_bitpar_new(r), "bit-parallel matcher");
+	e = wrx_bitpar_exec(bp, s, end);
+	wrx_bitpar_free(bp);
+	return e;
+}
+
+static int dfa_find(const wregex_t *r, const char *s, const char **end) {
+	wregex_t *r2;
+	int e, ep;
+
+	r2 = wrx_comp_dfa(r->p, &e, &ep, 0);
+	if(!r2) comp_error(r->p, e, ep);
+	e = wrx_dfa_exec(r2, s, end);
+	wrx_free(r2);
+	return e;
+}
+
+static int dfa_match(const wregex_t *r, const char *s, wregmatch_t subm[], int nsm) {
+	wregex_t *r2;
+	int e, ep;
+
+	r2 = wrx_comp_dfa(r->p, &e, &ep, 0);
+	if(!r2) comp_error(r->p, e, ep);
+	e = wrx_dfa_match(r2, s, subm, nsm);
+	wrx_free(r2);
+	return e;
+}
+
+static int tdfa_match(const wregex_t *r, const char *s, wregmatch_t subm[], int nsm) {
+	wregex_t *r2;
+	int e, ep;
+
+	r2 = wrx_comp_tdfa(r->p, &e, &ep, 0);
+	if(!r2) comp_error(r->p, e, ep);
+	e = wrx_tdfa_exec(r2, s, subm, nsm);
+	wrx_free(r2);
+	return e;
+}
+
+static int jit_match(const wregex_t *r, const char *s, wregmatch_t subm[], int nsm) {
+	wregex_t *r2;
+	int e, ep;
+
+	r2 = wrx_comp(r->p, &e, &ep);
+	if(!r2) comp_error(r->p, e, ep);
+	/* If there's no JIT compiler, wrx_jit_exec() uses the backtracker */
+	wrx_jit(r2);
+	e = wrx_jit_exec(r2, s, subm, nsm);
+	wrx_free(r2);
+	return e;
+}
+
 static int _match(const char *p, const char *s, const char *file, int line) {
 	int e, ep;
 	wregex_t *r;
@@ -44,18 +224,14 @@ static int _match(const char *p, const char *s, const char *file, int line) {
 	}
 
 	if(r->n_subm > 0) {
-		subm = calloc(sizeof *subm, r->n_subm);
-		if(!subm) {
-			fprintf(stderr, "Error: out of memory (submatches)\n");
-			wrx_free(r);
-			exit(EXIT_FAILURE);
-		}
+		subm = mem_or_die(calloc(sizeof *subm, r->n_subm), "submatches");
 	} else
 		subm = NULL;
 
 	e = wrx_exec(r, s, subm, r->n_subm);
 
 	if(e < 0) fprintf(stderr, "Error: %s\n", wrx_error(e));
+	else cross_check(r, p, s, e, subm, file, line);
 
 	free(subm);
 	wrx_free(r);
@@ -63,6 +239,260 @@ static int _match(const char *p, const char *s, const char *file, int line) {
 	return e;
 }
 
+/*
+ *	The probes look at how a pattern is compiled and matched, beyond whether
+ *	it matches. probe() compiles the pattern as probes[] says, and passes it
+ *	with the string s and the number arg to the probe, which returns:
+ */
+enum {
+	THOM,		/* What wrx_thom() returns, without wrx_exec()'s backtracking */
+	LAZY_FLUSH,	/* 1 if a lazy DFA with arg bytes of cache has to flush it,
+				and still finds the match end that wrx_thom() finds */
+	DFA_STATES,	/* The number of states in the minimized DFA, or 0 if it had
+				more than arg states before minimization */
+	PEXEC_SAME,	/* 1 if wrx_dfa_pexec() on 4 threads finds the match end
+				that wrx_dfa_exec() finds */
+	TDFA_STATES,	/* The number of states in the tagged DFA, or 0 if it has
+				more than arg states */
+	IS_ONEPASS,	/* 1 if wrx_comp() considers the pattern to be one-pass */
+	ENGINE,		/* The engine that wrx_comp() chooses */
+	GIVES_UP,	/* 1 if wrx_exec() without its bitmap finds the match that
+				wrx_thom() finds, giving up backtracking if it has to,
+				and leaves the engine as it was */
+	JITS,		/* 1 if wrx_jit() generates code, and wrx_exec() uses it */
+	DATE_SAME,	/* 1 if date() agrees with wrx_exec() on the result and
+				submatches. The pattern must be DATE_RE */
+	BITPAR_END,	/* The offset where wrx_bitpar_exec() finds that a match
+				ends, or -1 */
+	AEXEC_END,	/* The offset where wrx_aexec() finds that a match with at
+				most arg errors ends, times 10, plus the number of
+				errors; or -1 if there is no match */
+	NEXT_START,	/* The offset of the first position where wrx_comp() says
+				a match can begin, or -1 */
+	HAS_REQ,	/* 1 if wrx_comp() finds that every match contains s,
+				ignoring case if arg is set; s is NULL for no string */
+	RETURNS,	/* 1 if wrx_exec() and wrx_thom() both return arg, and set
+				all the submatches to NULL when they don't match */
+	LINE_MATCH,	/* AT(beg, end) for the match wrx_exec() finds, or -1 */
+	INNER_MATCH,	/* LINE_MATCH, if wrx_exec() matches outward from the
+				string every match contains */
+	REV_MATCH,	/* LINE_MATCH, if wrx_comp() reversed the pattern so that
+				wrx_exec() searches back from the ends of the lines */
+	WINDOW_LEN,	/* The length of the window with which every match begins,
+				or 0 if wrx_comp() didn't store one */
+	HAS_LOOP,	/* 1 if wrx_comp() finds the loop with which every match
+				begins */
+	ENGINE_EXEC	/* What matching with the engine arg returns */
+};
+
+/* The span of a match, as the probes return it */
+#define AT(beg, end)	((beg) * 1000 + (end))
+
+static int thom_match(wregex_t *r, const char *s, int arg) {
+	return wrx_thom(r, s, NULL, 0);
+}
+
+static int lazy_flush(wregex_t *r, const char *s, int arg) {
+	int e, rv;
+	wrx_lazy *dfa;
+	wregmatch_t subm[1];
+	const char *end = NULL;
+	unsigned long hits, misses, flushes;
+
+	dfa = mem_or_die(wrx_lazy_new(r, arg), "lazy DFA");
+	e = wrx_lazy_exec(dfa, s, &end);
+	wrx_lazy_stats(dfa, &hits, &misses, &flushes);
+	rv = e == wrx_thom(r, s, subm, 1) && (e != 1 || end == subm[0].end) && flushes > 0 && hits > misses;
+	wrx_lazy_free(dfa);
+	return rv;
+}
+
+static int dfa_states(wregex_t *r, const char *s, int arg) {
+	return r->dfa ? r->dfa->nstates : 0;
+}
+
+static int pexec_same(wregex_t *r, const char *s, int arg) {
+	const char *end1 = NULL, *end2 = NULL;
+	int e;
+
+	e = wrx_dfa_exec(r, s, &end1);
+	return r->dfa && wrx_dfa_pexec(r, s, 4, &end2) == e && end1 == end2;
+}
+
+static int tdfa_states(wregex_t *r, const char *s, int arg) {
+	return r->tdfa ? r->tdfa->nstates : 0;
+}
+
+static int is_onepass(wregex_t *r, const char *s, int arg) {
+	return r->onepass != NULL;
+}
+
+static int engine(wregex_t *r, const char *s, int arg) {
+	return r->engine;
+}
+
+static int gives_up(wregex_t *r, const char *s, int arg) {
+	int e, eng;
+	wregmatch_t subm[2], subm2[2];
+
+	r->memo_max = 0;
+	eng = r->engine;
+	e = wrx_exec(r, s, subm, 2);
+	return e == wrx_thom(r, s, subm2, 2) && r->engine == eng
+		&& (e != 1 || (subm[0].beg == subm2[0].beg && subm[0].end == subm2[0].end));
+}
+
+static int jits(wregex_t *r, const char *s, int arg) {
+	return wrx_jit(r) == 0 && r->jit && r->engine == WRX_ENG_JIT;
+}
+
+/* The matcher wrxgen writes for date.re. The Makefile writes the pattern in
+that file to date_re.h as DATE_RE */
+int date(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm);
+#include "date_re.h"
+
+static int date_same(wregex_t *r, const char *s, int arg) {
+	int e, i;
+	wregmatch_t subm[7], subm2[7];
+
+	memset(subm, 0, sizeof subm);
+	for(i = 0; i < 7; i++)
+		subm2[i].beg = subm2[i].end = s;
+	e = wrx_exec(r, s, subm, 7);
+	if(date(r, s, subm2, 7) != e)
+		return 0;
+	if(e >= 0)
+		for(i = 0; i < 7; i++)
+			if(subm[i].beg != subm2[i].beg || subm[i].end != subm2[i].end)
+				return 0;
+	return 1;
+}
+
+static int bitpar_end(wregex_t *r, const char *s, int arg) {
+	const char *end;
+
+	return bitpar_find(r, s, &end) == 1 ? end - s : -1;
+}
+
+static int aexec_end(wregex_t *r, const char *s, int arg) {
+	int e, err;
+	const char *end;
+
+	e = wrx_aexec(r, s, arg, &end, &err);
+	if(e == 1)
+		e = (end - s) * 10 + err;
+	else if(e == 0)
+		e = -1;
+	return e;
+}
+
+static int next_start(wregex_t *r, const char *s, int arg) {
+	const char *cp;
+
+	cp = wrx_next_start(r, s, s);
+	return cp ? cp - s : -1;
+}
+
+static int has_req(wregex_t *r, const char *s, int arg) {
+	return s ? r->req && !strcmp(r->req, s) && r->req_ci == arg : !r->req;
+}
+
+static int returns(wregex_t *r, const char *s, int arg) {
+	int i, ok = 1;
+	wregmatch_t subm[3];
+
+	for(i = 0; i < 2 && ok; i++) {
+		memset(subm, 0xFF, sizeof subm);
+		ok = (i ? wrx_thom(r, s, subm, 3) : wrx_exec(r, s, subm, 3)) == arg
+			&& (arg != 0 || (!subm[0].beg && !subm[1].end && !subm[2].beg));
+	}
+	return ok;
+}
+
+static int line_match(wregex_t *r, const char *s, int arg) {
+	wregmatch_t subm[1];
+
+	if(wrx_exec(r, s, subm, 1) != 1)
+		return -1;
+	return AT(subm[0].beg - s, subm[0].end - s);
+}
+
+static int inner_match(wregex_t *r, const char *s, int arg) {
+	return r->req_pre ? line_match(r, s, arg) : -1;
+}
+
+static int rev_match(wregex_t *r, const char *s, int arg) {
+	return r->rev ? line_match(r, s, arg) : -1;
+}
+
+static int window_len(wregex_t *r, const char *s, int arg) {
+	return r->bndm ? r->bndm->m : 0;
+}
+
+static int has_loop(wregex_t *r, const char *s, int arg) {
+	return r->loop != NULL;
+}
+
+/* wrx_onepass() is called directly, so that it doesn't leave the string to
+the search for the string every match contains */
+static int engine_exec(wregex_t *r, const char *s, int arg) {
+	wregmatch_t subm[3];
+
+	r->engine = arg;
+	if(arg == WRX_ENG_ONEPASS)
+		return wrx_onepass(r, s, subm, 3);
+	return wrx_exec(r, s, subm, 3);
+}
+
+/* How probe() compiles the pattern. With wrx_comp_dfa() and wrx_comp_tdfa(),
+arg is also the maximum number of states */
+enum { NFA, DFA, TDFA };
+
+static const struct {
+	int comp;
+	int (*fn)(wregex_t *, const char *, int);
+} probes[] = {
+	{NFA, thom_match},
+	{NFA, lazy_flush},
+	{DFA, dfa_states},
+	{DFA, pexec_same},
+	{TDFA, tdfa_states},
+	{NFA, is_onepass},
+	{NFA, engine},
+	{NFA, gives_up},
+	{NFA, jits},
+	{NFA, date_same},
+	{NFA, bitpar_end},
+	{NFA, aexec_end},
+	{NFA, next_start},
+	{NFA, has_req},
+	{NFA, returns},
+	{NFA, line_match},
+	{NFA, inner_match},
+	{NFA, rev_match},
+	{NFA, window_len},
+	{NFA, has_loop},
+	{NFA, engine_exec}
+};
+
+/*
+ *	Compiles p, and returns what the probe what finds out about it
+ */
+static int probe(int what, const char *p, const char *s, int arg) {
+	int e, ep;
+	wregex_t *r;
+
+	switch(probes[what].comp) {
+	case DFA: r = wrx_comp_dfa(p, &e, &ep, arg); break;
+	case TDFA: r = wrx_comp_tdfa(p, &e, &ep, arg); break;
+	default: r = wrx_comp(p, &e, &ep);
+	}
+	if(!r) comp_error(p, e, ep);
+	e = probes[what].fn(r, s, arg);
+	wrx_free(r);
+	return e;
+}
+
 /* Macro to test patterns that should match strings */
 #define MATCH(x,y)  do{\
 					total++;\
@@ -94,8 +524,24 @@ static int _match(const char *p, const char *s, const char *file, int line) {
                     fflush(stdout);\
 					} while(0)
 
+/* Counts a test that passes if cond is true, described by msg */
+#define CHECK(cond, msg)  do{\
+					total++;\
+					if(cond) \
+					{\
+						success++;\
+						printf("[%s:%3d] SUCCESS....: %s\n", __FILE__, __LINE__, msg);\
+					}\
+					else\
+					{\
+						printf("[%s:%3d] FAIL.......: %s\n", __FILE__, __LINE__, msg);\
+					}\
+                    fflush(stdout);\
+					} while(0)
+
 int main(int argc, char *argv[]) {
 	int i, e, ep, len, nsm;
+	unsigned int seed;
 
 	int total = 0, success = 0;
 
@@ -250,6 +696,18 @@ int main(int argc, char *argv[]) {
 		MATCH("([abcABC]{3})-\\i\\1", "aBc-AbC");
 		MATCH("\\i([abc]{3})-\\1", "aBc-AbC");
 
+		/* Loops whose body can match the empty string. All the engines stop
+		going around such a loop when an iteration consumes nothing */
+		MATCH("(a|)*b", "aab");
+		MATCH("(a*)+$", "aaa");
+		MATCH("(:b*)*?c", "bbc");
+		MATCH("(b|a?)+x", "aax");
+		MATCH("((a)|b*)*c", "abbac");
+		MATCH("(a?)*?a", "aaa");
+		MATCH("(.*?)*x", "abcx");
+		MATCH("x?*?(b|)*(b|)*?a?", "bbAAxxxaAAAAAbbbxaxbxxAax");
+		NOMATCH("(a*)*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+
 		/* Escape sequences */
 		MATCH("\\.", ".");
 		NOMATCH("\\.", "a");
@@ -379,9 +837,236 @@ int main(int argc, char *argv[]) {
 		MATCH("\\)+", ")))))))");
 		NOMATCH("\\)+", "((((((((");
 
+		/* Catastrophic backtracking should not affect wrx_thom() */
+		CHECK(probe(THOM, "(:x+x+)+y", "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", 0) == 0,
+			"wrx_thom() handles \"(:x+x+)+y\"");
+
+		/* Character sets only hold ASCII, so Latin-1 bytes are never in one */
+		NOMATCH("[^abc]", "\xE9");
+		MATCH("[^abc]+", "\xE9z\xE9");
+		NOMATCH("caf[^\\s]", "un caf\xE9");
+
+		/* wrx_exec() should not try the same state at the same position twice */
+		NOMATCH("(:a|a)*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+		MATCH("(:x+x+)+y", "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxy");
+		/* however many steps it takes before it starts keeping track of them */
+		MATCH("(a*)*b", "aaaab");
+		MATCH("(.*?)+A*|b", "AAbxxxx");
+		MATCH("(:.*?|[^a])+A*|b", "AAbxxxx");
+		MATCH("(:.*?|[^a])+A*|.>?", "AAb");
+		MATCH("(:.*?|[^a])+A*|.>?", "AAbb");
+		MATCH("(:.*?|[^a])+A*|.>?", "AAbbbbbbbbbbbbbbbbbbbbbbbbbb");
+
+		/* The lazy DFA should survive having its cache flushed */
+		buf = mem_or_die(malloc(20008), "string");
+		for(i = 0, seed = 1; i < 20000; i++) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = (i < 10000 ? "ab" : "cd")[(seed >> 16) & 1];
+		}
+		strcpy(buf + 20000, "ccccccy");
+
+		CHECK(probe(LAZY_FLUSH, "a(a|b)(a|b)(a|b)(a|b)(a|b)x|c(c|d)(c|d)(c|d)(c|d)(c|d)y", buf, 8192),
+			"wrx_lazy_exec() flushes its cache");
+		free(buf);
+
+		/* Equivalent patterns should have the same minimal DFA */
+		CHECK(probe(DFA_STATES, "x(:ab|cb)", NULL, 0) == probe(DFA_STATES, "x(:a|c)b", NULL, 0),
+			"wrx_comp_dfa() minimizes the DFA");
+
+		/* A DFA with too many states isn't built, but the pattern still works */
+		CHECK(probe(DFA_STATES, "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)", NULL, 50) == 0,
+			"wrx_comp_dfa() respects max_states");
+		MATCH("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)", "bbbabababbbbbbbbb");
+
+		/* The tagged DFA should be built for patterns with submatches */
+		CHECK(probe(TDFA_STATES, "(\\d+)-(\\a+):(\\w+)", NULL, 0) > 0
+			&& probe(TDFA_STATES, "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)", NULL, 50) == 0,
+			"wrx_comp_tdfa() builds the tagged DFA");
+		MATCH("(\\d+)-(\\a+):(\\w+)", "at 2015-may:x86 and 2016-june:arm");
+		MATCH("((a)|b)+", "xabba");
+
+		/* wrx_comp() should spot the patterns that wrx_onepass() can match */
+		CHECK(probe(IS_ONEPASS, "^(\\d+)-(\\a+):(\\w+)$", NULL, 0)
+			&& !probe(IS_ONEPASS, "(a|ab)c", NULL, 0) && !probe(IS_ONEPASS, "(a*)*b", NULL, 0),
+			"wrx_comp() spots one-pass patterns");
+		MATCH("^(\\d+)-(\\a+):(\\w+)$", "2015-may:x86");
+		NOMATCH("^(\\d+)-(\\a+):(\\w+)$", "2015-may:x86-64");
+		MATCH("(a|b)*c(\\d*)", "xxababc12a");
+
+		/* wrx_dfa_pexec() splits a long string among threads */
+		{
+			int i, ok, n = 1 << 20;
+			char *big = mem_or_die(malloc(n + 1), "string");
+			for(i = 0; i < n; i++)
+				big[i] = "abcab cba\nxy"[i % 13];
+			big[n] = '\0';
+			ok = probe(PEXEC_SAME, "x(a|b)*c", big, 0) && probe(PEXEC_SAME, "zz", big, 0) && probe(PEXEC_SAME, "(ab|c)+ cb$", big, 0);
+			memcpy(big + n / 4 - 3, "zz(a+)", 6);
+			memcpy(big + n - 20, "x12y", 4);
+			ok = ok && probe(PEXEC_SAME, "zz\\(a", big, 0) && probe(PEXEC_SAME, "zz|x\\d+", big, 0) && probe(PEXEC_SAME, "\\d+y.*", big, 0);
+			free(big);
+			CHECK(ok, "wrx_dfa_pexec() matches like wrx_dfa_exec()");
+		}
+
+		/* The bit-parallel matcher stops where the first match ends */
+		CHECK(probe(BITPAR_END, "x(a|b)*c+", "xxababccc12", 0) == 7 && probe(BITPAR_END, "\\d+>|<ab", "12 ab", 0) == 2,
+			"wrx_bitpar_exec() finds the first match end");
+
+		/* The matchers skip the positions where no match can begin */
+		CHECK(probe(NEXT_START, "E(RR|XX)OR", "an ERROR", 0) == 3 && probe(NEXT_START, "(:\\i[ab]|\\d)x", "cc-3Bx", 0) == 3
+			&& probe(NEXT_START, "a?b?", "ccc", 0) == 0 && probe(NEXT_START, "(a*)\\1x", "bbb", 0) == 0
+			&& probe(NEXT_START, "[xyz]+", "abc", 0) == -1,
+			"wrx_comp() finds the bytes that begin a match");
+		MATCH("E(RR|XX)OR (\\w+)", "INFO ok\nWARN EXX\nERROR EXXOR disk");
+		MATCH("^(\\w+)=", "-x\n-y\nkey=value");
+		NOMATCH("(:Z|Q)\\d", "QZ ZQ Z Q");
+
+		/* The matchers skip to where one of the strings that begin a match occurs */
+		CHECK(probe(NEXT_START, "timeout|refused|reset by peer|ECONNRESET", "the rest was reset by peer", 0) == 13
+			&& probe(NEXT_START, "\\iERROR|\\iwarn", "errand Warning", 0) == 7
+			&& probe(NEXT_START, "alpha|bravo|charlie|delta|echo|foxtrot|golf|hotel|india|juliet", "a golfer", 0) == 2
+			&& probe(NEXT_START, "(GET|POST) /", "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxPOST /", 0) == 50
+			&& probe(NEXT_START, "ab*c", "aaabbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbc", 0) == 2,
+			"wrx_comp() finds the strings that begin a match");
+		MATCH("timeout|refused|reset by peer|ECONNRESET", "read: connection reset by peer");
+		NOMATCH("timeout|refused|reset by peer|ECONNRESET", "read: connection reset by pear");
+		MATCH("(:\\iERROR|\\iwarn)(\\w*)", "errand: no Warnings");
+
+		/* wrx_exec() rejects strings without the string every match contains */
+		CHECK(probe(HAS_REQ, "^\\d+ ERROR (\\w+)", " ERROR ", 0) && probe(HAS_REQ, "(a|b)+xy(z|zz)", "xy", 0)
+			&& probe(HAS_REQ, "(\\w+)@\\iExample\\.com", "@example.com", 1) && probe(HAS_REQ, "ab|cd", NULL, 0)
+			&& probe(HAS_REQ, "(abc)?d", "d", 0),
+			"wrx_comp() finds the string that every match contains");
+		MATCH("^\\d+ ERROR (\\w+)", "12 INFO ok\n13 ERROR disk");
+		NOMATCH("^\\d+ ERROR (\\w+)", "12 INFO ok\n13 WARN ERROR disk");
+		MATCH("(\\w+)@\\iExample\\.com", "mail joe@EXAMPLE.COM now");
+		NOMATCH("(\\w+)@\\iExample\\.com", "mail joe@EXAMPLE.CO now");
+		CHECK(probe(RETURNS, "\\1b", "a", WRX_INV_BREF) && probe(RETURNS, "\\1b", "ab", WRX_INV_BREF)
+			&& probe(RETURNS, "(\\w+)@\\iExample\\.com", "mail joe", 0) && probe(RETURNS, "E(RR|XX)OR", "no such", 0),
+			"wrx_exec() gives the same result without the required string");
+
+		/* wrx_exec() matches outward from the string every match contains */
+		CHECK(probe(INNER_MATCH, "(\\w+)@example\\.com", "to: bob@example.co, ann@example.com", 0) == AT(20, 35)
+			&& probe(INNER_MATCH, "\\d+ms took", "12 ms, 3456ms took", 0) == AT(7, 18)
+			&& probe(INNER_MATCH, "[a-z]*[0-9]*:x", "ab:x", 0) == AT(0, 4)
+			&& probe(INNER_MATCH, "a\\w*ab", "aab", 0) != AT(0, 3),
+			"wrx_exec() matches outward from the required string");
+		MATCH("\\d+ms took", "1 ms took 22ms took");
+		NOMATCH("\\d+ms took", "1 ms took 22 ms took");
+
+		/* Patterns that begin with '^' are tried one line at a time, in order */
+		CHECK(probe(NEXT_START, "^(b|c)", "ab\ncd", 0) == 3 && probe(NEXT_START, "^x", "ab\n\nxy", 0) == 4
+			&& probe(NEXT_START, "^x", "ax\nbx", 0) == -1 && probe(NEXT_START, "^", "a\r\nb", 0) == 0
+			&& probe(LINE_MATCH, "^b(\\w*)", "ab\nbc\rbd", 0) == AT(3, 5) && probe(LINE_MATCH, "^$", "a\n\nb", 0) == AT(2, 2),
+			"wrx_exec() tries the lines that begin a match in order");
+
+		/* Patterns that end with '$' are searched for back from the ends of the lines */
+		CHECK(probe(REV_MATCH, "\\d+ms$", "took 12ms \r\nin 345ms\nx", 0) == AT(15, 20)
+			&& probe(REV_MATCH, "(a|ab)(c|bcd)?$", "abcd abc\nabcd", 0) == AT(5, 8)
+			&& probe(REV_MATCH, "\\w*$", "ab\ncd", 0) == AT(0, 2) && probe(REV_MATCH, "x?$", "", 0) == AT(0, 0)
+			&& probe(REV_MATCH, "x$", "a\nxx\n", 0) == AT(3, 4) && probe(REV_MATCH, ".$", "ab", 0) != AT(1, 2)
+			&& probe(REV_MATCH, "^a$", "b\na", 0) != AT(2, 3),
+			"wrx_exec() searches back from the ends of the lines");
+		MATCH("(\\w+)=(\\d+)$", "a=1x\nb=22\nc=3");
+		NOMATCH("(\\w+)=(\\d+)$", "a=1x\nb=22 \nc=3 ");
+
+		/* The matchers skip over the string to where the window that begins every match occurs */
+		{
+			int i, ok, n = 10000;
+			char *big = mem_or_die(malloc(n + 16), "string");
+			for(i = 0; i < n; i++)
+				big[i] = "rror: err Error 9 "[i % 18];
+			strcpy(big + n, "error: 42");
+			ok = probe(WINDOW_LEN, "[Ee]rror: [0-9]", NULL, 0) == 8 && probe(WINDOW_LEN, "\\d{4}-\\d\\d", NULL, 0) == 7
+				&& probe(WINDOW_LEN, "[Ee]rror: (\\w+)", NULL, 0) == 7 && probe(WINDOW_LEN, "\\w\\w\\w\\w", NULL, 0) == 0
+				&& probe(WINDOW_LEN, "a[bc]d", NULL, 0) == 0 && probe(WINDOW_LEN, "timeout: \\d", NULL, 0) == 0
+				&& probe(NEXT_START, "[Ee]rror: [0-9]", "error: x, Error: 7", 0) == 10
+				&& probe(NEXT_START, "\\d{4}-\\d\\d", "12-2024-1 2024-12", 0) == 10
+				&& probe(NEXT_START, "[Ee]rror: [0-9]", big, 0) == n && probe(NEXT_START, "[Ee]rror: [0-9]", big + n + 1, 0) == -1;
+			free(big);
+			CHECK(ok, "wrx_comp() finds the window that begins a match");
+		}
+		MATCH("[Ee]rror: (\\d+)", "no error: x, but Error: 503");
+		NOMATCH("[Ee]rror: (\\d+)", "no error: x, nor Error: y");
+
+		/* A failed try at the beginning of a leading loop rules out the rest of its run */
+		{
+			int i, ok, n = 100000;
+			char *big = mem_or_die(malloc(n + 1), "string");
+			for(i = 0; i < n; i++)
+				big[i] = "abcdefgh"[i % 8];
+			big[n] = '\0';
+			memcpy(big, "foo", 3);
+			ok = probe(HAS_LOOP, ".*foo", NULL, 0) && probe(HAS_LOOP, "(\\w+)@(\\w+)\\.com", NULL, 0)
+				&& probe(HAS_LOOP, "[a-z]*?\\d", NULL, 0) && !probe(HAS_LOOP, "a\\w+", NULL, 0)
+				&& !probe(HAS_LOOP, "(\\w+)-\\1", NULL, 0) && !probe(HAS_LOOP, "<\\w+>", NULL, 0)
+				&& probe(ENGINE_EXEC, ".*foo\\d", big, WRX_ENG_BACKTRACK) == 0
+				&& probe(ENGINE_EXEC, "[a-z]*\\d", big, WRX_ENG_BACKTRACK) == 0
+				&& probe(ENGINE_EXEC, "(\\w+)@(\\w+)\\.com", big, WRX_ENG_ONEPASS) == 0
+				&& probe(ENGINE_EXEC, "\\w+:x", big, WRX_ENG_ONEPASS) == 0
+				&& probe(ENGINE_EXEC, ".*h", big, WRX_ENG_BACKTRACK) == 1;
+			free(big);
+			CHECK(ok, "wrx_exec() doesn't retry inside a leading loop");
+		}
+		MATCH("(\\w+)@(\\w+)\\.com", "mail bob.smith@example.com");
+		MATCH("\\w+:x", "a:b aa:x");
+		NOMATCH("\\w+:x", "a:b aa:y");
+
+		/* Patterns whose matches all have the same length get wrx_fixed() */
+		CHECK(probe(ENGINE, "\\d{4}-\\d{2}-\\d{2}", NULL, 0) == WRX_ENG_FIXED
+			&& probe(ENGINE, "<([0-9a-f]{8})>", NULL, 0) == WRX_ENG_FIXED
+			&& probe(ENGINE, "\\d{2,4}", NULL, 0) != WRX_ENG_FIXED && probe(ENGINE, "a(b|c)", NULL, 0) != WRX_ENG_FIXED,
+			"wrx_comp() spots fixed-length patterns");
+		MATCH("(\\d{4})-(\\d{2})-(\\d{2})", "released on 2015-06-21, fixed on 2015-07-01");
+		MATCH("<([0-9a-f]{8})>", "id 0123456789 then deadbeef and cafef00d");
+		NOMATCH("^\\d{4}$", "12015\nabcd 201516");
+		MATCH("\\i(ab)x", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaABX");
+
+		/* wrx_aexec() allows insertions, deletions and substitutions */
+		CHECK(probe(AEXEC_END, "hello", "say helo world", 0) == -1 && probe(AEXEC_END, "hello", "say helo world", 1) == 81
+			&& probe(AEXEC_END, "hello", "say hxllo world", 1) == 91 && probe(AEXEC_END, "hello", "say heello", 1) == 101
+			&& probe(AEXEC_END, "<world>", "a word here", 1) == 61 && probe(AEXEC_END, "<world>", "a swords", 1) == -1
+			&& probe(AEXEC_END, "(a+)\\1", "aa", 1) < -1,
+			"wrx_aexec() finds approximate matches");
+
+		/* wrx_comp() should choose the engine that suits the pattern */
+		CHECK(probe(ENGINE, "abc", NULL, 0) == WRX_ENG_LITERAL && probe(ENGINE, "a\\.b", NULL, 0) == WRX_ENG_LITERAL
+			&& probe(ENGINE, "\\iTimeout", NULL, 0) == WRX_ENG_LITERAL && probe(ENGINE, "a\\ib", NULL, 0) != WRX_ENG_LITERAL
+			&& probe(ENGINE, "^(\\d+)-(\\a+)$", NULL, 0) == WRX_ENG_ONEPASS && probe(ENGINE, "(a\\w*)[=:]", NULL, 0) != WRX_ENG_ONEPASS
+			&& probe(ENGINE, "(a|ab)c", NULL, 0) == WRX_ENG_BITPAR
+			&& probe(ENGINE, "(a+)x\\1", NULL, 0) == WRX_ENG_BACKTRACK && probe(ENGINE, "(abc)", NULL, 0) != WRX_ENG_LITERAL,
+			"wrx_comp() chooses the engine");
+		MATCH("a\\.b", "a.a.b");
+		NOMATCH("a\\.b", "axb a.c");
+		MATCH("(a|ab)(c|bcd)(d*)", "xabcd");
+		MATCH("\\iTimeout", "read tcp: i/o TIMEOUT");
+		MATCH("\\iTimeout", "a longer line than the vectors are wide, ending in a tImEoUt");
+		NOMATCH("\\iTimeout", "a longer line than the vectors are wide, ending in a time-out");
+
+		/* wrx_exec() should stop backtracking when it gets nowhere */
+		CHECK(probe(GIVES_UP, "(:x+x+)+y", "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", 0) && probe(GIVES_UP, "(:x+x+)+y", "xxxxxxy", 0)
+			&& probe(GIVES_UP, "(a|ab)(c|bcd)(d*)", "abcd", 0),
+			"wrx_exec() gives up backtracking");
+
+#if defined(__x86_64__) && defined(__linux__)
+		/* wrx_jit() should compile everything but back references */
+		CHECK(probe(JITS, "(a|ab)(c|bcd)(d*)", NULL, 0) && probe(JITS, "\\b[\\u\\l]+(\\d*)$", NULL, 0)
+			&& !probe(JITS, "(a+)x\\1", NULL, 0),
+			"wrx_jit() generates code");
+#endif
+
+		/* date.o is what wrxgen wrote for date.re; it should match like wrx_exec() */
+		CHECK(probe(DATE_SAME, DATE_RE, "on 2024-03-07T12:45 at", 0) && probe(DATE_SAME, DATE_RE, "2024-3-7", 0)
+			&& probe(DATE_SAME, DATE_RE, "12024-03-0", 0) && probe(DATE_SAME, DATE_RE, "24-03-07, 1999-12-31T23", 0)
+			&& probe(DATE_SAME, DATE_RE, "", 0) && probe(DATE_SAME, DATE_RE, "x2024-12-01T5:6:7", 0),
+			"date() from wrxgen matches like wrx_exec()");
+		MATCH("^(\\i[a-f]+)>(.*)$", "\nxyz\nBad food\n");
+
 		printf("\n______________\nSuccess: %d/%d\n", success, total);
+		if(mismatches)
+			printf("Mismatches: %d\n", mismatches);
 
-		if(success != total)
+		if(success != total || mismatches)
 			fprintf(stderr, "Some tests failed!\n");
 
 		return 0;
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	Tests for wregex.hpp. The static_asserts run the matcher at compile
+ *	time; main() checks that it agrees with wrx_exec() on long strings.
+ */
+
+#include <cstdio>
+#include <string>
+
+#include "wregex.h"
+#include "wregex.hpp"
+
+static_assert(wrx::regex<"a*b">::match("xaaab"));
+static_assert(!wrx::regex<"a*b">::match("aaaa"));
+static_assert(wrx::regex<"^\\d{4}-\\d{2}-\\d{2}$">::match("2015-06-21"));
+static_assert(!wrx::regex<"^\\d{4}-\\d{2}-\\d{2}$">::match("12015-06-21"));
+static_assert(wrx::regex<"^(\\i[a-f]+)>(.*)$">::match("\nxyz\nBad food\n"));
+static_assert(wrx::regex<"(:a|a)*b">::exec("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa") == 0);
+static_assert(wrx::regex<"(abc) \\1">::match("abc abc") && !wrx::regex<"(abc) \\1">::match("abc bbc"));
+static_assert(wrx::regex<"([abc]{3})-\\i\\1">::match("abc-ABC"));
+static_assert(wrx::regex<"(a)|\\1">::exec("b") == -16);
+
+/* The submatches are the ones wrx_exec() finds */
+static_assert([] {
+	const char *s = "xabcd";
+	wregmatch_t m[4];
+	return wrx::regex<"(a|ab)(c|bcd)(d*)">::exec(s, m, 4) == 1
+		&& m[0].beg == s + 1 && m[0].end == s + 5 && m[1].beg == s + 1 && m[1].end == s + 2
+		&& m[2].beg == s + 2 && m[2].end == s + 5 && m[3].beg == s + 5 && m[3].end == s + 5;
+}());
+static_assert([] {
+	const char *s = "b";
+	wregmatch_t m[2];
+	return wrx::regex<"(:a*)*(b)">::exec(s, m, 2) == 1 && m[1].beg == s && m[1].end == s + 1;
+}());
+
+/* Strings too long for the bitmap follow all the states at once */
+static_assert([] {
+	char s[2000] = {};
+	wregmatch_t m[2];
+	for(int i = 0; i < 1998; i++)
+		s[i] = i < 1000 ? 'x' : 'a';
+	s[1998] = 'b';
+	return wrx::regex<"(a*)b">::exec(s, m, 2) == 1 && m[1].beg == s + 1000 && m[1].end == s + 1998
+		&& !wrx::regex<"a*c">::match(s);
+}());
+
+static int total = 0, success = 0;
+
+#define CHECK(cond, msg)  do{\
+					total++;\
+					if(cond) \
+					{\
+						success++;\
+						printf("[%s:%3d] SUCCESS....: %s\n", __FILE__, __LINE__, msg);\
+					}\
+					else\
+					{\
+						printf("[%s:%3d] FAIL.......: %s\n", __FILE__, __LINE__, msg);\
+					}\
+                    fflush(stdout);\
+					} while(0)
+
+/*
+ *	Does wrx::regex<P> return the same result and submatches as wrx_exec()
+ *	for s?
+ */
+template<wrx::pattern P>
+static bool same(const std::string &s) {
+	wregex_t *r;
+	wregmatch_t m1[10] = {}, m2[10] = {};
+	int e, ep, e1, e2, i, nsm;
+	bool ok;
+
+	r = wrx_comp(P.s, &e, &ep);
+	if(!r) {
+		fprintf(stderr, "\nERROR......: \"%s\": %s\n", P.s, wrx_error(e));
+		return false;
+	}
+	nsm = r->n_subm < 10 ? r->n_subm : 10;
+	e1 = wrx_exec(r, s.c_str(), m1, nsm);
+	e2 = wrx::regex<P>::exec(s.c_str(), m2, nsm);
+	ok = e1 == e2;
+	if(ok && e1 == 1)
+		for(i = 0; i < nsm; i++)
+			if(m1[i].beg != m2[i].beg || m1[i].end != m2[i].end)
+				ok = false;
+	wrx_free(r);
+	return ok;
+}
+
+int main() {
+	std::string a(1 << 20, 'a'), w(100000, 'x');
+
+	/* These used to recurse once for every character */
+	CHECK(same<"a*b">(a) && same<"a*b">(a + "b"), "\"a*b\" on 1 MB");
+	CHECK(same<"(a+)(b?)$">(a) && same<"<(\\w+)>">(a), "submatches on 1 MB");
+	CHECK(same<"(\\w+)@(\\w+)">(w + "@y") && same<"(\\w+)@(\\w+)">(w), "\"(\\w+)@(\\w+)\" on 100 KB");
+
+	/* wrx_exec() gives up on these, since it can't fall back on wrx_thom() */
+	CHECK(wrx::regex<"^(a)\\1*$">::match(a.c_str()) && !wrx::regex<"^(a)\\1*$">::match((a + "b").c_str()),
+		"back references on 1 MB");
+
+	printf("\n______________\nSuccess: %d/%d\n", success, total);
+	if(success != total)
+		fprintf(stderr, "Some tests failed!\n");
+
+	return 0;
+}
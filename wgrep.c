@@ -20,16 +20,19 @@ void usage(char *s) {
     printf("  -o outfilename   - Specify output file\n");
     printf("  -v               - Invert matches\n");
     printf("  -s               - Output only submatches\n");
+    printf("  -k n             - Allow up to n errors in a match\n");
     printf("Under construction...\n");
 }
 
 /*
  *  "greps" a file by matching each line in infile to the wregex_t, writes
- *	the results to outfile.
+ *	the results to outfile. If k > 0, a line matches if it contains a string
+ *	that is at most k inserts, deletes or substitutions away from a match.
  */
-void grep(wregex_t *r, FILE *infile, FILE *outfile, int flags) {
+void grep(wregex_t *r, FILE *infile, FILE *outfile, int flags, int k) {
     char buffer[256], *sm;
     wregmatch_t *subm;
+    wrx_lazy *dfa = NULL;
     int e, i, len;
 
     /* Allocate enough memory for all the submatches in the wregex_t */
@@ -43,12 +46,27 @@ void grep(wregex_t *r, FILE *infile, FILE *outfile, int flags) {
 	} else
 		subm = NULL;
 
+    /* If we don't need the submatches, a DFA can tell us faster whether
+        the line matches */
+    if(!(flags & SUBMATCHES) && k == 0) {
+        dfa = wrx_lazy_new(r, 0);
+        if(!dfa) {
+            fprintf(stderr, "Error: out of memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* For each line in the file */
     while(!feof(infile)) {
         /* Read the line */
         if(fgets(buffer, sizeof buffer, infile) == buffer) {
             /* Match the line to the wregex_t */
-            e = wrx_exec(r, buffer, subm, r->n_subm);
+            if(k > 0)
+                e = wrx_aexec(r, buffer, k, NULL, NULL);
+            else if(dfa)
+                e = wrx_lazy_exec(dfa, buffer, NULL);
+            else
+                e = wrx_exec(r, buffer, subm, r->n_subm);
 
             if(e == 1 && flags & SUBMATCHES) {
 	            /* Print only the submatches */
@@ -83,6 +101,8 @@ void grep(wregex_t *r, FILE *infile, FILE *outfile, int flags) {
             }
         }
     }
+
+    wrx_lazy_free(dfa);
 }
 
 int main(int argc, char *argv[]) {
@@ -93,16 +113,17 @@ int main(int argc, char *argv[]) {
         *ofn = NULL,    /* outfile name */
         *pat;           /* pattern */
 
-    int i, e, ep, flags = 0;
+    int i, e, ep, flags = 0, k = 0;
 
     wregex_t *r; /* Used to store the compiled regular expression */
 
     /* Parse the command line options */
-    while ((c = getopt(argc, argv, "o:vs?")) != EOF) {
+    while ((c = getopt(argc, argv, "o:vsk:?")) != EOF) {
       switch (c) {
         case 'o': ofn = optarg; break;
         case 'v': flags |= INVERT; break;
         case 's': flags |= SUBMATCHES; break;
+        case 'k': k = atoi(optarg); break;
         case '?': usage(argv[0]); return 1;
         }
     }
@@ -113,6 +134,12 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if(k > 0 && (flags & SUBMATCHES)) {
+        /* Approximate matches don't have submatches */
+        fprintf(stderr, "Error: -s can't be used with -k\n");
+        return 1;
+    }
+
     if(ofn) {
         /* Open the output file */
         outfile = fopen(ofn, "w");
@@ -146,14 +173,14 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
             /* "grep" to input file */
-            grep(r, infile, outfile, flags);
+            grep(r, infile, outfile, flags, k);
 
             /* ...and close it */
             fclose(infile);
         }
     } else {
         /* "grep" stdin */
-        grep(r, stdin, outfile, flags);
+        grep(r, stdin, outfile, flags, k);
     }
 
     /* Deallocate the memory allocated to the wregex_t */
@@ -29,6 +29,8 @@
 #ifndef _WREGEX_H
 #define _WREGEX_H
 
+#include <stddef.h>
+
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
 #endif
@@ -68,8 +70,100 @@ typedef struct _wregex_t
 
 	/* Copy of the pattern passed to wrx_comp() */
 	char *p;
+
+	/* The DFA built by wrx_comp_dfa(), or NULL */
+	struct _wrx_dfa *dfa;
+
+	/* The DFA for the reversed pattern, used by wrx_dfa_match() to find
+	where a match starts, or NULL */
+	struct _wrx_dfa *rdfa;
+
+	/* The tagged DFA built by wrx_comp_tdfa(), or NULL */
+	struct _wrx_tdfa *tdfa;
+
+	/* The tables used by wrx_onepass(), or NULL if the NFA isn't one-pass */
+	struct _wrx_onepass *onepass;
+
+	/* The engine that wrx_exec() uses to match the NFA, one of the
+	WRX_ENG_* values below. wrx_comp() chooses it, but it may be changed */
+	int engine;
+
+	/* The string that the pattern matches, if it is nothing but a literal
+	string, or NULL */
+	char *lit;
+
+	/* Set if lit is compared without regard to case. It is then in lower case */
+	int lit_ci;
+
+	/* The longest string that every match contains, or NULL. wrx_exec()
+	rejects the strings that don't contain it without matching them */
+	char *req;
+
+	/* Set if req is compared without regard to case. It is then in lower case */
+	int req_ci;
+
+	/* The bytes that the part of a match before req can consist of, as a bit
+	vector, or NULL if that part may contain the first byte of req. If it is
+	set, wrx_exec() looks for req first and matches outward from there */
+	unsigned char *req_pre;
+
+	/* The bytes with which a match can begin, or NULL if a match can begin
+	with any byte or be empty */
+	struct _wrx_first *first;
+
+	/* The strings with which every match begins, if there are a few that are
+	longer than a byte, or NULL. wrx_next_start() skips to where they occur */
+	struct _wrx_lits *lits;
+
+	/* The window of characters or small sets of characters with which every
+	match begins, for patterns without lits, or NULL. wrx_next_start()
+	skips to where it occurs */
+	struct _wrx_bndm *bndm;
+
+	/* The bytes of the loop with which the pattern begins, as in ".*foo", as
+	a bit vector, or NULL. Once no match begins at a position, wrx_retry()
+	skips the positions after it that follow a byte of the loop */
+	unsigned char *loop;
+
+	/* Set if every match begins at the beginning of a line, because the
+	pattern begins with '^'. wrx_next_start() skips from line to line */
+	int bol;
+
+	/* The NFA for the reverse of the pattern, if it ends with '$' but doesn't
+	begin with '^' and no match spans more than one line, or NULL.
+	wrx_exec() then searches back from the ends of the lines */
+	struct _wregex_t *rev;
+
+	/* The tables used by wrx_fixed(), or NULL if the matches don't all have
+	the same length */
+	struct _wrx_fixed *fixed;
+
+	/* The bit-parallel matcher that wrx_exec() uses when the engine is
+	WRX_ENG_BITPAR, built by wrx_comp(), or NULL */
+	struct _wrx_bitpar *bitpar;
+
+	/* The machine code generated by wrx_jit(), or NULL */
+	struct _wrx_jit *jit;
+
+	/* The largest bitmap in which wrx_exec() may mark the states it has tried
+	at each position in the string. Strings that need a larger one are
+	matched without it. Set to 0 to never use the bitmap */
+	size_t memo_max;
 } wregex_t;
 
+/*
+ *	The engines that wrx_exec() can dispatch to (see wregex_t::engine)
+ */
+#define WRX_ENG_BACKTRACK	0	/* The backtracker; the only one for back references */
+#define WRX_ENG_PIKE		1	/* wrx_thom() */
+#define WRX_ENG_ONEPASS		2	/* wrx_onepass() */
+#define WRX_ENG_DFA			3	/* wrx_dfa_match() */
+#define WRX_ENG_TDFA		4	/* wrx_tdfa_exec() */
+#define WRX_ENG_BITPAR		5	/* wrx_bitpar_exec(), or the backtracker for submatches */
+#define WRX_ENG_LITERAL		6	/* A search for wregex_t::lit */
+#define WRX_ENG_JIT			7	/* wrx_jit_exec() */
+#define WRX_ENG_FIXED		8	/* wrx_fixed() */
+
 /*@ typedef struct _wregmatch_t wregmatch_t
  *#	Structure used to capture a submatch.
  *[
@@ -101,6 +195,36 @@ typedef struct _wregmatch_t
  */
 wregex_t *wrx_comp(const char *pattern, int *e, int *ep);
 
+/*@ wregex_t *wrx_comp_dfa(const char *pattern, int *e, int *ep, int max_states)
+ *#	Compiles the pattern like {{wrx_comp()}} does, and then builds the complete
+ *#	DFA for it, minimizes it and stores it in the {{wregex_t}}, for use with
+ *#	{{wrx_dfa_exec()}}.\n
+ *#	This takes a lot longer than {{wrx_comp()}}, and the number of states of
+ *#	a DFA can grow exponentially with the length of the pattern, so it is
+ *#	meant for patterns that are compiled once and matched very often.\n
+ *#	{{max_states}} limits the number of states the DFA may have before it is
+ *#		minimized. If the limit is exceeded, or if the pattern contains back
+ *#		references, no DFA is stored and {{wrx_dfa_exec()}} uses the NFA
+ *#		instead. Use 0 for a default of 10000 states.\n
+ *#	The other parameters and the return value are the same as {{wrx_comp()}}'s.
+ *#	The {{wregex_t}} can be used with all the other matching functions.
+ */
+wregex_t *wrx_comp_dfa(const char *pattern, int *e, int *ep, int max_states);
+
+/*@ wregex_t *wrx_comp_tdfa(const char *pattern, int *e, int *ep, int max_states)
+ *#	Compiles the pattern like {{wrx_comp()}} does, and then builds a tagged DFA
+ *#	for it (as described by Ville Laurikari), for use with {{wrx_tdfa_exec()}}.\n
+ *#	A tagged DFA keeps the positions recorded by the parentheses in registers,
+ *#	and its transitions copy the registers around, so it extracts the
+ *#	submatches while it matches the string.\n
+ *#	{{max_states}} limits the number of states the DFA may have. If the limit is
+ *#		exceeded, or if the pattern contains back references, no DFA is stored
+ *#		and {{wrx_tdfa_exec()}} uses the NFA instead. Use 0 for a default of
+ *#		10000 states.\n
+ *#	The other parameters and the return value are the same as {{wrx_comp()}}'s.
+ */
+wregex_t *wrx_comp_tdfa(const char *pattern, int *e, int *ep, int max_states);
+
 /*@ int wrx_exec(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
  *#	Pattern matching function.\n
  *#	Matches the regular expression compiled by {{wrx_comp()}} against a string {/'str'/}.\n
@@ -112,10 +236,250 @@ wregex_t *wrx_comp(const char *pattern, int *e, int *ep);
  *#		matching part of the string.\n
  *#	{{nsm}} The number of elements in the {{subm}} array.\n
  *#	Returns 1 on a match, 0 on no match, and < 0 on a error. Use {{wrx_error()}}
- *#		to get a message associated with the error.
+ *#		to get a message associated with the error.\n
+ *#	{{wrx_exec()}} hands the work to the engine in {{wreg->engine}}, which
+ *#	{{wrx_comp()}} picks for the pattern: A search for the string if the
+ *#	pattern is a literal string, {{wrx_fixed()}} for patterns whose matches
+ *#	all have the same length, {{wrx_onepass()}} for one-pass patterns that
+ *#	start with a {/'^'/}, {{wrx_bitpar_exec()}} for small patterns when no
+ *#	submatches are wanted, {{wrx_thom()}} for very large patterns, and
+ *#	otherwise the backtracker, which is the only engine that can match back
+ *#	references.
+ *#	{{wrx_comp_dfa()}} and {{wrx_comp_tdfa()}} choose the DFA they built.
+ *#	The engines all find the same match.\n
+ *#	Unless the pattern contains back references, the backtracker records the
+ *#	states it has tried at each position in the string in a bitmap, so that it
+ *#	never tries the same one twice, and patterns such as {/"(:a|a)*b"/} don't
+ *#	make it backtrack catastrophically. The bitmap takes the length of the
+ *#	string times the number of states in bits, and is allocated for each call
+ *#	once the backtracker has taken a few hundred steps. The search then
+ *#	begins again with the bitmap, so the submatches don't depend on when
+ *#	it was set up.
+ *#	Strings that would need more than {{wreg->memo_max}} bytes (1MB by
+ *#	default) are matched without the bitmap. If the backtracker then takes
+ *#	too many steps for the length of the string, it gives up and the string
+ *#	is matched with {{wrx_thom()}} instead. {{wrx_exec()}} doesn't change
+ *#	the {{wregex_t}}, so several threads may use it at the same time.
  */
 int wrx_exec(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
 
+/*@ int wrx_thom(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
+ *#	Pattern matching function that doesn't backtrack.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_exec()}}, but
+ *#	it follows all the paths through the NFA at the same time (Thompson's method)
+ *#	so its running time is bounded by the length of {{str}} times the number of
+ *#	states in the NFA. Patterns such as {/"(:x+x+)+y"/} that cause {{wrx_exec()}}
+ *#	to backtrack catastrophically are therefore handled in linear time.\n
+ *#	Back references can't be matched this way, so if the pattern contains any
+ *#	{{wrx_thom()}} simply calls {{wrx_exec()}}.
+ */
+int wrx_thom(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
+
+/*@ typedef struct _wrx_lazy wrx_lazy
+ *#	A lazily built DFA for a {{wregex_t}}, created with {{wrx_lazy_new()}}.\n
+ *#	The DFA's states are only computed as the characters in the strings being
+ *#	matched call for them, and are kept in a cache for the next time they're
+ *#	needed, so once the cache is warm each character costs a table lookup.
+ *#	The DFA only tells whether the string matched and where the match ended;
+ *#	use {{wrx_exec()}} or {{wrx_thom()}} if you need the submatches.\n
+ *#	The cache is not protected in any way, so each thread should create its
+ *#	own {{wrx_lazy}}.
+ */
+typedef struct _wrx_lazy wrx_lazy;
+
+/*@ wrx_lazy *wrx_lazy_new(const wregex_t *wreg, size_t max_mem)
+ *#	Creates a lazy DFA for the {{wregex_t}} compiled by {{wrx_comp()}}.\n
+ *#	{{wreg}} must not be freed while the {{wrx_lazy}} is in use.\n
+ *#	{{max_mem}} is the number of bytes that the state cache may use. When the
+ *#		cache is full it is flushed and the states are built again. If that
+ *#		happens too often the DFA gives up and matches the string with
+ *#		{{wrx_thom()}} instead. Use 0 for a default size of 1MB.\n
+ *#	Patterns with back references can't be matched by a DFA, so they are
+ *#	always matched with the NFA.\n
+ *#	Returns {{NULL}} if it runs out of memory.
+ */
+wrx_lazy *wrx_lazy_new(const wregex_t *wreg, size_t max_mem);
+
+/*@ int wrx_lazy_exec(wrx_lazy *dfa, const char *str, const char **end)
+ *#	Matches the string {/'str'/} with a lazy DFA.\n
+ *#	If {{end}} is not {{NULL}}, it will point to the end of the match, which
+ *#	is the same as {{subm[0].end}} would be after a call to {{wrx_exec()}}.\n
+ *#	Returns 1 on a match, 0 on no match, and < 0 on a error.
+ */
+int wrx_lazy_exec(wrx_lazy *dfa, const char *str, const char **end);
+
+/*@ void wrx_lazy_stats(const wrx_lazy *dfa, unsigned long *hits, unsigned long *misses, unsigned long *flushes)
+ *#	Retrieves the lazy DFA's counters, which may be useful for choosing a
+ *#	size for its cache. Any of the pointers may be {{NULL}}.\n
+ *#	{{hits}} is the number of characters for which the transition was
+ *#		already in the cache.\n
+ *#	{{misses}} is the number of transitions that had to be computed.\n
+ *#	{{flushes}} is the number of times the cache was flushed because it was full.
+ */
+void wrx_lazy_stats(const wrx_lazy *dfa, unsigned long *hits, unsigned long *misses, unsigned long *flushes);
+
+/*@ void wrx_lazy_free(wrx_lazy *dfa)
+ *#	Deallocates a {{wrx_lazy}} created by {{wrx_lazy_new()}}.
+ */
+void wrx_lazy_free(wrx_lazy *dfa);
+
+/*@ typedef struct _wrx_bitpar wrx_bitpar
+ *#	A bit-parallel matcher for a {{wregex_t}}, created with {{wrx_bitpar_new()}}.\n
+ *#	If the pattern has no more than 64 states that consume characters, the set
+ *#	of states that are active at a point in the string fits in a 64-bit word,
+ *#	and the matcher moves the whole set past the next character with a couple
+ *#	of table lookups, shifts and ANDs. Its tables are built much faster than
+ *#	a DFA, which makes it a good choice for short patterns on short strings.
+ */
+typedef struct _wrx_bitpar wrx_bitpar;
+
+/*@ wrx_bitpar *wrx_bitpar_new(const wregex_t *wreg)
+ *#	Creates a bit-parallel matcher for the {{wregex_t}} compiled by {{wrx_comp()}}.\n
+ *#	{{wreg}} must not be freed while the {{wrx_bitpar}} is in use.\n
+ *#	Patterns with more than 64 states that consume characters or with back
+ *#	references are matched with {{wrx_thom()}} instead.\n
+ *#	Returns {{NULL}} if it runs out of memory.
+ */
+wrx_bitpar *wrx_bitpar_new(const wregex_t *wreg);
+
+/*@ int wrx_bitpar_exec(const wrx_bitpar *bp, const char *str, const char **end)
+ *#	Tells whether the string {/'str'/} matches, with a bit-parallel matcher.\n
+ *#	If {{end}} is not {{NULL}}, it will point to the first position in the
+ *#	string where a match ends. This need not be the end of the match that
+ *#	{{wrx_exec()}} would find, because the matcher stops as soon as it
+ *#	knows that the string matches.\n
+ *#	Returns 1 on a match, 0 on no match, and < 0 on a error.
+ */
+int wrx_bitpar_exec(const wrx_bitpar *bp, const char *str, const char **end);
+
+/*@ void wrx_bitpar_free(wrx_bitpar *bp)
+ *#	Deallocates a {{wrx_bitpar}} created by {{wrx_bitpar_new()}}.
+ */
+void wrx_bitpar_free(wrx_bitpar *bp);
+
+/*@ int wrx_aexec(const wregex_t *wreg, const char *str, int k, const char **end, int *err)
+ *#	Tells whether some part of the string {/'str'/} is at most {{k}} edits away
+ *#	from a string that matches the pattern, where an edit inserts, deletes
+ *#	or substitutes a single character.\n
+ *#	It uses the tables of {{wrx_bitpar_new()}}, keeping a set of positions for
+ *#	each number of errors from 0 to {{k}}, so it takes time proportional to
+ *#	{{k}} times the length of the string.\n
+ *#	The assertions ('^', '$', '<', '>' and "\b") are tested against the
+ *#	characters of the string, and can't be edited away.\n
+ *#	If {{end}} is not {{NULL}}, it will point to the first position in the
+ *#	string where such a match ends, and if {{err}} is not {{NULL}} it will be
+ *#	set to the fewest edits of a match that ends there.\n
+ *#	Returns 1 on a match, 0 on no match, and < 0 on a error. Patterns with
+ *#	more than 64 states that consume characters or with back references
+ *#	can't be matched this way, and give an error for which {{wrx_error()}}
+ *#	says so.
+ */
+int wrx_aexec(const wregex_t *wreg, const char *str, int k, const char **end, int *err);
+
+/*@ int wrx_dfa_exec(const wregex_t *wreg, const char *str, const char **end)
+ *#	Matches the string {/'str'/} with the DFA built by {{wrx_comp_dfa()}}.\n
+ *#	If {{end}} is not {{NULL}}, it will point to the end of the match, which
+ *#	is the same as {{subm[0].end}} would be after a call to {{wrx_exec()}}.\n
+ *#	If {{wreg}} doesn't have a DFA, the string is matched with {{wrx_thom()}}.\n
+ *#	Returns 1 on a match, 0 on no match, and < 0 on a error.
+ */
+int wrx_dfa_exec(const wregex_t *wreg, const char *str, const char **end);
+
+/*@ int wrx_dfa_pexec(const wregex_t *wreg, const char *str, int nthreads, const char **end)
+ *#	Matches a long string {/'str'/} with the DFA built by {{wrx_comp_dfa()}} on
+ *#	{{nthreads}} threads at once, or on one thread per processor if {{nthreads}}
+ *#	is 0. The string is divided into a chunk for each thread. Each chunk but
+ *#	the first is run from every state of the DFA, following only one path
+ *#	once two of them reach the same state, and the chunks are then joined
+ *#	in order.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_dfa_exec()}},
+ *#	which it calls for strings too short to be worth dividing, or if threads
+ *#	aren't available.\n
+ *#	Returns 1 on a match, 0 on no match, and < 0 on a error.
+ */
+int wrx_dfa_pexec(const wregex_t *wreg, const char *str, int nthreads, const char **end);
+
+/*@ int wrx_dfa_match(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
+ *#	Matches the string {/'str'/} in three phases, using the DFAs built by
+ *#	{{wrx_comp_dfa()}}.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_exec()}}.\n
+ *#	First the DFA finds where the match ends. Then a DFA built from the
+ *#	reversed pattern runs backwards from there to find where the match
+ *#	starts. Only then, if more than {{subm[0]}} is wanted, are the submatches
+ *#	extracted by {{wrx_thom()}}'s engine, which has to consider just that part
+ *#	of the string. A long string that doesn't match is therefore scanned only
+ *#	once, rather than once from every position as {{wrx_exec()}} does.\n
+ *#	If {{wreg}} doesn't have the DFAs, the string is matched with {{wrx_thom()}}.
+ */
+int wrx_dfa_match(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
+
+/*@ int wrx_tdfa_exec(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
+ *#	Matches the string {/'str'/} with the tagged DFA built by {{wrx_comp_tdfa()}}.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_exec()}},
+ *#	but it looks at each character in the string only once, and costs a table
+ *#	lookup and a few copies of pointers per character.\n
+ *#	If {{wreg}} doesn't have a tagged DFA, the string is matched with {{wrx_thom()}}.
+ */
+int wrx_tdfa_exec(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
+
+/*@ int wrx_jit(wregex_t *wreg)
+ *#	Translates the NFA to machine code, so that {{wrx_exec()}} matches strings
+ *#	without interpreting the states one by one. The backtracking is done on the
+ *#	machine stack, and gives the same results as {{wrx_exec()}}'s.\n
+ *#	The JIT compiler is only available on x86-64 Linux, and doesn't handle
+ *#	back references. It returns 0 on success, or an error code < 0 if the
+ *#	code could not be generated, in which case {{wrx_exec()}} simply carries on
+ *#	using the engine chosen by {{wrx_comp()}}.\n
+ *#	The code is freed by {{wrx_free()}}.
+ */
+int wrx_jit(wregex_t *wreg);
+
+/*@ int wrx_jit_exec(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
+ *#	Matches the string {/'str'/} with the code generated by {{wrx_jit()}}.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_exec()}}.
+ *#	Like {{wrx_exec()}}'s backtracker, the code marks the states it has tried
+ *#	at each position in a bitmap, so it takes time linear in the length of
+ *#	the string, and counts its steps if the string is too long for the
+ *#	bitmap. Its backtracking nests a native call for every character that a
+ *#	loop consumes, on a stack of up to 1MB. If the code takes too many
+ *#	steps, or a loop runs over tens of thousands of characters and uses up
+ *#	the stack, the string is matched with {{wrx_thom()}} instead.
+ *#	If {{wreg}} has no code, the string is matched with the backtracker.
+ */
+int wrx_jit_exec(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
+
+/*@ int wrx_onepass(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
+ *#	Pattern matching function for one-pass patterns.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_exec()}}.\n
+ *#	A pattern is one-pass if, wherever the matcher finds itself in the NFA,
+ *#	no more than one of the paths it can take next consumes any given character,
+ *#	as in {/"^([0-9]+)-([a-z]+):(.*)$"/}. {{wrx_comp()}} spots these patterns and
+ *#	lists the paths in advance, so {{wrx_onepass()}} never has to guess and
+ *#	extracts the submatches in a single pass over the match, without a
+ *#	backtracking stack or lists of threads.\n
+ *#	A single pass finds the match that begins at one position, so only
+ *#	patterns that start with a {/'^'/} are matched this way, with a pass
+ *#	for each line in the string. Trying every position in the string would
+ *#	take time quadratic in its length.\n
+ *#	If the pattern isn't one-pass, or doesn't start with a {/'^'/}, the
+ *#	string is matched with {{wrx_thom()}}.
+ */
+int wrx_onepass(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
+
+/*@ int wrx_fixed(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm)
+ *#	Pattern matching function for patterns without alternatives or repetition
+ *#	other than {/"{n}"/}, such as {/"\d{4}-\d{2}-\d{2}"/} or {/"[0-9a-f]{32}"/}.\n
+ *#	It takes the same parameters and gives the same results as {{wrx_exec()}}.\n
+ *#	All the matches of such a pattern have the same length, and {{wrx_comp()}}
+ *#	stores the set of characters that each position in the match accepts.
+ *#	Where SSE2 or AVX2 is available, the sets are tested on 16 or 32
+ *#	starting positions at once, the smallest sets first.
+ *#	The submatches are at fixed offsets in the match.\n
+ *#	If the matches don't all have the same length, the string is matched
+ *#	with {{wrx_thom()}}.
+ */
+int wrx_fixed(const wregex_t *wreg, const char *str, wregmatch_t subm[], int nsm);
+
 /*@ void wrx_free(wregex_t *wreg)
  *#	Deallocates a {{wregex_t}} object compiled by {{wrx_comp()}}.
  */
@@ -0,0 +1,1192 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	C++ interface that compiles a pattern at compile time.
+ *
+ *	A pattern given as a string literal is parsed by a constexpr port of
+ *	the parser in wrx_comp.c, which builds the same NFA states that
+ *	wrx_comp() would. Each state then becomes an instantiation of a
+ *	function template, so the optimizer sees the whole matcher and can
+ *	inline it; nothing is compiled at run time:
+ *
+ *		static int valid(const char *s) {
+ *			return wrx::regex<"^\\d{4}-\\d{2}-\\d{2}$">::match(s);
+ *		}
+ *
+ *	An invalid pattern is a compile error, and the notes in the error
+ *	message name the problem, eg. "')' expected".
+ *
+ *	The matcher returns the same results as wrx_exec(), except that the
+ *	match starts are tried from left to right like wrx_thom() does.
+ *	Without back references, strings shorter than MEMO_BITS / (number of
+ *	states) are backtracked with a bitmap of the (state, position) pairs
+ *	tried so far, which bounds the work and the depth of the recursion.
+ *	Longer strings are matched by following all the states at once, like
+ *	wrx_thom(), with each thread keeping the submatches it has seen and
+ *	the threads kept in the order wrx_exec() would try them in; the work
+ *	is linear in the length of the string and the memory depends only on
+ *	the number of states. Patterns with back references are backtracked
+ *	with the alternatives still to be tried on a stack on the heap rather
+ *	than in the recursion.
+ *
+ *	exec() and match() are constexpr, so a pattern can also be matched
+ *	at compile time.
+ *
+ *	Requires C++20.
+ */
+
+#ifndef _WREGEX_HPP
+#define _WREGEX_HPP
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "wregex.h"
+
+namespace wrx {
+
+/*
+ *	A string literal used as a template parameter
+ */
+template<std::size_t N>
+struct pattern {
+	char s[N];
+	constexpr pattern(const char (&p)[N]) {
+		for(std::size_t i = 0; i < N; i++)
+			s[i] = p[i];
+	}
+};
+
+namespace detail {
+
+/* The opcodes, as in wrxcfg.h */
+enum { MTC, MCI, CHC, MOV, EOM, SET, REC, STP, BRF, BRI, BOL, EOL, BOW, EOW, BND, MEV };
+
+/* Return values of the matcher, as in wrxcfg.h */
+enum { NOMATCH = 0, MATCH = 1, SMALL_NSM = -15, INV_BREF = -16 };
+
+/* The size of the bitmap of (state, position) pairs */
+constexpr std::size_t MEMO_BITS = 4096;
+
+/* The <ctype.h> functions for the "C" locale, which aren't constexpr */
+constexpr bool is_digit(int c) { return c >= '0' && c <= '9'; }
+constexpr bool is_upper(int c) { return c >= 'A' && c <= 'Z'; }
+constexpr bool is_lower(int c) { return c >= 'a' && c <= 'z'; }
+constexpr bool is_alnum(int c) { return is_digit(c) || is_upper(c) || is_lower(c); }
+constexpr bool is_space(int c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+constexpr bool is_graph(int c) { return c > ' ' && c < 127; }
+constexpr int to_lower(int c) { return is_upper(c) ? c - 'A' + 'a' : c; }
+constexpr int to_upper(int c) { return is_lower(c) ? c - 'a' + 'A' : c; }
+
+constexpr bool in(const char *s, int c) {
+	for(; *s; s++)
+		if(*s == c) return true;
+	return false;
+}
+
+/*
+ *	Reports an error in the pattern. Since throwing isn't allowed while
+ *	the pattern is compiled, the compiler reports it along with msg
+ */
+constexpr void error(const char *msg) {
+	if(msg) throw msg;
+}
+
+/*
+ *	A state of the NFA, like wrx_state
+ */
+struct state {
+	char op = MOV;
+	short s[2] = {-1, -1};
+	char c = 0;		/* MTC and MCI */
+	short idx = 0;	/* REC, STP, BRF and BRI */
+	unsigned char bv[16] = {};	/* SET */
+};
+
+struct segment {
+	short beg, end;
+};
+
+/*
+ *	The parser of wrx_comp.c, with vectors instead of realloc() and
+ *	error() instead of longjmp()
+ */
+struct compiler {
+	const char *p;
+	std::vector<state> states;
+	std::vector<segment> seg;
+	int n_subm = 1;
+	bool ci = false;
+	short start = 0, stop = 0;
+
+	constexpr compiler(const char *pat) : p(pat) {
+		segment m;
+		pattern();
+		if(p[0] != '\0') error("invalid expression");
+		m = pop_seg();
+		stop = next_state();
+		states[stop].op = EOM;
+		transition(m.end, stop);
+		start = m.beg;
+	}
+
+	constexpr short next_state() {
+		if(states.size() >= 0x7FFF) error("too many states");
+		states.push_back(state());
+		return (short)(states.size() - 1);
+	}
+
+	constexpr short ns() const { return (short)states.size(); }
+
+	constexpr void push_seg(short beg, short end) {
+		seg.push_back(segment{beg, end});
+	}
+
+	constexpr segment pop_seg() {
+		segment m;
+		if(seg.empty()) error("invalid expression");
+		m = seg.back();
+		seg.pop_back();
+		return m;
+	}
+
+	constexpr void transition(short s1, short s2) {
+		if(states[s1].s[0] < 0)
+			states[s1].s[0] = s2;
+		else
+			states[s1].s[1] = s2;
+	}
+
+	constexpr void weaken(short s) {
+		short t = states[s].s[0];
+		states[s].s[0] = states[s].s[1];
+		states[s].s[1] = t;
+	}
+
+	/* Appends copies of the states from beg to end, moved up by ofs */
+	constexpr void duplicate(short beg, short end, short ofs) {
+		short j, k;
+		for(j = beg; j < end; j++) {
+			k = next_state();
+			states[k] = states[j];
+			if(states[k].s[0] >= 0) states[k].s[0] += ofs;
+			if(states[k].s[1] >= 0) states[k].s[1] += ofs;
+		}
+	}
+
+	constexpr void set_range(unsigned char *bv, int u, int v) {
+		for(int i = u; i <= v; i++)
+			bv[i >> 3] |= 1 << (i & 7);
+	}
+
+	constexpr void invert(unsigned char *bv) {
+		for(int i = 4; i < 16; i++)
+			bv[i] = ~bv[i];
+		bv['\r' >> 3] ^= 1 << ('\r' & 7);
+		bv['\n' >> 3] ^= 1 << ('\n' & 7);
+		bv['\t' >> 3] ^= 1 << ('\t' & 7);
+	}
+
+	/* A state that consumes one character, followed by a MOV */
+	constexpr short atom(char op) {
+		short b = next_state(), e = next_state();
+		states[b].op = op;
+		transition(b, e);
+		push_seg(b, e);
+		return b;
+	}
+
+	/* pattern	::= ['^'] [list] ['$'] */
+	constexpr void pattern() {
+		short b, e;
+		bool bol = false, hl = false;
+		segment m1, m2;
+
+		if(p[0] == '\0') {
+			b = next_state();
+			states[b].op = MEV;
+			push_seg(b, b);
+			return;
+		}
+
+		if(p[0] == '^') {
+			bol = true;
+			b = next_state();
+			states[b].op = BOL;
+			push_seg(b, b);
+			p++;
+			if(!p[0]) return;
+		}
+
+		if(p[0] != '$') {
+			hl = true;
+			list();
+		}
+
+		if(bol && hl) {
+			m2 = pop_seg();
+			m1 = pop_seg();
+			transition(m1.end, m2.beg);
+			push_seg(m1.beg, m2.end);
+		}
+
+		if(p[0] == '$') {
+			if(!bol && !hl) {
+				b = next_state();
+				states[b].op = MEV;
+				push_seg(b, b);
+			}
+			p++;
+			if(p[0] != '\0') error("'$' not at end of pattern");
+
+			b = next_state();
+			e = next_state();
+			states[b].op = EOL;
+			transition(b, e);
+			m1 = pop_seg();
+			transition(m1.end, b);
+			push_seg(m1.beg, e);
+		}
+
+		m1 = pop_seg();
+		b = next_state();
+		e = next_state();
+		states[b].op = REC;
+		states[e].op = STP;
+		transition(b, m1.beg);
+		transition(m1.end, e);
+		push_seg(b, e);
+	}
+
+	/* list	::= element ["|" list] */
+	constexpr void list() {
+		short n1, n2;
+		segment m1, m2;
+
+		element();
+		if(p[0] == '|') {
+			p++;
+			m1 = pop_seg();
+			list();
+			m2 = pop_seg();
+			n1 = next_state();
+			n2 = next_state();
+			states[n1].op = CHC;
+			transition(n1, m1.beg);
+			transition(n1, m2.beg);
+			transition(m1.end, n2);
+			transition(m2.end, n2);
+			push_seg(n1, n2);
+		}
+	}
+
+	/* element	::= ("(" [":"] list ")" | value) [quantifier] [element] */
+	constexpr void element() {
+		short b, e, i, j, ofs, sub1, sub2, sub3;
+		int bref, boc = 0, eoc = 0, cf = 0;
+		segment m;
+
+		sub1 = ns();
+
+		if(p[0] == '$') return;
+
+		if(p[0] == '(') {
+			if(p[1] == ':') {
+				bref = -1;
+				p += 2;
+			} else {
+				bref = n_subm++;
+				p++;
+			}
+			list();
+			if(p[0] != ')') error("')' expected");
+			if(bref >= 0) {
+				m = pop_seg();
+				b = next_state();
+				states[b].op = REC;
+				states[b].idx = bref;
+				transition(b, m.beg);
+				e = next_state();
+				states[e].op = STP;
+				states[e].idx = bref;
+				transition(m.end, e);
+				push_seg(b, e);
+			}
+			p++;
+		} else
+			value();
+
+		if(p[0] == '$') return;
+
+		if(p[0] && in("*+?", p[0])) {
+			m = pop_seg();
+			b = next_state();
+			e = next_state();
+			states[b].op = CHC;
+			transition(b, m.beg);
+			transition(b, e);
+			switch(p[0]) {
+				case '*': transition(m.end, b); push_seg(b, e); break;
+				case '+': transition(m.end, b); push_seg(m.beg, e); break;
+				case '?': transition(m.end, e); push_seg(b, e); break;
+			}
+			p++;
+			if(p[0] == '?') {
+				p++;
+				weaken(b);
+			}
+		} else if(p[0] == '{') {
+			p++;
+			if(is_digit(p[0])) cf = 1;
+			while(is_digit(p[0]))
+				boc = boc * 10 + (*p++ - '0');
+			if(p[0] == ',') {
+				cf |= 2;
+				p++;
+				if(is_digit(p[0])) cf |= 4;
+				while(is_digit(p[0]))
+					eoc = eoc * 10 + (*p++ - '0');
+			}
+			if(p[0] != '}') error("'}' expected");
+			p++;
+
+			if(cf == 7 && boc == eoc) cf = 1;
+
+			switch(cf) {
+			case 0:
+			case 2: /* {} or {,}: '*' */
+				m = pop_seg();
+				b = next_state();
+				e = next_state();
+				states[b].op = CHC;
+				transition(b, m.beg);
+				transition(b, e);
+				transition(m.end, b);
+				push_seg(b, e);
+				if(p[0] == '?') {
+					p++;
+					weaken(b);
+				}
+				break;
+			case 1: /* {boc} */
+			case 3: /* {boc,}: boc times and then a '+' */
+				sub2 = ns();
+				m = pop_seg();
+				ofs = sub2 - sub1;
+				b = m.beg + ofs;
+				e = m.end;
+				for(i = 1; i < boc; i++) {
+					duplicate(sub1, sub2, ofs);
+					states[e].s[0] = b;
+					b += ofs;
+					e += ofs;
+					sub1 += ofs;
+					sub2 += ofs;
+				}
+				if(cf == 1) {
+					if(p[0] == '?') p++;
+					push_seg(m.beg, e);
+					break;
+				}
+				b -= ofs;
+				i = next_state();
+				j = next_state();
+				states[i].op = CHC;
+				transition(i, b);
+				transition(i, j);
+				transition(e, i);
+				if(p[0] == '?') {
+					p++;
+					weaken(i);
+				}
+				push_seg(m.beg, j);
+				break;
+			case 6: /* {,eoc}: A?A?A?... */
+				m = pop_seg();
+				b = next_state();
+				e = next_state();
+				states[b].op = CHC;
+				transition(b, m.beg);
+				transition(b, e);
+				transition(m.end, e);
+				if(p[0] == '?') {
+					p++;
+					weaken(b);
+				}
+				sub2 = ns();
+				m.beg = b;
+				m.end = e;
+				ofs = sub2 - sub1;
+				b += ofs;
+				for(i = 1; i < eoc; i++) {
+					duplicate(sub1, sub2, ofs);
+					states[e].s[0] = b;
+					b += ofs;
+					e += ofs;
+					sub1 += ofs;
+					sub2 += ofs;
+				}
+				push_seg(m.beg, e);
+				break;
+			case 7: /* {boc,eoc}: AAA?A?A? */
+				if(boc > eoc) error("m > n in {m,n}");
+				sub2 = ns();
+				m = pop_seg();
+				ofs = sub2 - sub1;
+				b = m.beg + ofs;
+				e = m.end;
+				for(i = 1; i < boc; i++) {
+					duplicate(sub1, sub2, ofs);
+					states[e].s[0] = b;
+					b += ofs;
+					e += ofs;
+					sub1 += ofs;
+					sub2 += ofs;
+				}
+				sub3 = ns();
+				duplicate(sub1, sub2, ofs);
+				i = next_state();
+				j = next_state();
+				states[i].op = CHC;
+				states[e].s[0] = i;
+				transition(i, b);
+				transition(i, j);
+				e += ofs;
+				transition(e, j);
+				if(p[0] == '?')
+					weaken(i);
+				sub1 = sub3;
+				sub2 = ns();
+				ofs = sub2 - sub1;
+				b = i;
+				e = j;
+				for(i = boc; i < eoc - 1; i++) {
+					duplicate(sub1, sub2, ofs);
+					b += ofs;
+					states[e].s[0] = b;
+					e += ofs;
+					sub1 += ofs;
+					sub2 += ofs;
+				}
+				push_seg(m.beg, e);
+				if(p[0] == '?') p++;
+				break;
+			}
+		}
+
+		if(p[0] && p[0] != '|' && p[0] != ')' && p[0] != '$') {
+			m = pop_seg();
+			b = m.beg;
+			e = m.end;
+			element();
+			m = pop_seg();
+			transition(e, m.beg);
+			push_seg(b, m.end);
+		}
+	}
+
+	/* value	::= character | '<' | '>' | "[" ["^"] sets "]" | "." | '\i' list | '\I' list | escape */
+	constexpr void value() {
+		short b;
+		int i, c;
+
+		if(is_alnum(p[0]) || p[0] == ' ') {
+			b = atom(ci ? MCI : MTC);
+			states[b].c = *p++;
+		} else if(p[0] == '[') {
+			p++;
+			b = atom(SET);
+			if(p[0] == '^') {
+				p++;
+				sets(states[b].bv);
+				invert(states[b].bv);
+			} else
+				sets(states[b].bv);
+			if(p[0] != ']') error("']' expected");
+			p++;
+		} else if(p[0] == '.') {
+			b = atom(SET);
+			for(i = 4; i < 16; i++)
+				states[b].bv[i] = 0xFF;
+			set_range(states[b].bv, '\r', '\r');
+			set_range(states[b].bv, '\n', '\n');
+			set_range(states[b].bv, '\t', '\t');
+			p++;
+		} else if(p[0] == '<') {
+			atom(BOW);
+			p++;
+		} else if(p[0] == '>') {
+			atom(EOW);
+			p++;
+		} else if(p[0] == '$') {
+			return;
+		} else if(p[0] == '\\') {
+			p++;
+			c = p[0];
+			if(!c) error("invalid escape sequence");
+			if(c == 'i' || c == 'I') {
+				ci = (c == 'i');
+				p++;
+				if(p[0] && p[0] != '$')
+					list();
+				else {
+					b = next_state();
+					push_seg(b, b);
+				}
+			} else if(in("daulswx", to_lower(c))) {
+				b = atom(SET);
+				unsigned char *bv = states[b].bv;
+				switch(to_lower(c)) {
+					case 'd': set_range(bv, '0', '9'); break;
+					case 'a': set_range(bv, 'a', 'z'); set_range(bv, 'A', 'Z'); break;
+					case 'u': set_range(bv, 'A', 'Z'); if(ci) set_range(bv, 'a', 'z'); break;
+					case 'l': set_range(bv, 'a', 'z'); if(ci) set_range(bv, 'A', 'Z'); break;
+					case 's': set_range(bv, ' ', ' '); set_range(bv, '\t', '\t');
+						set_range(bv, '\r', '\r'); set_range(bv, '\n', '\n'); break;
+					case 'w': set_range(bv, '0', '9'); set_range(bv, 'a', 'z');
+						set_range(bv, 'A', 'Z'); set_range(bv, '_', '_'); break;
+					case 'x': set_range(bv, 'a', 'f'); set_range(bv, 'A', 'F'); set_range(bv, '0', '9'); break;
+				}
+				if(is_upper(c))
+					invert(bv);
+				p++;
+			} else if(in("rntb", c)) {
+				if(c == 'b')
+					atom(BND);
+				else {
+					b = atom(MTC);
+					states[b].c = c == 'n' ? '\n' : c == 'r' ? '\r' : '\t';
+				}
+				p++;
+			} else if(in(".*+?[](){}|^$<>:", c) || c == '\\') {
+				b = atom(MTC);
+				states[b].c = *p++;
+			} else if(is_digit(c)) {
+				for(i = 0; is_digit(p[0]); p++)
+					i = i * 10 + (p[0] - '0');
+				b = atom(ci ? BRI : BRF);
+				states[b].idx = i;
+			} else
+				error("invalid escape sequence");
+		} else if(p[0] && p[0] != ')' && (is_graph(p[0]) || is_space(p[0]))) {
+			b = atom(MTC);
+			states[b].c = *p++;
+		} else if(p[0] && p[0] != ')' && p[0] != '|') {
+			/* wrx_comp() recurses until it runs out of stack on these */
+			error("invalid character in pattern");
+		} else {
+			/* Allows "(a|)" */
+			b = next_state();
+			push_seg(b, b);
+		}
+	}
+
+	/* sets 	::= (c ["-" c])+ */
+	constexpr void sets(unsigned char *bv) {
+		int u, v, i;
+		do {
+			if(p[0] == '\0') error("']' expected");
+			u = (unsigned char)p[0];
+			if(u == '\\') {
+				switch(p[1]) {
+					case 'r': set_range(bv, '\r', '\r'); break;
+					case 'n': set_range(bv, '\n', '\n'); break;
+					case 't': set_range(bv, '\t', '\t'); break;
+					case '\\': case '-': case '^': case ']': set_range(bv, p[1], p[1]); break;
+					case 'd': set_range(bv, '0', '9'); break;
+					case 'a': set_range(bv, 'a', 'z'); set_range(bv, 'A', 'Z'); break;
+					case 'u': set_range(bv, 'A', 'Z'); if(ci) set_range(bv, 'a', 'z'); break;
+					case 'l': set_range(bv, 'a', 'z'); if(ci) set_range(bv, 'A', 'Z'); break;
+					case 's': set_range(bv, ' ', ' '); set_range(bv, '\t', '\t');
+						set_range(bv, '\r', '\r'); set_range(bv, '\n', '\n'); break;
+					case 'w': set_range(bv, 'a', 'z'); set_range(bv, 'A', 'Z');
+						set_range(bv, '0', '9'); set_range(bv, '_', '_'); break;
+					case 'x': set_range(bv, 'a', 'f'); set_range(bv, 'A', 'F'); set_range(bv, '0', '9'); break;
+				}
+				p += 2;
+			} else {
+				if(p[1] == '-') {
+					p += 2;
+					if(p[0] == '\0') error("error in range []");
+					v = (unsigned char)p[0];
+					if(!is_alnum(u) || !is_alnum(v))
+						error("non-alphanumeric character in range [u-v]");
+					else if((is_upper(u) && !is_upper(v)) || (is_lower(u) && !is_lower(v)) || (is_digit(u) && !is_digit(v)))
+						error("mismatch in range [u-v]");
+				} else
+					v = u;
+				p++;
+				if((u < ' ' && u != '\r' && u != '\n' && u != '\t') || u > 127)
+					error("error in range []");
+				if((v < ' ' && v != '\r' && v != '\n' && v != '\t') || v > 127)
+					error("error in range []");
+				if(v < u) error("v < u in the range [u-v]");
+				for(i = u; i <= v; i++) {
+					if(ci) {
+						set_range(bv, to_upper(i), to_upper(i));
+						set_range(bv, to_lower(i), to_lower(i));
+					} else
+						set_range(bv, i, i);
+				}
+			}
+		} while(p[0] != ']');
+	}
+};
+
+/*
+ *	The compiled NFA, along with what the matcher needs to know about
+ *	each state
+ */
+template<std::size_t NS>
+struct nfa {
+	state states[NS];
+	short start, stop;
+	int n_subm;
+	bool bref;			/* There are back references, so the bitmap can't be used */
+	bool memo[NS];		/* The state can be entered in more than one way */
+	short guard[NS];	/* The slot in which a state on an empty loop records its position, or -1 */
+	int nguard;
+};
+
+template<pattern P>
+constexpr std::size_t count_states() {
+	return compiler(P.s).states.size();
+}
+
+/*
+ *	Compiles the pattern and works out which states need to check the
+ *	bitmap, and which can be reached again without consuming input
+ */
+template<pattern P>
+constexpr auto compile() {
+	constexpr std::size_t NS = count_states<P>();
+	compiler cc(P.s);
+	nfa<NS> r{};
+	std::vector<short> refs(NS, 0), stk;
+	std::vector<char> reach(NS, 0), eps(NS, 0);
+	std::size_t i, j;
+	short st, k;
+
+	for(i = 0; i < NS; i++)
+		r.states[i] = cc.states[i];
+	r.start = cc.start;
+	r.stop = cc.stop;
+	r.n_subm = cc.n_subm;
+	r.bref = false;
+
+	/* Count the transitions from the reachable states into each state */
+	refs[r.start] = 1;
+	reach[r.start] = 1;
+	stk.push_back(r.start);
+	while(!stk.empty()) {
+		const state &s = r.states[stk.back()];
+		stk.pop_back();
+		if(s.op == BRF || s.op == BRI)
+			r.bref = true;
+		for(j = 0; j < 2; j++) {
+			if(s.op == EOM || s.op == MEV || (j && s.op != CHC) || (k = s.s[j]) < 0)
+				continue;
+			refs[k]++;
+			if(!reach[k]) {
+				reach[k] = 1;
+				stk.push_back(k);
+			}
+		}
+	}
+
+	/* A CHC state that can reach itself without consuming input would
+	loop forever on an empty match, unless it stops itself */
+	r.nguard = 0;
+	for(i = 0; i < NS; i++) {
+		r.memo[i] = !r.bref && reach[i] && refs[i] > 1;
+		r.guard[i] = -1;
+		if(!reach[i] || r.states[i].op != CHC)
+			continue;
+		for(j = 0; j < NS; j++)
+			eps[j] = 0;
+		stk.push_back(r.states[i].s[0]);
+		stk.push_back(r.states[i].s[1]);
+		while(!stk.empty()) {
+			st = stk.back();
+			stk.pop_back();
+			if(st < 0 || eps[st]) continue;
+			eps[st] = 1;
+			switch(r.states[st].op) {
+				case MTC: case MCI: case SET: case EOM: case MEV: continue;
+			}
+			stk.push_back(r.states[st].s[0]);
+			if(r.states[st].op == CHC)
+				stk.push_back(r.states[st].s[1]);
+		}
+		if(eps[i])
+			r.guard[i] = r.nguard++;
+	}
+	return r;
+}
+
+} /* namespace detail */
+
+/*
+ *	A pattern compiled at compile time.
+ *	The pattern's syntax is the same as wrx_comp()'s.
+ */
+template<pattern P>
+class regex {
+	static constexpr auto nfa = detail::compile<P>();
+	static constexpr int NCAP = 2 * nfa.n_subm;
+	static constexpr std::size_t NS = sizeof nfa.states / sizeof nfa.states[0];
+
+	/*
+	 *	The threads at one position in the string, in the order in which
+	 *	wrx_exec() would try them, along with the submatch positions each
+	 *	has recorded so far
+	 */
+	struct threads {
+		std::size_t n = 0;
+		std::size_t gen = 0;
+		std::vector<short> st;
+		std::vector<std::size_t> mark;		/* mark[S] == gen if state S was added */
+		std::vector<const char *> cap;		/* NCAP for each thread */
+
+		constexpr threads() : st(NS), mark(NS, 0), cap(NS * NCAP, nullptr) {}
+	};
+
+	/*
+	 *	What the backtracker has to do when it backtracks past an entry
+	 *	on its stack
+	 */
+	enum { TRY, CAP, GUARD };
+	struct undo {
+		int what;
+		short s;		/* The state to TRY, or the slot of the CAP or GUARD */
+		const char *cp;	/* The position to try s at, or the old position */
+	};
+
+	struct context {
+		const char *str;
+		const char **cap;
+		const char *guard[nfa.nguard > 0 ? nfa.nguard : 1];
+		unsigned char memo[detail::MEMO_BITS / 8];
+	};
+
+	/* Is c a "word" character for the purposes of '<', '>' and "\b"? */
+	static constexpr bool is_word(char c) {
+		return detail::is_alnum((unsigned char)c);
+	}
+
+	/*
+	 *	Matches the rest of the string from state S at position cp.
+	 *	Returns MATCH or NOMATCH.
+	 */
+	template<int S>
+	static constexpr int run(context &c, const char *cp) {
+		if constexpr(nfa.memo[S]) {
+			std::size_t k = (std::size_t)(cp - c.str) * NS + S;
+			if(c.memo[k >> 3] & (1 << (k & 7)))
+				return detail::NOMATCH;
+			c.memo[k >> 3] |= 1 << (k & 7);
+		}
+
+		if constexpr(nfa.guard[S] >= 0) {
+			const char *old = c.guard[nfa.guard[S]];
+			int r;
+			if(old == cp)
+				return detail::NOMATCH;
+			c.guard[nfa.guard[S]] = cp;
+			r = run_op<S>(c, cp);
+			c.guard[nfa.guard[S]] = old;
+			return r;
+		} else
+			return run_op<S>(c, cp);
+	}
+
+	/*
+	 *	The code for state S's opcode
+	 */
+	template<int S>
+	static constexpr int run_op(context &c, const char *cp) {
+		constexpr detail::state st = nfa.states[S];
+		using namespace detail;
+
+		if constexpr(st.op == MTC) {
+			if(cp[0] != st.c) return NOMATCH;
+			return run<st.s[0]>(c, cp + 1);
+		} else if constexpr(st.op == MCI) {
+			if(to_lower((unsigned char)cp[0]) != to_lower((unsigned char)st.c)) return NOMATCH;
+			return run<st.s[0]>(c, cp + 1);
+		} else if constexpr(st.op == SET) {
+			unsigned char ch = cp[0];
+			if(!ch || ch >= 0x80 || !(st.bv[ch >> 3] & (1 << (ch & 7)))) return NOMATCH;
+			return run<st.s[0]>(c, cp + 1);
+		} else if constexpr(st.op == CHC) {
+			if(run<st.s[0]>(c, cp) == MATCH) return MATCH;
+			return run<st.s[1]>(c, cp);
+		} else if constexpr(st.op == MOV) {
+			return run<st.s[0]>(c, cp);
+		} else if constexpr(st.op == REC || st.op == STP) {
+			constexpr int slot = 2 * st.idx + (st.op == STP);
+			const char *old = c.cap[slot];
+			c.cap[slot] = cp;
+			if(run<st.s[0]>(c, cp) == MATCH) return MATCH;
+			c.cap[slot] = old;
+			return NOMATCH;
+		} else if constexpr(st.op == BOL) {
+			if(cp > c.str && cp[-1] != '\r' && cp[-1] != '\n') return NOMATCH;
+			return run<st.s[0]>(c, cp);
+		} else if constexpr(st.op == EOL) {
+			if(cp[0] && cp[0] != '\r' && cp[0] != '\n') return NOMATCH;
+			return run<st.s[0]>(c, cp);
+		} else if constexpr(st.op == BOW) {
+			if(!is_word(cp[0]) || (cp > c.str && is_word(cp[-1]))) return NOMATCH;
+			return run<st.s[0]>(c, cp);
+		} else if constexpr(st.op == EOW) {
+			if(cp == c.str || !is_word(cp[-1]) || is_word(cp[0])) return NOMATCH;
+			return run<st.s[0]>(c, cp);
+		} else if constexpr(st.op == BND) {
+			if(cp == c.str ? !is_word(cp[0]) : !is_word(cp[0]) == !is_word(cp[-1])) return NOMATCH;
+			return run<st.s[0]>(c, cp);
+		} else {
+			/* EOM and MEV; there are no back references here */
+			return MATCH;
+		}
+	}
+
+	/*
+	 *	Matches a string of len characters by backtracking like wrx_exec(),
+	 *	for patterns without back references. The string has to be short
+	 *	enough for the bitmap.
+	 */
+	static constexpr int memoized(const char *str, std::size_t len, const char **cap) {
+		context c;
+		const char *beg;
+		std::size_t i;
+		int r;
+
+		c.str = str;
+		c.cap = cap;
+		for(auto &g : c.guard)
+			g = nullptr;
+		for(i = 0; i < ((len + 1) * NS + 7) / 8; i++)
+			c.memo[i] = 0;
+
+		/* A match may start at any character, or at the '\0' of an empty string */
+		for(beg = str; ; beg++) {
+			r = run<nfa.start>(c, beg);
+			if(r != detail::NOMATCH || !beg[0] || !beg[1])
+				break;
+		}
+		return r;
+	}
+
+	/*
+	 *	Adds state S at position cp to t, following the transitions that
+	 *	don't consume input. cap holds the submatch positions so far.
+	 */
+	template<int S>
+	static constexpr void add(const char *str, threads &t, const char *cp, const char **cap) {
+		if constexpr(S >= 0) {
+			constexpr detail::state st = nfa.states[S];
+			using namespace detail;
+
+			if(t.mark[S] == t.gen) return;
+			t.mark[S] = t.gen;
+
+			if constexpr(st.op == CHC) {
+				add<st.s[0]>(str, t, cp, cap);
+				add<st.s[1]>(str, t, cp, cap);
+			} else if constexpr(st.op == MOV) {
+				add<st.s[0]>(str, t, cp, cap);
+			} else if constexpr(st.op == REC || st.op == STP) {
+				constexpr int slot = 2 * st.idx + (st.op == STP);
+				const char *old = cap[slot];
+				cap[slot] = cp;
+				add<st.s[0]>(str, t, cp, cap);
+				cap[slot] = old;
+			} else if constexpr(st.op == BOL) {
+				if(cp == str || cp[-1] == '\r' || cp[-1] == '\n')
+					add<st.s[0]>(str, t, cp, cap);
+			} else if constexpr(st.op == EOL) {
+				if(!cp[0] || cp[0] == '\r' || cp[0] == '\n')
+					add<st.s[0]>(str, t, cp, cap);
+			} else if constexpr(st.op == BOW) {
+				if(is_word(cp[0]) && (cp == str || !is_word(cp[-1])))
+					add<st.s[0]>(str, t, cp, cap);
+			} else if constexpr(st.op == EOW) {
+				if(cp > str && is_word(cp[-1]) && !is_word(cp[0]))
+					add<st.s[0]>(str, t, cp, cap);
+			} else if constexpr(st.op == BND) {
+				if(cp == str ? is_word(cp[0]) : !is_word(cp[0]) != !is_word(cp[-1]))
+					add<st.s[0]>(str, t, cp, cap);
+			} else {
+				/* MTC, MCI, SET, EOM and MEV wait for the next character */
+				t.st[t.n] = S;
+				for(int i = 0; i < NCAP; i++)
+					t.cap[t.n * NCAP + i] = cap[i];
+				t.n++;
+			}
+		}
+	}
+
+	/*
+	 *	Moves a thread in state S past the character at cp, into t
+	 */
+	template<int S>
+	static constexpr void step(const char *str, threads &t, const char *cp, const char **cap) {
+		constexpr detail::state st = nfa.states[S];
+		using namespace detail;
+
+		if constexpr(st.op == MTC) {
+			if(cp[0] == st.c)
+				add<st.s[0]>(str, t, cp + 1, cap);
+		} else if constexpr(st.op == MCI) {
+			if(to_lower((unsigned char)cp[0]) == to_lower((unsigned char)st.c))
+				add<st.s[0]>(str, t, cp + 1, cap);
+		} else if constexpr(st.op == SET) {
+			unsigned char ch = cp[0];
+			if(ch && ch < 0x80 && (st.bv[ch >> 3] & (1 << (ch & 7))))
+				add<st.s[0]>(str, t, cp + 1, cap);
+		}
+	}
+
+	using step_fn = void (*)(const char *, threads &, const char *, const char **);
+
+	template<std::size_t... I>
+	static constexpr std::array<step_fn, NS> steps(std::index_sequence<I...>) {
+		return {{ &step<(int)I>... }};
+	}
+
+	/*
+	 *	Matches str by following all the states at once, like wrx_thom()
+	 */
+	static constexpr int pike(const char *str, const char **cap) {
+		constexpr std::array<step_fn, NS> next = steps(std::make_index_sequence<NS>());
+		threads t[2];
+		const char *none[NCAP] = {};
+		const char *cp;
+		std::size_t i, gen = 0;
+		int cur = 0, k;
+		bool found = false;
+
+		t[cur].gen = ++gen;
+		for(cp = str; ; cp++) {
+			threads &cl = t[cur], &nl = t[cur ^ 1];
+
+			/* A match may start at any character, or at the '\0' of an empty string,
+			and those that start later are tried after the ones already under way */
+			if(!found && (cp == str || cp[0]))
+				add<nfa.start>(str, cl, cp, none);
+			if(found && !cl.n)
+				break;
+
+			nl.n = 0;
+			nl.gen = ++gen;
+			for(i = 0; i < cl.n; i++) {
+				const char **tc = &cl.cap[i * NCAP];
+				char op = nfa.states[cl.st[i]].op;
+				if(op == detail::EOM || op == detail::MEV) {
+					/* The threads after this one would only be tried if it failed */
+					for(k = 0; k < NCAP; k++)
+						cap[k] = tc[k];
+					found = true;
+					break;
+				}
+				next[cl.st[i]](str, nl, cp, tc);
+			}
+
+			if(!cp[0])
+				break;
+			cur ^= 1;
+		}
+		return found ? detail::MATCH : detail::NOMATCH;
+	}
+
+	/*
+	 *	Matches str by backtracking like wrx_exec(), for patterns with back
+	 *	references. The alternatives still to be tried, and the positions to
+	 *	restore on the way back to them, are kept on a stack.
+	 */
+	static constexpr int backtrack(const char *str, const char **cap) {
+		std::vector<undo> stk;
+		const char *guard[nfa.nguard > 0 ? nfa.nguard : 1] = {};
+		const char *beg, *cp, *b, *e;
+		short s;
+		int g, slot;
+		bool ok;
+		using namespace detail;
+
+		/* A match may start at any character, or at the '\0' of an empty string */
+		for(beg = str; ; beg++) {
+			s = nfa.start;
+			cp = beg;
+			for(;;) {
+				const state &st = nfa.states[s];
+
+				ok = true;
+				if((g = nfa.guard[s]) >= 0) {
+					if(guard[g] == cp)
+						ok = false;
+					else {
+						stk.push_back(undo{GUARD, (short)g, guard[g]});
+						guard[g] = cp;
+					}
+				}
+
+				if(ok) {
+					switch(st.op) {
+					case MTC:
+						ok = cp[0] == st.c;
+						cp++;
+						break;
+					case MCI:
+						ok = to_lower((unsigned char)cp[0]) == to_lower((unsigned char)st.c);
+						cp++;
+						break;
+					case SET: {
+						unsigned char ch = cp[0];
+						ok = ch && ch < 0x80 && (st.bv[ch >> 3] & (1 << (ch & 7)));
+						cp++;
+					} break;
+					case CHC:
+						stk.push_back(undo{TRY, st.s[1], cp});
+						break;
+					case REC:
+					case STP:
+						slot = 2 * st.idx + (st.op == STP);
+						stk.push_back(undo{CAP, (short)slot, cap[slot]});
+						cap[slot] = cp;
+						break;
+					case BRF:
+					case BRI:
+						if(st.idx >= nfa.n_subm)
+							return INV_BREF;
+						b = cap[2 * st.idx];
+						e = cap[2 * st.idx + 1];
+						if(!b || !e)
+							return INV_BREF;
+						for(; ok && b < e; b++, cp++)
+							if(st.op == BRF)
+								ok = b[0] == cp[0];
+							else
+								ok = to_lower((unsigned char)b[0]) == to_lower((unsigned char)cp[0]);
+						break;
+					case BOL:
+						ok = cp == str || cp[-1] == '\r' || cp[-1] == '\n';
+						break;
+					case EOL:
+						ok = !cp[0] || cp[0] == '\r' || cp[0] == '\n';
+						break;
+					case BOW:
+						ok = is_word(cp[0]) && (cp == str || !is_word(cp[-1]));
+						break;
+					case EOW:
+						ok = cp > str && is_word(cp[-1]) && !is_word(cp[0]);
+						break;
+					case BND:
+						ok = cp == str ? is_word(cp[0]) : !is_word(cp[0]) != !is_word(cp[-1]);
+						break;
+					case EOM:
+					case MEV:
+						return MATCH;
+					}
+				}
+
+				if(ok) {
+					s = st.s[0];
+					continue;
+				}
+
+				/* Back up to the last alternative, restoring what was changed since */
+				while(!stk.empty() && stk.back().what != TRY) {
+					if(stk.back().what == CAP)
+						cap[stk.back().s] = stk.back().cp;
+					else
+						guard[stk.back().s] = stk.back().cp;
+					stk.pop_back();
+				}
+				if(stk.empty())
+					break;
+				s = stk.back().s;
+				cp = stk.back().cp;
+				stk.pop_back();
+			}
+
+			if(!beg[0] || !beg[1])
+				break;
+		}
+		return NOMATCH;
+	}
+
+public:
+	/* The number of submatches, including the whole match, like wregex_t::n_subm */
+	static constexpr int n_subm = nfa.n_subm;
+
+	/*
+	 *	Matches str against the pattern. Takes the same parameters, except
+	 *	for the wregex_t, and returns the same values as wrx_exec().
+	 */
+	static constexpr int exec(const char *str, wregmatch_t subm[] = nullptr, int nsm = 0) {
+		const char *cap[NCAP] = {};
+		int i, r;
+
+		if(!subm) nsm = 0;
+		if(nsm < 0) return detail::SMALL_NSM;
+
+		for(i = 0; i < nsm; i++)
+			subm[i].beg = subm[i].end = nullptr;
+
+		if constexpr(nfa.bref)
+			r = backtrack(str, cap);
+		else {
+			std::size_t len = 0;
+			while(str[len])
+				len++;
+			if((len + 1) * NS <= detail::MEMO_BITS)
+				r = memoized(str, len, cap);
+			else
+				r = pike(str, cap);
+		}
+
+		if(r == detail::MATCH)
+			for(i = 0; i < nsm && 2 * i < NCAP; i++) {
+				subm[i].beg = cap[2 * i];
+				subm[i].end = cap[2 * i + 1];
+			}
+		return r;
+	}
+
+	/*
+	 *	Returns true if the pattern matches str
+	 */
+	static constexpr bool match(const char *str) {
+		return exec(str) == detail::MATCH;
+	}
+};
+
+} /* namespace wrx */
+
+#endif /*_WREGEX_HPP*/
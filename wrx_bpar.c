@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	A bit-parallel matcher for small patterns.
+ *
+ *	The states that consume input (MTC, MCI and SET) are the "positions" of
+ *	Glushkov's automaton. If there are no more than 64 of them, the set of
+ *	positions that are active at a point in the string fits in a single
+ *	64-bit integer, and the whole set is advanced past the next character
+ *	at once: The positions that can follow the active ones are looked up in
+ *	tables indexed by the active set eight bits at a time, the positions at
+ *	which a new match may start are added, and the result is ANDed with the
+ *	positions that accept the character (the Shift-And algorithm, generalized
+ *	to the '|', '*' and '?' operators by the lookup tables).
+ *
+ *	The set doesn't record which path through the NFA has priority, so the
+ *	matcher can't tell which match wrx_exec() would have picked. It stops
+ *	at the first position where any match ends instead, which is all that
+ *	is needed to decide whether the string matches.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
+
+/* The maximum number of positions */
+#define MAX_POS		64
+
+/*
+ *	The tables for one combination of the contexts of the characters before
+ *	and after a point in the string. The '^', '$', '<', '>' and "\b"
+ *	assertions depend on these, so patterns without assertions need only one.
+ */
+typedef struct {
+	uint64_t first;		/* The positions reachable from the start state */
+	uint64_t fin;		/* The positions from which the end of the match is reachable */
+	int empty;			/* The end of the match is reachable from the start state */
+	uint64_t (*follow)[256];	/* The positions reachable from the active ones, 8 at a time */
+} bp_tables;
+
+struct _wrx_bitpar {
+	const wregex_t *nfa;
+	int nfa_only;	/* Too many positions, or back references */
+
+	int nctx;		/* 1, or 16 if the pattern contains assertions */
+	unsigned char ctx[256];	/* The context (CTX_*) of each byte */
+	uint64_t accept[256];	/* The positions that consume each byte */
+	bp_tables tab[16];		/* Indexed by prev * 4 + next */
+};
+
+/*
+ *	Tests the zero-width assertions, given the contexts of the characters
+ *	before and after the point.
+ */
+static int check(char op, int prev, int next) {
+	switch(op) {
+	case BOL: return prev == CTX_EDGE || prev == CTX_NL;
+	case EOL: return next == CTX_EDGE || next == CTX_NL;
+	case BOW: return next == CTX_WORD && prev != CTX_WORD;
+	case EOW: return prev == CTX_WORD && next != CTX_WORD;
+	case BND: return (prev == CTX_WORD) != (next == CTX_WORD);
+	}
+	assert(0);
+	return 0;
+}
+
+/*
+ *	Follows the transitions that don't consume input from state st, and
+ *	returns the positions reached. *fin is set if the end of the match is
+ *	reached. mark[] and stk[] are work space.
+ */
+static uint64_t closure(const wregex_t *nfa, const short *pos, short st, int prev, int next, int *fin, char *mark, short *stk) {
+	const wrx_state *sp;
+	uint64_t set = 0;
+	int ts = 0;
+
+	memset(mark, 0, nfa->ns);
+	*fin = 0;
+
+	stk[ts++] = st;
+	while(ts > 0) {
+		st = stk[--ts];
+		if(mark[st])
+			continue;
+		mark[st] = 1;
+
+		sp = &nfa->states[st];
+		switch(sp->op) {
+		case CHC:
+			stk[ts++] = sp->s[1];
+			stk[ts++] = sp->s[0];
+			break;
+		case MOV:
+		case REC:
+		case STP:
+			stk[ts++] = sp->s[0];
+			break;
+		case BOL:
+		case EOL:
+		case BOW:
+		case EOW:
+		case BND:
+			if(check(sp->op, prev, next))
+				stk[ts++] = sp->s[0];
+			break;
+		case EOM:
+		case MEV:
+			*fin = 1;
+			break;
+		default:
+			set |= (uint64_t)1 << pos[st];
+		}
+	}
+	return set;
+}
+
+wrx_bitpar *wrx_bitpar_new(const wregex_t *nfa) {
+	wrx_bitpar *bp;
+	const wrx_state *sp;
+	uint64_t reach[MAX_POS];
+	short *pos = NULL, *stk = NULL, src[MAX_POS];
+	char *mark = NULL;
+	int i, j, c, n = 0, nchunk, asserts = 0, prev, next, fin;
+	bp_tables *t;
+
+	if(!nfa) return NULL;
+
+	bp = calloc(1, sizeof *bp);
+	if(!bp) return NULL;
+	bp->nfa = nfa;
+
+	for(i = 0; i < nfa->ns; i++)
+		switch(nfa->states[i].op) {
+		case MTC: case MCI: case SET: n++; break;
+		case BOL: case EOL: case BOW: case EOW: case BND: asserts = 1; break;
+		}
+
+	if(n > MAX_POS || wrx_has_bref(nfa)) {
+		bp->nfa_only = 1;
+		return bp;
+	}
+
+	pos = malloc(nfa->ns * sizeof *pos);
+	stk = malloc((2 * nfa->ns + 2) * sizeof *stk);
+	mark = malloc(nfa->ns);
+	if(!pos || !stk || !mark)
+		goto error;
+
+	/* Number the positions, and work out which bytes each one accepts */
+	for(n = 0, i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		if(sp->op != MTC && sp->op != MCI && sp->op != SET)
+			continue;
+		pos[i] = n;
+		src[n] = sp->s[0];
+		for(c = 1; c < 256; c++) {
+			if(sp->op == MTC)
+				j = c == (unsigned char)sp->data.c;
+			else if(sp->op == MCI)
+				j = tolower(c) == tolower((unsigned char)sp->data.c);
+			else
+				j = c < 0x80 && BV_TST(sp->data.bv, c);
+			if(j)
+				bp->accept[c] |= (uint64_t)1 << n;
+		}
+		n++;
+	}
+
+	for(c = 0; c < 256; c++) {
+		if(!c)
+			bp->ctx[c] = CTX_EDGE;
+		else if(c == '\r' || c == '\n')
+			bp->ctx[c] = CTX_NL;
+		else if(IS_WORD(c))
+			bp->ctx[c] = CTX_WORD;
+		else
+			bp->ctx[c] = CTX_OTHER;
+	}
+
+	bp->nctx = asserts ? 16 : 1;
+	nchunk = (n + 7) / 8;
+
+	for(i = 0; i < bp->nctx; i++) {
+		t = &bp->tab[i];
+		prev = i >> 2;
+		next = i & 3;
+
+		t->follow = calloc(nchunk ? nchunk : 1, sizeof *t->follow);
+		if(!t->follow)
+			goto error;
+
+		t->first = closure(nfa, pos, nfa->start, prev, next, &t->empty, mark, stk);
+		for(j = 0; j < n; j++) {
+			reach[j] = closure(nfa, pos, src[j], prev, next, &fin, mark, stk);
+			if(fin)
+				t->fin |= (uint64_t)1 << j;
+		}
+
+		/* follow[k][b] is the union of reach[] for the bits set in b */
+		for(j = 0; j < nchunk; j++)
+			for(c = 1; c < 256; c++) {
+				for(fin = 0; !(c & (1 << fin)); fin++);
+				if(8 * j + fin < n)
+					t->follow[j][c] = t->follow[j][c & (c - 1)] | reach[8 * j + fin];
+				else
+					t->follow[j][c] = t->follow[j][c & (c - 1)];
+			}
+	}
+
+	free(pos);
+	free(stk);
+	free(mark);
+	return bp;
+
+error:
+	free(pos);
+	free(stk);
+	free(mark);
+	wrx_bitpar_free(bp);
+	return NULL;
+}
+
+int wrx_bitpar_exec(const wrx_bitpar *bp, const char *str, const char **end) {
+	const bp_tables *t;
+	const char *cp, *skip;
+	uint64_t act = 0, next, d;
+	unsigned char c;
+	int i, prev = CTX_EDGE, start;
+
+	if(!bp) return WRX_BAD_NFA;
+
+	if(bp->nfa_only)
+		return wrx_nfa_end(bp->nfa, str, end);
+
+	for(cp = str; ; cp++) {
+		c = cp[0];
+
+		/* With no positions active, skip to where the next match can begin */
+		if(!act && c && (bp->nfa->bol || bp->nfa->lits || bp->nfa->bndm
+			|| (bp->nfa->first && !BV_TST(bp->nfa->first->bv, c)))) {
+			skip = wrx_next_start(bp->nfa, str, cp);
+			if(!skip)
+				break;
+			if(skip != cp) {
+				cp = skip;
+				c = cp[0];
+				prev = bp->ctx[(unsigned char)cp[-1]];
+			}
+		}
+
+		t = &bp->tab[bp->nctx > 1 ? prev * 4 + bp->ctx[c] : 0];
+
+		/* As with wrx_exec(), a match may start at any character in the
+		string, but only starts at the terminating '\0' if it is empty */
+		start = c || cp == str;
+
+		if((act & t->fin) || (start && t->empty)) {
+			if(end) *end = cp;
+			return WRX_MATCH;
+		}
+
+		next = start ? t->first : 0;
+		for(i = 0, d = act; d; i++, d >>= 8)
+			next |= t->follow[i][d & 0xFF];
+		act = next & bp->accept[c];
+
+		if(!c) break;
+		prev = bp->ctx[c];
+	}
+
+	return WRX_NOMATCH;
+}
+
+/* The number of error levels that wrx_aexec() keeps on the stack */
+#define AEXEC_LEVELS	8
+
+/*
+ *	Approximate matching, after Wu and Manber's agrep: The set of active
+ *	positions is kept for each number of errors i from 0 to k.
+ *	A position is active at level i if the text read so far ends with a
+ *	string that is at most i edits away from one that leads to it.
+ *	Before the next character is consumed, the positions that follow the
+ *	ones at level i - 1 are added to level i (deleting a pattern character).
+ *	After it is consumed, level i also gets the positions of level i - 1
+ *	(inserting a text character) and the ones that follow them (substituting
+ *	one), without testing whether they accept the character.
+ */
+int wrx_aexec(const wregex_t *nfa, const char *str, int k, const char **end, int *err) {
+	const wrx_bitpar *bp;
+	wrx_bitpar *own = NULL;
+	const bp_tables *t;
+	const char *cp;
+	uint64_t buf[3 * AEXEC_LEVELS], *act, *cls, *fol, d;
+	unsigned char c;
+	int i, j, prev = CTX_EDGE, start, r = WRX_NOMATCH;
+
+	if(!nfa) return WRX_BAD_NFA;
+	if(k < 0) k = 0;
+
+	/* wrx_comp() only builds the tables for the patterns wrx_exec() matches
+	with them. The others get tables of their own for this call */
+	bp = nfa->bitpar;
+	if(!bp && !(bp = own = wrx_bitpar_new(nfa)))
+		return WRX_MEMORY;
+	if(bp->nfa_only) {
+		wrx_bitpar_free(own);
+		return WRX_APPROX;
+	}
+
+	if(k < AEXEC_LEVELS)
+		act = buf;
+	else if(!(act = malloc(3 * (k + 1) * sizeof *act))) {
+		wrx_bitpar_free(own);
+		return WRX_MEMORY;
+	}
+	cls = act + k + 1;	/* The active positions, plus the deletions */
+	fol = cls + k + 1;	/* The positions that may follow those in cls[] */
+	memset(act, 0, (k + 1) * sizeof *act);
+
+	for(cp = str; ; cp++) {
+		c = cp[0];
+		t = &bp->tab[bp->nctx > 1 ? prev * 4 + bp->ctx[c] : 0];
+		start = c || cp == str;
+
+		for(i = 0; i <= k; i++) {
+			cls[i] = act[i];
+			if(i > 0) cls[i] |= fol[i - 1];
+
+			/* The first level at which a match ends has the fewest errors */
+			if((cls[i] & t->fin) || (start && t->empty)) {
+				if(end) *end = cp;
+				if(err) *err = i;
+				r = WRX_MATCH;
+				goto done;
+			}
+
+			fol[i] = start ? t->first : 0;
+			for(j = 0, d = cls[i]; d; j++, d >>= 8)
+				fol[i] |= t->follow[j][d & 0xFF];
+		}
+
+		if(!c) break;
+
+		for(i = 0; i <= k; i++) {
+			act[i] = fol[i] & bp->accept[c];
+			if(i > 0) act[i] |= cls[i - 1] | fol[i - 1];
+		}
+		prev = bp->ctx[c];
+	}
+
+done:
+	if(act != buf)
+		free(act);
+	wrx_bitpar_free(own);
+	return r;
+}
+
+void wrx_bitpar_free(wrx_bitpar *bp) {
+	int i;
+	if(!bp) return;
+	for(i = 0; i < 16; i++)
+		free(bp->tab[i].follow);
+	free(bp);
+}
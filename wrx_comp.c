@@ -31,6 +31,8 @@
 
 #include "wregex.h"
 #include "wrxcfg.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
 
 #ifdef DEBUG_OUTPUT
 #	include <stdio.h> /* To be removed, along with all the printf()s */
@@ -70,6 +72,7 @@ typedef struct {
 			  seg_sp;	/* Index of the top of the stack */
 
 	char ci;	/* case insensitive flag */
+	char eol;	/* The pattern ends with '$' */
 } comp_data;
 
 #define THROW(x) longjmp(cd->jb, x)
@@ -86,8 +89,9 @@ static short next_state(comp_data *cd) {
 
 	if(cd->nfa->ns + 1 >= cd->nfa->n_states) {
 		/* We need more states. Guess the number needed from the
-			remaining characters in the input pattern */
-		delta = (DELTA_STATES * strlen(cd->p));
+			remaining characters in the input pattern. Some may still be
+			needed at the end of the pattern, so we always add a few */
+		delta = (DELTA_STATES * (strlen(cd->p) + 1));
 
 		if(cd->nfa->n_states == 0x7FFF) {
 			/* Too many states: We use shorts to index them, and this
@@ -280,6 +284,7 @@ static void pattern(comp_data *cd) {
 
 	if(cd->p[0] == '^') {
 		bol = 1;
+		cd->nfa->bol = 1;
 
 		/* Create a BOL node */
 		b = next_state(cd);
@@ -325,6 +330,7 @@ static void pattern(comp_data *cd) {
 		cd->p++;
 		if(cd->p[0] != '\0')
 			THROW(WRX_BAD_DOLLAR);
+		cd->eol = 1;
 
 		/* Create a EOL node */
 		b = next_state(cd);
@@ -1335,10 +1341,11 @@ static char *sets(comp_data *cd) {
 static void optimize(wregex_t *nfa) {
 	short i;
 	for(i = 0; i < nfa->ns; i++) {
-		while(nfa->states[nfa->states[i].s[0]].op == MOV)
+		/* EOM and MEV have no transitions, and only CHC uses s[1] */
+		while(nfa->states[i].s[0] >= 0 && nfa->states[nfa->states[i].s[0]].op == MOV)
 			nfa->states[i].s[0] = nfa->states[nfa->states[i].s[0]].s[0];
 
-		while(nfa->states[nfa->states[i].s[1]].op == MOV)
+		while(nfa->states[i].s[1] >= 0 && nfa->states[nfa->states[i].s[1]].op == MOV)
 			nfa->states[i].s[1] = nfa->states[nfa->states[i].s[1]].s[0];
 	}
 
@@ -1347,6 +1354,864 @@ static void optimize(wregex_t *nfa) {
 }
 #endif
 
+/*
+ *	Data used while working out whether the NFA is one-pass
+ */
+typedef struct {
+	const wregex_t *nfa;
+
+	char *on_path;	/* The states on the path being followed */
+	char *reached;	/* The leaves already reached from the current node */
+	char used[256];	/* The characters consumed by those leaves */
+
+	short *stk;		/* The REC, STP and assertion states on the path */
+	int sp;
+
+	wrx_path *path;
+	int npath, apath;
+	short *ops;
+	int nops, aops;
+} onepass_data;
+
+/*
+ *	Follows the paths from state st to the states that consume input,
+ *	in the order in which wrx_exec() would, and adds them to od->path.
+ *	Returns 0 if the NFA turns out not to be one-pass
+ */
+static int follow_paths(onepass_data *od, short st) {
+	const wrx_state *sp = &od->nfa->states[st];
+	int c, ok = 1;
+	void *p;
+
+	if(od->on_path[st])
+		return 0; /* A loop that doesn't consume any input */
+
+	switch(sp->op) {
+	case CHC:
+		od->on_path[st] = 1;
+		ok = follow_paths(od, sp->s[0]) && follow_paths(od, sp->s[1]);
+		od->on_path[st] = 0;
+		return ok;
+	case MOV:
+		od->on_path[st] = 1;
+		ok = follow_paths(od, sp->s[0]);
+		od->on_path[st] = 0;
+		return ok;
+	case REC:
+	case STP:
+	case BOL:
+	case EOL:
+	case BOW:
+	case EOW:
+	case BND:
+		od->on_path[st] = 1;
+		od->stk[od->sp++] = st;
+		ok = follow_paths(od, sp->s[0]);
+		od->sp--;
+		od->on_path[st] = 0;
+		return ok;
+	case MTC:
+	case MCI:
+	case SET:
+		for(c = 1; c < 256; c++) {
+			if(sp->op == MTC)
+				ok = c == (unsigned char)sp->data.c;
+			else if(sp->op == MCI)
+				ok = tolower(c) == tolower((unsigned char)sp->data.c);
+			else
+				ok = c < 0x80 && BV_TST(sp->data.bv, c);
+			if(ok && od->used[c])
+				return 0; /* Two paths consume the same character */
+			if(ok)
+				od->used[c] = 1;
+		}
+		break;
+	case EOM:
+	case MEV:
+		break;
+	default:
+		return 0; /* Back references */
+	}
+
+	if(od->reached[st])
+		return 0; /* Two different paths lead to the same state */
+	od->reached[st] = 1;
+
+	if(od->npath + 1 >= od->apath) {
+		od->apath = 2 * od->apath + 8;
+		p = realloc(od->path, od->apath * sizeof *od->path);
+		if(!p) return 0;
+		od->path = p;
+	}
+	if(od->nops + od->sp > od->aops) {
+		od->aops = 2 * od->aops + od->sp;
+		p = realloc(od->ops, od->aops * sizeof *od->ops);
+		if(!p) return 0;
+		od->ops = p;
+	}
+
+	od->path[od->npath].leaf = st;
+	od->path[od->npath].nop = od->sp;
+	od->path[od->npath].op = od->nops;
+	od->npath++;
+	memcpy(od->ops + od->nops, od->stk, od->sp * sizeof *od->stk);
+	od->nops += od->sp;
+
+	return 1;
+}
+
+/*
+ *	Works out whether the NFA is one-pass, and if it is builds the tables
+ *	for wrx_onepass(). Running out of memory here is not an error; the NFA
+ *	is simply treated as not being one-pass.
+ */
+static void onepass(wregex_t *nfa) {
+	onepass_data od;
+	struct _wrx_onepass *op = NULL;
+	int *node, i;
+	short st;
+	char *mem;
+
+	nfa->onepass = NULL;
+
+	memset(&od, 0, sizeof od);
+	od.nfa = nfa;
+
+	node = malloc(nfa->ns * sizeof *node);
+	od.on_path = calloc(2, nfa->ns);
+	od.stk = malloc(nfa->ns * sizeof *od.stk);
+	if(!node || !od.on_path || !od.stk)
+		goto done;
+	od.reached = od.on_path + nfa->ns;
+
+	for(i = 0; i < nfa->ns; i++)
+		node[i] = -1;
+	node[nfa->start] = 0;
+	for(i = 0; i < nfa->ns; i++)
+		switch(nfa->states[i].op) {
+		case MTC: case MCI: case SET: node[nfa->states[i].s[0]] = 0;
+		}
+
+	for(st = 0; st < nfa->ns; st++) {
+		if(node[st] < 0)
+			continue;
+		node[st] = od.npath;
+
+		memset(od.used, 0, sizeof od.used);
+		if(!follow_paths(&od, st))
+			goto done;
+		for(i = node[st]; i < od.npath; i++)
+			od.reached[od.path[i].leaf] = 0;
+
+		/* Each node's list ends with a path with no leaf */
+		od.path[od.npath].leaf = -1;
+		od.path[od.npath].nop = 0;
+		od.path[od.npath].op = 0;
+		od.npath++;
+	}
+
+	mem = malloc(sizeof *op + nfa->ns * sizeof *node + od.npath * sizeof *od.path + od.nops * sizeof *od.ops);
+	if(!mem)
+		goto done;
+
+	op = (struct _wrx_onepass *)mem;
+	op->node = (int *)(op + 1);
+	op->path = (wrx_path *)(op->node + nfa->ns);
+	op->ops = (short *)(op->path + od.npath);
+	memcpy(op->node, node, nfa->ns * sizeof *node);
+	memcpy(op->path, od.path, od.npath * sizeof *od.path);
+	memcpy(op->ops, od.ops, od.nops * sizeof *od.ops);
+
+	nfa->onepass = op;
+
+done:
+	free(node);
+	free(od.on_path);
+	free(od.stk);
+	free(od.path);
+	free(od.ops);
+}
+
+/*
+ *	If the NFA matches nothing but a literal string, stores the string in
+ *	nfa->lit. The characters must all be MTC, or all MCI, in which case the
+ *	string is stored in lower case and nfa->lit_ci is set.
+ *	Running out of memory just means the string isn't stored.
+ */
+static void literal(wregex_t *nfa) {
+	const wrx_state *sp;
+	short st;
+	char op;
+	int n;
+
+	if(nfa->n_subm != 1)
+		return;
+
+	sp = &nfa->states[nfa->start];
+	if(sp->op != REC || sp->data.idx != 0)
+		return;
+
+	op = nfa->states[sp->s[0]].op;
+	if(op != MTC && op != MCI)
+		return;
+	for(n = 0, st = sp->s[0]; nfa->states[st].op == op; st = nfa->states[st].s[0])
+		n++;
+	sp = &nfa->states[st];
+	if(sp->op != STP || nfa->states[sp->s[0]].op != EOM)
+		return;
+
+	nfa->lit = malloc(n + 1);
+	if(!nfa->lit)
+		return;
+	for(n = 0, st = nfa->states[nfa->start].s[0]; nfa->states[st].op == op; st = nfa->states[st].s[0])
+		nfa->lit[n++] = op == MCI ? tolower((unsigned char)nfa->states[st].data.c) : nfa->states[st].data.c;
+	nfa->lit[n] = '\0';
+	nfa->lit_ci = op == MCI;
+}
+
+/*
+ *	If every path through the NFA consumes the same sequence of sets of
+ *	characters, so that all matches have the same length, builds the tables
+ *	for wrx_fixed(). Running out of memory just means they aren't built.
+ */
+static void fixed(wregex_t *nfa) {
+	struct _wrx_fixed *fx;
+	const wrx_state *sp;
+	int len = 0, nop = 0, i, j, c, n;
+	short st;
+	int *size;
+	char *mem;
+
+	nfa->fixed = NULL;
+
+	for(st = nfa->start; ; st = sp->s[0]) {
+		sp = &nfa->states[st];
+		switch(sp->op) {
+		case MTC: case MCI: case SET: len++; continue;
+		case REC: case STP: case BOL: case EOL: case BOW: case EOW: case BND: nop++; continue;
+		case MOV: continue;
+		case EOM: break;
+		default: return;
+		}
+		break;
+	}
+	if(len == 0)
+		return;
+
+	mem = calloc(1, sizeof *fx + len * (32 + 2 * FIXED_RANGES + 1) + (len + 2 * nop) * sizeof(short));
+	size = malloc(len * sizeof *size);
+	if(!mem || !size) {
+		free(mem);
+		free(size);
+		return;
+	}
+
+	fx = (struct _wrx_fixed *)mem;
+	fx->len = len;
+	fx->nop = nop;
+	fx->order = (short *)(fx + 1);
+	fx->ops = fx->order + len;
+	fx->cls = (unsigned char (*)[32])(fx->ops + 2 * nop);
+	fx->lo = (unsigned char (*)[FIXED_RANGES])(fx->cls + len);
+	fx->hi = fx->lo + len;
+	fx->nr = (unsigned char *)(fx->hi + len);
+
+	for(i = 0, nop = 0, st = nfa->start; nfa->states[st].op != EOM; st = sp->s[0]) {
+		sp = &nfa->states[st];
+		switch(sp->op) {
+		case MTC:
+			BV_SET(fx->cls[i], (unsigned char)sp->data.c);
+			break;
+		case MCI:
+			for(c = 1; c < 256; c++)
+				if(tolower(c) == tolower((unsigned char)sp->data.c))
+					BV_SET(fx->cls[i], c);
+			break;
+		case SET:
+			for(c = 1; c < 0x80; c++)
+				if(BV_TST(sp->data.bv, c))
+					BV_SET(fx->cls[i], c);
+			break;
+		case MOV:
+			continue;
+		default:
+			fx->ops[nop++] = st;
+			fx->ops[nop++] = i;
+			continue;
+		}
+
+		/* Split the position's bytes into ranges, and count them */
+		for(c = 1, n = 0, size[i] = 0; c < 256; c++) {
+			if(!BV_TST(fx->cls[i], c))
+				continue;
+			size[i]++;
+			if(c > 1 && BV_TST(fx->cls[i], (c - 1))) {
+				if(n <= FIXED_RANGES)
+					fx->hi[i][n - 1] = c;
+			} else if(++n <= FIXED_RANGES)
+				fx->lo[i][n - 1] = fx->hi[i][n - 1] = c;
+		}
+		fx->nr[i] = n <= FIXED_RANGES ? n : 0;
+
+		/* Insert the position into order[] after the ones that accept fewer bytes */
+		for(j = i; j > 0 && size[fx->order[j - 1]] > size[i]; j--)
+			fx->order[j] = fx->order[j - 1];
+		fx->order[j] = i;
+		i++;
+	}
+
+	fx->ranges = 1;
+	for(i = 0; i < len; i++)
+		if(fx->nr[i] == 0)
+			fx->ranges = 0;
+
+	free(size);
+	nfa->fixed = fx;
+}
+
+/*
+ *	Can the end of a match be reached from the start state without passing
+ *	the state avoid? seen[] and stk[] need room for every state.
+ */
+static int avoidable(const wregex_t *nfa, short avoid, char *seen, short *stk) {
+	const wrx_state *sp;
+	int ts = 0, i;
+	short st;
+
+	memset(seen, 0, nfa->ns);
+	if(nfa->start == avoid)
+		return 0;
+	stk[ts++] = nfa->start;
+	seen[nfa->start] = 1;
+	while(ts > 0) {
+		sp = &nfa->states[stk[--ts]];
+		if(sp->op == EOM || sp->op == MEV)
+			return 1;
+		for(i = 0; i < (sp->op == CHC ? 2 : 1); i++) {
+			st = sp->s[i];
+			if(st >= 0 && st != avoid && !seen[st]) {
+				seen[st] = 1;
+				stk[ts++] = st;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ *	Returns the MTC or MCI state that must follow the MTC or MCI state st,
+ *	because only states that don't consume input or branch lie between them,
+ *	or -1 if there is none
+ */
+static short next_char(const wregex_t *nfa, short st) {
+	const wrx_state *sp;
+	int n;
+
+	for(n = 0, st = nfa->states[st].s[0]; n < nfa->ns; n++, st = sp->s[0]) {
+		sp = &nfa->states[st];
+		switch(sp->op) {
+		case MTC: case MCI: return st;
+		case MOV: case REC: case STP: case BOL: case EOL: case BOW: case EOW: case BND: continue;
+		default: return -1;
+		}
+	}
+	return -1;
+}
+
+/*
+ *	Collects the bytes that the states reachable from the start state without
+ *	passing the state req can consume, which are the bytes that the part of a
+ *	match before nfa->req consists of. Returns NULL if that part can contain
+ *	the first byte of nfa->req, if it is always empty, if the NFA contains
+ *	back references or MEV, or if there is no memory.
+ */
+static unsigned char *before_req(const wregex_t *nfa, short req, char *seen, short *stk) {
+	const wrx_state *sp;
+	unsigned char *bv;
+	int ts = 0, i, c;
+	short st;
+
+	for(i = 0; i < nfa->ns; i++)
+		if(nfa->states[i].op == BRF || nfa->states[i].op == BRI || nfa->states[i].op == MEV)
+			return NULL;
+
+	bv = calloc(32, 1);
+	if(!bv)
+		return NULL;
+	memset(seen, 0, nfa->ns);
+	if(nfa->start != req) {
+		stk[ts++] = nfa->start;
+		seen[nfa->start] = 1;
+	}
+	while(ts > 0) {
+		sp = &nfa->states[stk[--ts]];
+		switch(sp->op) {
+		case MTC:
+			BV_SET(bv, (unsigned char)sp->data.c);
+			break;
+		case MCI:
+			for(c = 1; c < 256; c++)
+				if(tolower(c) == tolower((unsigned char)sp->data.c))
+					BV_SET(bv, c);
+			break;
+		case SET:
+			for(c = 1; c < 0x80; c++)
+				if(BV_TST(sp->data.bv, c))
+					BV_SET(bv, c);
+			break;
+		}
+		for(i = 0; i < (sp->op == CHC ? 2 : 1); i++) {
+			st = sp->s[i];
+			if(sp->op != EOM && st >= 0 && st != req && !seen[st]) {
+				seen[st] = 1;
+				stk[ts++] = st;
+			}
+		}
+	}
+
+	/* If nothing comes before req, nfa->first already finds where matches begin */
+	for(c = 0; c < 32 && !bv[c]; c++)
+		;
+	if(c < 32) {
+		c = (unsigned char)nfa->req[0];
+		if(!BV_TST(bv, c) && !(nfa->req_ci && BV_TST(bv, toupper(c))))
+			return bv;
+	}
+	free(bv);
+	return NULL;
+}
+
+/*
+ *	Finds the longest string of MTC and MCI states that every path from the
+ *	start state to the end of the match passes, and stores it in nfa->req.
+ *	A MTC or MCI state is on every path if the end can't be reached without
+ *	it, and the states that must follow it are then on every path as well.
+ *	Running out of memory just means the string isn't stored. Neither is it
+ *	for patterns with back references: Whether an invalid one is reported
+ *	mustn't depend on whether the string contains req.
+ */
+static void required(wregex_t *nfa) {
+	const wrx_state *sp;
+	char *seen;
+	short *stk, st, best = -1;
+	int i, n, len = 0, ci;
+
+	nfa->req = NULL;
+	nfa->req_ci = 0;
+	nfa->req_pre = NULL;
+
+	if(nfa->ns >= REQ_MAX_STATES || wrx_has_bref(nfa))
+		return;
+
+	seen = malloc(nfa->ns);
+	stk = malloc(nfa->ns * sizeof *stk);
+	if(!seen || !stk)
+		goto done;
+
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		if(sp->op != MTC && sp->op != MCI)
+			continue;
+		for(n = 1, st = next_char(nfa, i); st >= 0 && n < nfa->ns; st = next_char(nfa, st))
+			n++;
+		if(n > len && !avoidable(nfa, i, seen, stk)) {
+			len = n;
+			best = i;
+		}
+	}
+	if(best < 0)
+		goto done;
+
+	nfa->req = malloc(len + 1);
+	if(!nfa->req)
+		goto done;
+	for(ci = 0, st = best; st >= 0; st = next_char(nfa, st))
+		if(nfa->states[st].op == MCI)
+			ci = 1;
+	for(n = 0, st = best; n < len; n++, st = next_char(nfa, st))
+		nfa->req[n] = ci ? tolower((unsigned char)nfa->states[st].data.c) : nfa->states[st].data.c;
+	nfa->req[n] = '\0';
+	nfa->req_ci = ci;
+	nfa->req_pre = before_req(nfa, best, seen, stk);
+
+done:
+	free(seen);
+	free(stk);
+}
+
+/*
+ *	Collects the strings of up to LITS_LEN characters that the paths from
+ *	state st onwards begin with, after the len characters in buf[]. A path's
+ *	string ends at the first state that consumes anything but a single
+ *	character. Sets *ci if a character is matched without regard to case.
+ *	Returns 0 if a path's string would be shorter than 2 characters, or if
+ *	there are too many strings or paths.
+ */
+static int begin_strings(const wregex_t *nfa, short st, char *buf, int len, int *ci,
+		char (*str)[LITS_LEN + 1], int *n, int *steps) {
+	const wrx_state *sp;
+
+	for(;;) {
+		if(++*steps > LITS_MAX * nfa->ns)
+			return 0;
+		sp = &nfa->states[st];
+		switch(sp->op) {
+		case MCI:
+			*ci = 1;
+			/* fallthrough */
+		case MTC:
+			buf[len++] = sp->data.c;
+			if(len == LITS_LEN)
+				goto done;
+			st = sp->s[0];
+			continue;
+		case CHC:
+			if(!begin_strings(nfa, sp->s[0], buf, len, ci, str, n, steps))
+				return 0;
+			st = sp->s[1];
+			continue;
+		case MOV: case REC: case STP: case BOL: case EOL: case BOW: case EOW: case BND:
+			st = sp->s[0];
+			continue;
+		}
+		/* SET, EOM, MEV, BRF and BRI */
+		break;
+	}
+done:
+	if(len < 2 || *n == LITS_MAX)
+		return 0;
+	memcpy(str[*n], buf, len);
+	str[*n][len] = '\0';
+	(*n)++;
+	return 1;
+}
+
+/*
+ *	Finds the strings with which every match begins, for patterns such as
+ *	"timeout|refused|reset by peer", and stores them in nfa->lits. The
+ *	strings must be longer than a byte to skip more than nfa->first does.
+ *	Running out of memory just means the strings aren't stored.
+ */
+static void begin_lits(wregex_t *nfa) {
+	char (*str)[LITS_LEN + 1], buf[LITS_LEN];
+	int n = 0, ci = 0, steps = 0;
+
+	nfa->lits = NULL;
+	if(!nfa->first)
+		return;
+
+	str = malloc(LITS_MAX * sizeof *str);
+	if(!str)
+		return;
+	if(begin_strings(nfa, nfa->start, buf, 0, &ci, str, &n, &steps))
+		nfa->lits = wrx_lits_new(str, n, ci);
+	free(str);
+}
+
+/*
+ *	Finds the window of characters with which every match begins, for
+ *	patterns like "[Ee]rror: [0-9]" that nfa->lits doesn't cover, and stores
+ *	it in nfa->bndm. The window follows the states from the start state up
+ *	to the first alternative, repetition or large set of bytes; the
+ *	assertions are assumed to hold. Running out of memory just means the
+ *	window isn't stored.
+ */
+static void begin_window(wregex_t *nfa) {
+	struct _wrx_bndm *bn;
+	const wrx_state *sp;
+	unsigned long at[256];
+	unsigned char bv[32];
+	short st;
+	int m = 0, n, i, c, steps;
+
+	nfa->bndm = NULL;
+	if(!nfa->first || nfa->lits || nfa->bol)
+		return;
+
+	/* Bit i of at[c] is set if position i accepts c */
+	memset(at, 0, sizeof at);
+	for(st = nfa->start, steps = 0; m < BNDM_MAX && steps < nfa->ns; st = sp->s[0], steps++) {
+		sp = &nfa->states[st];
+		memset(bv, 0, sizeof bv);
+		switch(sp->op) {
+		case MTC:
+			BV_SET(bv, (unsigned char)sp->data.c);
+			break;
+		case MCI:
+			for(c = 1; c < 256; c++)
+				if(tolower(c) == tolower((unsigned char)sp->data.c))
+					BV_SET(bv, c);
+			break;
+		case SET:
+			for(c = 1; c < 0x80; c++)
+				if(BV_TST(sp->data.bv, c))
+					BV_SET(bv, c);
+			break;
+		case MOV: case REC: case STP: case EOL: case BOW: case EOW: case BND:
+			continue;
+		default:
+			/* CHC, EOM, MEV, BRF and BRI */
+			goto done;
+		}
+
+		for(n = 0, c = 1; c < 256; c++)
+			if(BV_TST(bv, c))
+				n++;
+		if(n > BNDM_SET)
+			break;
+		for(c = 1; c < 256; c++)
+			if(BV_TST(bv, c))
+				at[c] |= 1UL << m;
+		m++;
+	}
+
+done:
+	if(m < BNDM_MIN)
+		return;
+
+	bn = calloc(1, sizeof *bn);
+	if(!bn)
+		return;
+	bn->m = m;
+	for(c = 1; c < 256; c++)
+		for(i = 0; i < m; i++)
+			if(at[c] & (1UL << i))
+				bn->mask[c] |= 1UL << (m - 1 - i);
+	nfa->bndm = bn;
+}
+
+/*
+ *	Reverses the NFA if it ends with '$' but doesn't begin with '^' and no
+ *	match can span more than one line, because no state consumes a '\r' or
+ *	a '\n'. wrx_exec() can then search back from the ends of the lines.
+ *	Running out of memory just means the NFA isn't reversed.
+ */
+static void reverse(wregex_t *nfa, int eol) {
+	const wrx_state *sp;
+	int i;
+
+	nfa->rev = NULL;
+	if(!eol || nfa->bol)
+		return;
+
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		switch(sp->op) {
+		case BRF: case BRI: case MEV:
+			return;
+		case MTC: case MCI:
+			if(sp->data.c == '\r' || sp->data.c == '\n')
+				return;
+			break;
+		case SET:
+			if(BV_TST(sp->data.bv, '\r') || BV_TST(sp->data.bv, '\n'))
+				return;
+			break;
+		}
+	}
+
+	nfa->rev = wrx_reverse_nfa(nfa);
+}
+
+/*
+ *	Follows the MOV states from st
+ */
+static short past_mov(const wregex_t *nfa, short st) {
+	int n;
+
+	for(n = 0; nfa->states[st].op == MOV && n < nfa->ns; n++)
+		st = nfa->states[st].s[0];
+	return st;
+}
+
+/*
+ *	Finds the bytes of the loop with which the pattern begins, as in
+ *	".*foo" or "(\w+)@(\w+)\.com", and stores them in nfa->loop.
+ *	If no match begins at a position whose byte is in the loop, then none
+ *	begins at the next position either: The match from there would also
+ *	be a match from the position before it, with the loop going around
+ *	once more. wrx_retry() uses this to pass over the whole run of bytes
+ *	that a failed try went through, instead of trying every position in it
+ *	again, which takes quadratic time.
+ *	Only the REC states may come before the loop. Back references could
+ *	tell the difference, so the patterns that have them are left alone.
+ *	Running out of memory just means the bytes aren't stored.
+ */
+static void begin_loop(wregex_t *nfa) {
+	const wrx_state *sp;
+	short st, t, k = -1;
+	int i, c;
+
+	nfa->loop = NULL;
+	for(i = 0; i < nfa->ns; i++)
+		switch(nfa->states[i].op) {
+			case BRF: case BRI: case MEV: return;
+		}
+
+	for(st = nfa->start, i = 0; i < nfa->ns; i++) {
+		st = past_mov(nfa, st);
+		if(nfa->states[st].op != REC)
+			break;
+		st = nfa->states[st].s[0];
+	}
+
+	sp = &nfa->states[st];
+	if(sp->op == CHC) {
+		/* "x*": One of the ways out of the CHC goes around the loop */
+		for(i = 0; i < 2 && k < 0; i++) {
+			t = past_mov(nfa, sp->s[i]);
+			switch(nfa->states[t].op) {
+			case MTC: case MCI: case SET:
+				if(past_mov(nfa, nfa->states[t].s[0]) == st)
+					k = t;
+			}
+		}
+	} else if(sp->op == MTC || sp->op == MCI || sp->op == SET) {
+		/* "x+": The CHC after the state leads back to it */
+		t = past_mov(nfa, sp->s[0]);
+		if(nfa->states[t].op == CHC
+			&& (past_mov(nfa, nfa->states[t].s[0]) == st || past_mov(nfa, nfa->states[t].s[1]) == st))
+			k = st;
+	}
+	if(k < 0)
+		return;
+
+	nfa->loop = calloc(32, 1);
+	if(!nfa->loop)
+		return;
+	sp = &nfa->states[k];
+	switch(sp->op) {
+	case MTC:
+		BV_SET(nfa->loop, (unsigned char)sp->data.c);
+		break;
+	case MCI:
+		for(c = 1; c < 256; c++)
+			if(tolower(c) == tolower((unsigned char)sp->data.c))
+				BV_SET(nfa->loop, c);
+		break;
+	case SET:
+		for(c = 1; c < 0x80; c++)
+			if(BV_TST(sp->data.bv, c))
+				BV_SET(nfa->loop, c);
+		break;
+	}
+}
+
+/*
+ *	Finds the bytes with which a match can begin, by following the states
+ *	that don't consume input from the start state. The assertions are
+ *	assumed to hold. If the end of the match or a back reference can be
+ *	reached that way, a match can begin anywhere and nothing is stored.
+ *	Running out of memory just means the bytes aren't stored.
+ */
+static void first_bytes(wregex_t *nfa) {
+	struct _wrx_first *f;
+	const wrx_state *sp;
+	char *seen;
+	short *stk, st;
+	int ts = 0, c, any = 0;
+
+	nfa->first = NULL;
+
+	f = calloc(1, sizeof *f);
+	seen = calloc(nfa->ns, 1);
+	stk = malloc(nfa->ns * sizeof *stk);
+	if(!f || !seen || !stk)
+		goto done;
+
+	stk[ts++] = nfa->start;
+	seen[nfa->start] = 1;
+	while(ts > 0 && !any) {
+		st = stk[--ts];
+		sp = &nfa->states[st];
+		switch(sp->op) {
+		case MTC:
+			BV_SET(f->bv, (unsigned char)sp->data.c);
+			break;
+		case MCI:
+			for(c = 1; c < 256; c++)
+				if(tolower(c) == tolower((unsigned char)sp->data.c))
+					BV_SET(f->bv, c);
+			break;
+		case SET:
+			for(c = 1; c < 0x80; c++)
+				if(BV_TST(sp->data.bv, c))
+					BV_SET(f->bv, c);
+			break;
+		case CHC:
+			if(!seen[sp->s[1]]) {
+				seen[sp->s[1]] = 1;
+				stk[ts++] = sp->s[1];
+			}
+			/* fallthrough */
+		case MOV: case REC: case STP: case BOL: case EOL: case BOW: case EOW: case BND:
+			if(!seen[sp->s[0]]) {
+				seen[sp->s[0]] = 1;
+				stk[ts++] = sp->s[0];
+			}
+			break;
+		default:
+			/* EOM, MEV, BRF and BRI */
+			any = 1;
+		}
+	}
+
+	if(!any) {
+		for(c = 1; c < 256; c++)
+			if(BV_TST(f->bv, c)) {
+				if(f->n < 3)
+					f->set[f->n] = c;
+				f->n++;
+			}
+		if(f->n < 256 - 1) {
+			nfa->first = f;
+			f = NULL;
+		}
+	}
+
+done:
+	free(f);
+	free(seen);
+	free(stk);
+}
+
+/*
+ *	Chooses the engine that wrx_exec() uses for the NFA.
+ *	Only the backtracker can match back references, and it is also left
+ *	the patterns that can match the empty string at the end with MEV, since
+ *	it doesn't record submatch 0 for them. The other engines are chosen
+ *	from the fastest down. wrx_onepass() only gets the patterns that begin
+ *	with '^', since it would make a pass from every position in the string
+ *	for the others. The bit-parallel matcher is built here, so that
+ *	wrx_exec() doesn't change the wregex_t.
+ */
+static void plan(wregex_t *nfa) {
+	int i, npos = 0;
+
+	nfa->engine = WRX_ENG_BACKTRACK;
+
+	for(i = 0; i < nfa->ns; i++)
+		switch(nfa->states[i].op) {
+		case BRF: case BRI: case MEV: return;
+		case MTC: case MCI: case SET: npos++; break;
+		}
+
+	literal(nfa);
+	fixed(nfa);
+	if(nfa->lit)
+		nfa->engine = WRX_ENG_LITERAL;
+	else if(nfa->fixed)
+		nfa->engine = WRX_ENG_FIXED;
+	else if(nfa->onepass && nfa->bol)
+		nfa->engine = WRX_ENG_ONEPASS;
+	else if(npos <= 64) {
+		nfa->engine = WRX_ENG_BITPAR;
+		nfa->bitpar = wrx_bitpar_new(nfa);
+	}
+	else if(nfa->ns >= PIKE_MIN_STATES)
+		nfa->engine = WRX_ENG_PIKE;
+}
+
 /*
  *	NFA Compiler. It initializes the wregex_t, and wraps around the
  *	parser functions above
@@ -1374,11 +2239,31 @@ wregex_t *wrx_comp(const char *p, int *e, int *ep) {
 
 	/* We're case sensitive by default */
 	cd.ci = 0;
+	cd.eol = 0;
 
 	cd.nfa = malloc(sizeof(wregex_t));
 	if(!cd.nfa) longjmp(cd.jb, WRX_MEMORY);
 
 	cd.nfa->states = NULL;
+	cd.nfa->dfa = NULL;
+	cd.nfa->rdfa = NULL;
+	cd.nfa->tdfa = NULL;
+	cd.nfa->onepass = NULL;
+	cd.nfa->engine = WRX_ENG_BACKTRACK;
+	cd.nfa->lit = NULL;
+	cd.nfa->lit_ci = 0;
+	cd.nfa->fixed = NULL;
+	cd.nfa->first = NULL;
+	cd.nfa->req = NULL;
+	cd.nfa->req_pre = NULL;
+	cd.nfa->lits = NULL;
+	cd.nfa->bndm = NULL;
+	cd.nfa->loop = NULL;
+	cd.nfa->bol = 0;
+	cd.nfa->rev = NULL;
+	cd.nfa->bitpar = NULL;
+	cd.nfa->jit = NULL;
+	cd.nfa->memo_max = EXEC_MEMO_MAX;
 
 	/* Store a copy of the pattern (I have a good reason for this) */
 	cd.nfa->p = strdup(p);
@@ -1417,6 +2302,15 @@ wregex_t *wrx_comp(const char *p, int *e, int *ep) {
 	optimize(cd.nfa); /* Get rid of the MOV instructions */
 #endif
 
+	onepass(cd.nfa);
+	first_bytes(cd.nfa);
+	begin_lits(cd.nfa);
+	begin_window(cd.nfa);
+	begin_loop(cd.nfa);
+	required(cd.nfa);
+	reverse(cd.nfa, cd.eol);
+	plan(cd.nfa);
+
 	/* Done! Clean up and return success */
 	if(cd.seg) free(cd.seg);
 	if(e) *e = WRX_SUCCESS;
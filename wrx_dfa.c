@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	The subset construction shared by the DFA engines.
+ *
+ *	A transition from a DFA state follows the same steps as wrx_thom()
+ *	does for its list of threads: The epsilon closure of each NFA state in
+ *	the list is followed in order, then a new thread is started if the
+ *	search is unanchored, and the states that consume the character make
+ *	up the new list. Because the order is kept, the DFA finds the same
+ *	match end as wrx_thom() and wrx_exec().
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+
+/*
+ *	Splits the byte classes in ss so that the bytes for which in[] is set
+ *	are in different classes from those for which it isn't.
+ */
+static void split(wrx_subset *ss, const char *in) {
+	short map[256][2];
+	int i, n = 0;
+
+	memset(map, 0xFF, sizeof map);
+	for(i = 0; i < 256; i++) {
+		if(map[ss->cls[i]][!!in[i]] < 0)
+			map[ss->cls[i]][!!in[i]] = n++;
+		ss->cls[i] = map[ss->cls[i]][!!in[i]];
+	}
+	ss->nclass = n;
+}
+
+/*
+ *	Does the state sp consume the character c?
+ */
+static int consumes(const wrx_state *sp, unsigned char c) {
+	switch(sp->op) {
+	case MTC: return c && c == (unsigned char)sp->data.c;
+	case MCI: return c && tolower(c) == tolower((unsigned char)sp->data.c);
+	case SET: return c && c < 0x80 && BV_TST(sp->data.bv, c);
+	}
+	return 0;
+}
+
+/*
+ *	Tests the zero-width assertions, given the contexts of the characters
+ *	before and after the position.
+ */
+static int check(char op, int prev, int next) {
+	switch(op) {
+	case BOL: return prev == CTX_EDGE || prev == CTX_NL;
+	case EOL: return next == CTX_EDGE || next == CTX_NL;
+	case BOW: return next == CTX_WORD && prev != CTX_WORD;
+	case EOW: return prev == CTX_WORD && next != CTX_WORD;
+	case BND: return (prev == CTX_WORD) != (next == CTX_WORD);
+	}
+	assert(0);
+	return 0;
+}
+
+int wrx_has_bref(const wregex_t *nfa) {
+	int i;
+	for(i = 0; i < nfa->ns; i++)
+		if(nfa->states[i].op == BRF || nfa->states[i].op == BRI)
+			return 1;
+	return 0;
+}
+
+int wrx_nfa_end(const wregex_t *nfa, const char *str, const char **end) {
+	wregmatch_t subm[1];
+	int rv;
+
+	rv = wrx_thom(nfa, str, subm, 1);
+	if(rv == WRX_MATCH && end)
+		*end = subm[0].end;
+	return rv;
+}
+
+int wrx_subset_init(wrx_subset *ss, const wregex_t *nfa) {
+	const wrx_state *sp;
+	char in[256];
+	int i, j, nl = 0, word = 0;
+
+	assert(!wrx_has_bref(nfa));
+
+	ss->nfa = nfa;
+	ss->start = nfa->start;
+	ss->all = 0;
+
+	/* Work out which contexts the assertions need to tell apart */
+	for(i = 0; i < nfa->ns; i++)
+		switch(nfa->states[i].op) {
+		case BOL: case EOL: nl = 1; break;
+		case BOW: case EOW: case BND: word = 1; break;
+		}
+
+	/* The end of the string is always in a class of its own */
+	memset(ss->cls, 0, sizeof ss->cls);
+	ss->nclass = 1;
+	memset(in, 0, sizeof in);
+	in[0] = 1;
+	split(ss, in);
+
+	if(nl) {
+		memset(in, 0, sizeof in);
+		in['\r'] = in['\n'] = 1;
+		split(ss, in);
+	}
+	if(word) {
+		for(j = 0; j < 256; j++)
+			in[j] = IS_WORD(j) != 0;
+		split(ss, in);
+	}
+
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		if(sp->op != MTC && sp->op != MCI && sp->op != SET)
+			continue;
+		for(j = 0; j < 256; j++)
+			in[j] = consumes(sp, j);
+		split(ss, in);
+	}
+
+	for(j = 255; j >= 0; j--)
+		ss->rep[ss->cls[j]] = j;
+
+	for(i = 0; i < ss->nclass; i++) {
+		j = ss->rep[i];
+		if(!j)
+			ss->ctx[i] = CTX_EDGE;
+		else if(nl && (j == '\r' || j == '\n'))
+			ss->ctx[i] = CTX_NL;
+		else if(word && IS_WORD(j))
+			ss->ctx[i] = CTX_WORD;
+		else
+			ss->ctx[i] = CTX_OTHER;
+	}
+
+	ss->gen = 0;
+	ss->mark = calloc(2 * nfa->ns, sizeof *ss->mark);
+	ss->stk = malloc((2 * nfa->ns + 2) * sizeof *ss->stk);
+	if(!ss->mark || !ss->stk) {
+		free(ss->mark);
+		free(ss->stk);
+		return WRX_MEMORY;
+	}
+	ss->omark = ss->mark + nfa->ns;
+
+	return WRX_SUCCESS;
+}
+
+void wrx_subset_done(wrx_subset *ss) {
+	free(ss->mark);
+	free(ss->stk);
+}
+
+int wrx_subset_step(wrx_subset *ss, const short *in, int nin, int flags, int k, short *out, int *nout) {
+	const wrx_state *sp;
+	short *stk = ss->stk;
+	int prev = flags & DS_PREV, next = ss->ctx[k];
+	unsigned char c = ss->rep[k];
+	int i, ts, st, no = 0, matched = 0, cut = 0;
+
+	assert(k >= 0 && k < ss->nclass);
+
+	if(++ss->gen == 0) {
+		memset(ss->mark, 0, 2 * ss->nfa->ns * sizeof *ss->mark);
+		ss->gen = 1;
+	}
+
+	for(i = 0; i <= nin && !cut; i++) {
+		if(i < nin)
+			st = in[i];
+		else if((flags & DS_LOOP) && (next != CTX_EDGE || prev == CTX_EDGE))
+			st = ss->start; /* Start a new thread, as wrx_thom() does */
+		else
+			break;
+
+		stk[0] = st;
+		ts = 1;
+		while(ts > 0) {
+			st = stk[--ts];
+			assert(st >= 0 && st < ss->nfa->ns);
+
+			if(ss->mark[st] == ss->gen)
+				continue;
+			ss->mark[st] = ss->gen;
+
+			sp = &ss->nfa->states[st];
+			switch(sp->op) {
+			case CHC:
+				stk[ts++] = sp->s[1];
+				stk[ts++] = sp->s[0];
+				break;
+			case MOV:
+			case REC:
+			case STP:
+				stk[ts++] = sp->s[0];
+				break;
+			case BOL:
+			case EOL:
+			case BOW:
+			case EOW:
+			case BND:
+				if(check(sp->op, prev, next))
+					stk[ts++] = sp->s[0];
+				break;
+			case EOM:
+			case MEV:
+				matched = 1;
+				if(!ss->all) {
+					/* The threads that follow would only have been tried
+					after this match */
+					cut = 1;
+					ts = 0;
+				}
+				break;
+			default:
+				if(consumes(sp, c) && ss->omark[sp->s[0]] != ss->gen) {
+					ss->omark[sp->s[0]] = ss->gen;
+					out[no++] = sp->s[0];
+				}
+			}
+		}
+	}
+
+	*nout = no;
+
+	flags = (flags & DS_LOOP) && !cut && next != CTX_EDGE ? next | DS_LOOP : next;
+	if(matched)
+		flags |= DS_MATCH;
+	return flags;
+}
+
+/*
+ *	Adds the CHC states needed to go from a state to all the states in
+ *	list[0..n-1] and returns the first one.
+ */
+static short fan_out(wregex_t *rev, const short *list, int n) {
+	short s;
+
+	if(n == 1)
+		return list[0];
+
+	s = rev->ns++;
+	rev->states[s].op = CHC;
+	rev->states[s].s[0] = list[0];
+	rev->states[s].s[1] = fan_out(rev, list + 1, n - 1);
+	return s;
+}
+
+wregex_t *wrx_reverse_nfa(const wregex_t *nfa) {
+	wregex_t *rev;
+	const wrx_state *sp;
+	wrx_state *rp;
+	short *pred, *npred, *stk, s, t, acc, fail;
+	char *seen;
+	int i, j, n, ts;
+
+	pred = malloc(4 * nfa->ns * sizeof *pred + 2 * sizeof *pred);
+	seen = calloc(nfa->ns, 1);
+	rev = malloc(sizeof *rev);
+	if(!pred || !seen || !rev) {
+		free(pred);
+		free(seen);
+		free(rev);
+		return NULL;
+	}
+	npred = pred + 2 * nfa->ns + 1;
+	stk = npred + nfa->ns + 1;
+
+	/* Find the states that can be reached from the start state; the others
+	are MOV states that optimize() bypassed */
+	stk[0] = nfa->start;
+	seen[nfa->start] = 1;
+	for(ts = 1; ts > 0;) {
+		sp = &nfa->states[stk[--ts]];
+		for(j = 0; j < (sp->op == CHC ? 2 : sp->op == EOM || sp->op == MEV ? 0 : 1); j++)
+			if(!seen[sp->s[j]]) {
+				seen[sp->s[j]] = 1;
+				stk[ts++] = sp->s[j];
+			}
+	}
+
+	/* The predecessors of state s are pred[npred[s]..npred[s + 1] - 1] */
+	memset(npred, 0, (nfa->ns + 1) * sizeof *npred);
+	npred[nfa->start + 1]++;
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		if(!seen[i] || sp->op == EOM || sp->op == MEV)
+			continue;
+		npred[sp->s[0] + 1]++;
+		if(sp->op == CHC)
+			npred[sp->s[1] + 1]++;
+	}
+	for(i = 0; i < nfa->ns; i++)
+		npred[i + 1] += npred[i];
+
+	/* stk[] is used to count the predecessors that have been filled in */
+	memset(stk, 0, nfa->ns * sizeof *stk);
+	acc = nfa->ns;
+	pred[npred[nfa->start] + stk[nfa->start]++] = acc;
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		if(!seen[i] || sp->op == EOM || sp->op == MEV)
+			continue;
+		pred[npred[sp->s[0]] + stk[sp->s[0]]++] = i;
+		if(sp->op == CHC)
+			pred[npred[sp->s[1]] + stk[sp->s[1]]++] = i;
+	}
+
+	/* Every state needs at most as many extra CHC states as it has
+	predecessors */
+	n = nfa->ns + 2 + npred[nfa->ns];
+	rev->states = malloc(n * sizeof *rev->states);
+	if(!rev->states) {
+		free(pred);
+		free(seen);
+		free(rev);
+		return NULL;
+	}
+	rev->n_states = n;
+	rev->ns = nfa->ns + 2;
+	rev->start = nfa->stop;
+	rev->stop = acc;
+	rev->n_subm = 0;
+	rev->p = NULL;
+	rev->dfa = NULL;
+	rev->rdfa = NULL;
+
+	/* The state that follows the NFA's start state */
+	rp = &rev->states[acc];
+	rp->op = EOM;
+	rp->s[0] = rp->s[1] = -1;
+	rp->data.c = '\0';
+
+	/* A state from which there is no way out, since it never matches */
+	fail = acc + 1;
+	rp = &rev->states[fail];
+	rp->op = MTC;
+	rp->s[0] = rp->s[1] = fail;
+	rp->data.c = '\0';
+
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		rp = &rev->states[i];
+		rp->data = sp->data;
+		rp->s[1] = -1;
+		n = npred[i + 1] - npred[i];
+
+		switch(sp->op) {
+		case MTC:
+		case MCI:
+		case SET:
+		case BND:
+			rp->op = sp->op;
+			break;
+		case BOL: rp->op = EOL; break;
+		case EOL: rp->op = BOL; break;
+		case BOW: rp->op = EOW; break;
+		case EOW: rp->op = BOW; break;
+		default:
+			/* CHC, MOV, REC, STP and EOM don't consume anything */
+			if(n > 1) {
+				rp->op = CHC;
+				rp->s[0] = pred[npred[i]];
+				t = fan_out(rev, pred + npred[i] + 1, n - 1);
+				rev->states[i].s[1] = t;
+				continue;
+			}
+			rp->op = MOV;
+			break;
+		}
+
+		if(!seen[i] || n == 0)
+			s = fail;
+		else
+			s = fan_out(rev, pred + npred[i], n);
+		rev->states[i].s[0] = s;
+	}
+
+	free(pred);
+	free(seen);
+	return rev;
+}
+
+/*
+ *	The context (CTX_*) of the character c
+ */
+static int context(unsigned char c) {
+	if(!c)
+		return CTX_EDGE;
+	if(c == '\r' || c == '\n')
+		return CTX_NL;
+	return IS_WORD(c) ? CTX_WORD : CTX_OTHER;
+}
+
+const char *wrx_rev_start(const wregex_t *rev, const char *str, const char *end, const char *lim, short *work) {
+	const wrx_state *sp;
+	const char *p, *beg = NULL;
+	short *sparse, *dense, *leaf, *stk, st;
+	int i, n, nl, ts, prev, next;
+
+	sparse = work;
+	dense = sparse + rev->ns;
+	leaf = dense + rev->ns;
+	stk = leaf + rev->ns;
+
+	stk[0] = rev->start;
+	ts = 1;
+	for(p = end; ; p--) {
+		/* The reversed string is read from right to left, so the
+		character before a position in it is the one after it in str */
+		prev = context(p[0]);
+		next = p == str ? CTX_EDGE : context(p[-1]);
+
+		/* Follow the transitions that don't consume anything, noting the
+		states that do */
+		for(n = nl = 0; ts > 0;) {
+			st = stk[--ts];
+			if(sparse[st] < n && dense[sparse[st]] == st)
+				continue;
+			sparse[st] = n;
+			dense[n++] = st;
+
+			sp = &rev->states[st];
+			switch(sp->op) {
+			case CHC:
+				stk[ts++] = sp->s[1];
+				stk[ts++] = sp->s[0];
+				break;
+			case BOL:
+			case EOL:
+			case BOW:
+			case EOW:
+			case BND:
+				if(check(sp->op, prev, next))
+					stk[ts++] = sp->s[0];
+				break;
+			case EOM:
+				/* As with wrx_exec(), a match only starts at the
+				terminating '\0' if the string is empty */
+				if(p[0] || p == str)
+					beg = p;
+				break;
+			case MTC:
+			case MCI:
+			case SET:
+				leaf[nl++] = st;
+				break;
+			default:
+				stk[ts++] = sp->s[0];
+				break;
+			}
+		}
+
+		if(p == lim)
+			break;
+		for(i = 0; i < nl; i++)
+			if(consumes(&rev->states[leaf[i]], p[-1]))
+				stk[ts++] = rev->states[leaf[i]].s[0];
+		if(!ts)
+			break;
+	}
+	return beg;
+}
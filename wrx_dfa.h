@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	Header file for the subset construction that the DFA engines share.
+ *	These functions are defined in wrx_dfa.c.
+ *
+ *	A DFA state is an ordered list of NFA states along with a couple of
+ *	flags. The NFA states in the list are the ones reached after the last
+ *	character was consumed, in the order in which wrx_exec() would have
+ *	tried them. Their epsilon closure is only computed once the next
+ *	character is known, because the '$', '<', '>' and "\b" assertions
+ *	depend on it.
+ */
+
+#ifndef _WRX_DFA_H
+#define _WRX_DFA_H
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/* The context of the character on either side of a position in the string */
+#define CTX_EDGE	0	/* The beginning (or end) of the string */
+#define CTX_NL		1	/* '\r' or '\n' */
+#define CTX_WORD	2	/* A character for which IS_WORD() is true */
+#define CTX_OTHER	3	/* Anything else */
+
+/* Flags of a DFA state */
+#define DS_PREV		0x03	/* Context of the last character consumed */
+#define DS_LOOP		0x04	/* A new match may still start at the next position */
+#define DS_MATCH	0x08	/* A match ended just before the last character */
+
+/*
+ *	Everything needed to compute transitions between DFA states
+ */
+typedef struct {
+	const wregex_t *nfa;
+
+	short start;	/* The NFA state at which new threads start */
+
+	/* If set, a match doesn't cut the threads with a lower priority,
+	so that every position where a match ends is reported */
+	char all;
+
+	/* The bytes are divided into classes of bytes that the NFA can't tell
+	apart, so that the DFA needs a transition for each class only */
+	int nclass;
+	unsigned char cls[256];	/* The class of each byte */
+	unsigned char rep[256];	/* A byte from each class */
+	unsigned char ctx[256];	/* The context (CTX_*) of each class */
+
+	/* Work space for wrx_subset_step() */
+	unsigned int gen, *mark, *omark;
+	short *stk;
+} wrx_subset;
+
+/*
+ *	A DFA compiled ahead of time by wrx_comp_dfa().
+ *	The structure and its transition table are allocated as a single block.
+ *	The states are identified by the offsets of their rows in trans[], so
+ *	the state after character c in state s is trans[s + cls[c]]
+ */
+struct _wrx_dfa {
+	int nstates;	/* Number of states */
+	int nclass;		/* Number of byte classes */
+	unsigned char cls[256];	/* The class of each byte */
+	unsigned char ctx[256];	/* The context (CTX_*) of each byte */
+
+	/* The start state, depending on the context of the character before
+	the starting position, or -1 if no byte has that context */
+	int start[4];
+	int mlim;	/* The states less than this are match states (DS_MATCH) */
+	int dead;	/* The state from which no match is possible, or -1 */
+
+	int *trans;	/* The transition table */
+};
+
+/*
+ *	A transition of a tagged DFA
+ */
+typedef struct {
+	int next;	/* The row of the next state, or -1 if no match is possible anymore */
+	int op;		/* The index in ops[] of the first of its operations */
+	short nop;	/* The number of operations */
+	char match;	/* A match ends here; the first operations set the submatches */
+} wrx_tdfa_trans;
+
+/*
+ *	A tagged DFA compiled by wrx_comp_tdfa(). As with struct _wrx_dfa, the
+ *	state after character c in state s is trans[s + cls[c]].
+ *	Each operation is a pair of shorts: The register (or submatch pointer)
+ *	to set, and the register to copy to it or one of the special values
+ *	described in wrx_tdfa.c. The structure, transitions and operations are
+ *	allocated as a single block.
+ */
+struct _wrx_tdfa {
+	int nstates;	/* Number of states */
+	int nclass;		/* Number of byte classes */
+	int nreg;		/* Number of registers */
+	int ncap;		/* Number of submatch pointers */
+	unsigned char cls[256];	/* The class of each byte */
+
+	wrx_tdfa_trans *trans;	/* The transition table. The start state is at 0 */
+	short *ops;		/* The transitions' operations */
+};
+
+/*
+ *	Initializes a wrx_subset for the NFA. The NFA may not contain back
+ *	references. Returns WRX_SUCCESS or WRX_MEMORY.
+ */
+int wrx_subset_init(wrx_subset *ss, const wregex_t *nfa);
+
+/*
+ *	Frees the memory allocated by wrx_subset_init()
+ */
+void wrx_subset_done(wrx_subset *ss);
+
+/*
+ *	Computes the transition from the DFA state consisting of the NFA states
+ *	in[0..nin-1] and flags on the byte class k.
+ *	The NFA states of the new DFA state are stored in out[], which must have
+ *	room for nfa->ns states, and their number in *nout.
+ *	Returns the new DFA state's flags.
+ */
+int wrx_subset_step(wrx_subset *ss, const short *in, int nin, int flags, int k, short *out, int *nout);
+
+/*
+ *	Returns non-zero if the NFA contains back references, which a DFA can't match
+ */
+int wrx_has_bref(const wregex_t *nfa);
+
+/*
+ *	Builds an NFA that matches the reverse of the strings that the NFA
+ *	matches. Each state's transitions lead to the states that led to it in
+ *	the NFA, its start state is the NFA's EOM state and its own EOM state
+ *	follows the NFA's start state. The zero-width assertions are mirrored,
+ *	so '^' becomes '$' and '<' becomes '>'. Returns NULL if there is no
+ *	memory. The character sets are shared with the NFA, so only
+ *	rev->states and rev itself must be freed.
+ */
+wregex_t *wrx_reverse_nfa(const wregex_t *nfa);
+
+/*
+ *	Runs the reversed NFA rev backward over str, from end down to no
+ *	further than lim, and returns the leftmost position where a match of
+ *	the original NFA that ends at end can begin, or NULL if there is none.
+ *	Submatches aren't tracked. work must have room for 6 * rev->ns shorts,
+ *	and be zeroed the first time it is used.
+ */
+const char *wrx_rev_start(const wregex_t *rev, const char *str, const char *end, const char *lim, short *work);
+
+/*
+ *	Finds the end of the match with wrx_thom(), for when a DFA can't be used.
+ *	Returns the same values as wrx_lazy_exec() and wrx_dfa_exec()
+ */
+int wrx_nfa_end(const wregex_t *nfa, const char *str, const char **end);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+} /* extern "C" */
+#endif
+
+#endif /*_WRX_DFA_H*/
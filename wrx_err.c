@@ -52,6 +52,8 @@ const char *wrx_error(int code) {
 	case WRX_MANY_STATES	: return "Too many states in expression";
 	case WRX_STACK			: return "Can't grow stack any further";
 	case WRX_OPCODE			: return "Unknown opcode";
+	case WRX_NO_JIT			: return "JIT compiler not available";
+	case WRX_APPROX			: return "Pattern too big or has back references for approximate matching";
 	}
 	return "Unknown error";
 }
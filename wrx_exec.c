@@ -26,12 +26,13 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
-#include <setjmp.h>
 
 #include <assert.h>
 
 #include "wregex.h"
 #include "wrxcfg.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
 
 #ifdef DEBUG_OUTPUT
 #	include <stdio.h>
@@ -59,6 +60,7 @@ typedef struct {
 	stack_el *els;	/* Elements on the stack */
 	short ns;	 	/* Number of elements on the stack */
 	short ts;		/* Top of stack */
+	short npos;		/* Number of op_pos elements on the stack */
 } stack;
 
 /*
@@ -79,6 +81,7 @@ static stack *stack_create(int ns) {
 
 	st->ns = ns;
 	st->ts = 0;
+	st->npos = 0;
 
 	return st;
 }
@@ -116,6 +119,8 @@ static int push(stack *stk, stack_op op, const char *opr, short state) {
 	stk->els[stk->ts].st = state;
 
 	stk->ts++;
+	if(op == op_pos)
+		stk->npos++;
 
 	return 1;
 }
@@ -125,13 +130,156 @@ static int push(stack *stk, stack_op op, const char *opr, short state) {
  */
 static stack_el* pop(stack *stk) {
 	if(--stk->ts < 0) return NULL;
+	if(stk->els[stk->ts].op == op_pos)
+		stk->npos--;
 	return &stk->els[stk->ts];
 }
 
+/*
+ *	Marks state st at position pos as visited in the bitmap memo.
+ *	Returns non-zero if it had been visited before.
+ */
+static int been_here(unsigned char *memo, int ns, size_t pos, short st) {
+	size_t i = pos * ns + st;
+	if(memo[i >> 3] & (1 << (i & 7)))
+		return 1;
+	memo[i >> 3] |= 1 << (i & 7);
+	return 0;
+}
+
+/*
+ *	The number of steps after which the backtracker gives up on str
+ */
+size_t wrx_max_steps(const wregex_t *nfa, const char *str) {
+	size_t steps = BACKTRACK_STEPS * (strlen(str) + 1) * nfa->ns;
+	return steps < BACKTRACK_MAX ? steps : BACKTRACK_MAX;
+}
+
+unsigned char *wrx_new_memo(const wregex_t *nfa, const char *str, unsigned char *mbuf, size_t mbuf_size) {
+	size_t sz = ((strlen(str) + 1) * nfa->ns + 7) / 8;
+
+	if(sz <= mbuf_size) {
+		memset(mbuf, 0, sz);
+		return mbuf;
+	}
+	if(sz <= nfa->memo_max)
+		return calloc(sz, 1);
+	return NULL;
+}
+
+/*
+ *	Sets the n submatches in subm[] to NULL
+ */
+static void clear_subm(wregmatch_t subm[], int n) {
+	int i;
+
+	for(i = 0; i < n; i++) {
+		subm[i].beg = NULL;
+		subm[i].end = NULL;
+	}
+}
+
+/* Returned by backtrack() when it takes more than max_steps steps */
+#define GAVE_UP	2
+
+/*
+ *	The states are dispatched with a switch statement, or with GCC's
+ *	computed gotos if THREADED_DISPATCH is defined: The code of each opcode
+ *	then moves on to the next state itself and ends with a jump through a
+ *	table of labels straight to the code for that state's opcode, so the
+ *	CPU has a separate indirect branch to predict at the end of each
+ *	opcode's code. wrx_comp() only emits the opcodes in the table, so the
+ *	jump needs no bounds check.
+ */
+
+/* Pushes an element on the stack, or returns the error if it can't grow */
+#define PUSH(op, opr, st) \
+	if((p = push(stk, op, opr, st)) != 1) { \
+		rv = p ? WRX_STACK : WRX_MEMORY; \
+		goto done; \
+	}
+
+/*
+ *	If the stack holds no more positions, pushes the next position where a
+ *	match can begin as a start state, so that a pattern like "abc" can
+ *	match against "xasxabc". For a pattern that begins with '^' that is the
+ *	start of the next line, so the lines are tried one at a time and in
+ *	order.
+ */
+#define RETRY \
+	if(stk->npos == 0 && (b = wrx_retry(nfa, s)) != NULL && (b = wrx_next_start(nfa, str, b)) != NULL) { \
+		s = b; \
+		PUSH(op_pos, s, nfa->start); \
+	}
+
+/*
+ *	Counts a step, and abandons the path if the state was tried at this
+ *	position before: it didn't lead to a match then either. The bitmap is
+ *	set up once the step count passes the first limit, and the search
+ *	begins again at the first start position, so that all of its paths are
+ *	checked against the bitmap. The bitmap bounds the steps by itself, so
+ *	after that there is only a limit if it couldn't be set up, and passing
+ *	that limit means giving up.
+ */
+#define STEP \
+	if(++steps > limit) { \
+		if(!want) { \
+			rv = GAVE_UP; \
+			goto done; \
+		} \
+		want = 0; \
+		memo = wrx_new_memo(nfa, str, mbuf, sizeof mbuf); \
+		limit = memo || !max_steps ? (size_t)-1 : max_steps; \
+		if(memo) { \
+			stk->ts = stk->npos = 0; \
+			clear_subm(subm, nsm); \
+			clear_subm(spare_sm, nfa->n_subm - nsm); \
+			s = cp = first; \
+			st = nfa->start; \
+			sp = &nfa->states[st]; \
+		} \
+	} \
+	if(memo && been_here(memo, nfa->ns, cp - str, st)) \
+		goto fail;
+
+#ifdef DEBUG_OUTPUT
+#	define MOVED	printf("moving to state %d ('%c')\n", st, cp[0]);
+#else
+#	define MOVED
+#endif
+
+#ifdef THREADED_DISPATCH
+#	define DISPATCH(op) \
+		assert((unsigned char)(op) <= MEV); \
+		goto *dispatch[(unsigned char)(op)];
+#	define CASE(op)		do_##op
+/* Moves on to the next state and jumps to the code for its opcode */
+#	define CONTINUE \
+		st = sp->s[0]; \
+		MOVED \
+		assert(st < nfa->n_states); \
+		sp = &nfa->states[st]; \
+		RETRY \
+		STEP \
+		DISPATCH(sp->op)
+#else
+#	define DISPATCH(op)	switch(op)
+#	define CASE(op)		case op
+#	define CONTINUE		goto next;
+#endif
+
+#ifdef THREADED_DISPATCH
+/* Computed gotos are an extension that -pedantic warns about */
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
 /*
  * Matches the string str to the NFA nfa, and stores the submatches in subm[]
+ * Gives up after max_steps steps, unless max_steps is 0 or the bitmap of the
+ * states tried so far could be set up.
  */
-int wrx_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+static int backtrack(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm, size_t max_steps) {
 	short st; 			/* current state */
 	wrx_state *sp;	/* state pointer */
 
@@ -139,19 +287,30 @@ int wrx_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm)
 	stack_el* sl;		/* last element popped from the stack */
 
 	const char *cp, 	/* Tracks the current character being matched */
-				*s;		/* Tracks the beginning of the string */
-
-	char cont;			/* flag to continue */
+				*s,		/* Tracks the beginning of the string */
+				*first;	/* The first position where a match can begin */
 
 	wregmatch_t *spare_sm = NULL;
 
+	unsigned char *memo = NULL;	/* The (state, position) pairs tried so far */
+	unsigned char mbuf[256];	/* Holds memo for short strings */
+	int want;					/* Set until memo is set up */
+	size_t steps = 0, limit;
+
 	/* various indexes and counters*/
-	int i, ctr, bol = 0, p;
+	int i, p;
 	const char *b;
 	wregmatch_t *sm;
 
-	int rv;
-	jmp_buf ex;	/* Exception handling */
+	int rv = WRX_NOMATCH;
+
+#ifdef THREADED_DISPATCH
+	/* The labels of the opcodes' code, in the order of the opcode enum */
+	static const void *const dispatch[] = {
+		&&do_MTC, &&do_MCI, &&do_CHC, &&do_MOV, &&do_EOM, &&do_SET, &&do_REC, &&do_STP,
+		&&do_BRF, &&do_BRI, &&do_BOL, &&do_EOL, &&do_BOW, &&do_EOW, &&do_BND, &&do_MEV
+	};
+#endif
 
 	assert(nfa->start < nfa->ns);
 	assert(nfa->stop < nfa->ns);
@@ -176,23 +335,37 @@ int wrx_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm)
 		}
 	}
 
-	for(i = 0; i < nsm; i++) {
-		subm[i].beg = NULL;
-		subm[i].end = NULL;
-	}
-
-	if((rv = setjmp(ex)) != 0) {
-		/* Exception handling: Error or Match */
-		free_stack(stk);
-		free(spare_sm);
-		return rv;
-	}
-#define THROW(x) longjmp(ex, (x))
-
-	/* Push the first character on top of the stack */
-	p = push(stk, op_pos, str, nfa->start);
-	if(p == 0 || p == -1)
-		THROW(p?WRX_STACK:WRX_MEMORY);
+	clear_subm(subm, nsm);
+
+	/*
+	 *	Without back references, whether a match can be found from a state at
+	 *	a position doesn't depend on the path that led there, so once a state
+	 *	has been tried at a position there is no point in trying it again
+	 *	after backtracking. This bounds the work to the length of the string
+	 *	times the number of states. The bitmap belongs to this call, so that
+	 *	several threads can match with the same wregex_t.
+	 *	Clearing the bitmap costs a bit for every state at every position in
+	 *	the string, while most strings match or fail within a few steps, so
+	 *	it is only set up after BACKTRACK_MEMO_STEPS steps.
+	 *	Which submatches are found in empty loops such as "(a*)*" depends on
+	 *	the bitmap, because a path that comes back to a state at the same
+	 *	position is cut off. So when the bitmap is set up the search begins
+	 *	again with it, and the result is the same as if it had been there
+	 *	from the first step. That repeats at most BACKTRACK_MEMO_STEPS
+	 *	steps. Without the bitmap, the step limit applies.
+	 */
+	want = nfa->memo_max > 0 && !wrx_has_bref(nfa);
+	if(want)
+		limit = BACKTRACK_MEMO_STEPS;
+	else
+		limit = max_steps ? max_steps : (size_t)-1;
+
+	/* Push the first position where a match can begin on top of the stack */
+	if(!str[0] || (s = wrx_next_start(nfa, str, str)) != NULL) {
+		PUSH(op_pos, s, nfa->start);
+	} else
+		s = str + strlen(str);
+	first = s;
 
 	/** Execute **/
 	while((sl = pop(stk)) != NULL) {
@@ -239,290 +412,445 @@ int wrx_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm)
 		else
 			printf(": %d\n", sp->op);
 #endif
-		do {
-			cont = 0;
-			switch(sp->op)
-			{
-			case CHC:
-			{
-#ifdef DEBUG_OUTPUT
-				printf("CHC @ %d\n", st);
+#ifndef THREADED_DISPATCH
+step:
 #endif
-				/* Push the alternatice route onto the stack */
-				p = push(stk, op_pos, cp, sp->s[1]);
-				if(p == 0 || p == -1)
-					THROW(p?WRX_STACK:WRX_MEMORY);
-
-				/* and continue along the current route */
-				cont = 1;
-			} break;
-			case MOV:
-			{
+		STEP
+
+		DISPATCH(sp->op)
+		{
+		CASE(CHC):
 #ifdef DEBUG_OUTPUT
-				printf("MOV @ %d\n", st);
+			printf("CHC @ %d\n", st);
 #endif
-				cont = 1;
-			} break;
-			case EOM:
-			{
+			/* Push the alternatice route onto the stack */
+			PUSH(op_pos, cp, sp->s[1]);
+
+			/* and continue along the current route */
+			CONTINUE
+		CASE(MOV):
 #ifdef DEBUG_OUTPUT
-				printf("EOM @ %d\n", st);
+			printf("MOV @ %d\n", st);
 #endif
-				/* If we get here, the we found a path through the graph */
-				THROW(WRX_MATCH);
-			}
-			case SET:
-			{
+			CONTINUE
+		CASE(EOM):
 #ifdef DEBUG_OUTPUT
-				printf("SET @ %d ('%c')\n", st, cp[0]);
+			printf("EOM @ %d\n", st);
 #endif
-				if(BV_TST(sp->data.bv, cp[0])) {
-					cont = 1;
-					/* get the next character in the input string */
-					cp++;
-				}
-			} break;
-			case REC: /* Start recording a submatch */
-			{
+			/* If we get here, the we found a path through the graph */
+			rv = WRX_MATCH;
+			goto done;
+		CASE(SET):
 #ifdef DEBUG_OUTPUT
-				printf("REC @ %d (%d)\n", st, sp->data.idx);
+			printf("SET @ %d ('%c')\n", st, cp[0]);
 #endif
-				/* Store the current submatch beginning in case we backtrack through here again */
-				if(sp->data.idx < nsm)
-					p = push(stk, op_rbeg, subm[sp->data.idx].beg, sp->data.idx);
-				else
-					p = push(stk, op_rbeg, spare_sm[sp->data.idx - nsm].beg, sp->data.idx);
-
-				if(p == 0 || p == -1)
-					THROW(p?WRX_STACK:WRX_MEMORY);
-
-				/* Record the beginning of the submatch */
-				if(sp->data.idx < nsm)
-					subm[sp->data.idx].beg = cp;
-				else
-					spare_sm[sp->data.idx - nsm].beg = cp;
-
-				cont = 1;
-			} break;
-			case STP:/* Stop recording a submatch */
-			{
+			/* Sets only hold bytes below 0x80, as in wrx_thom() */
+			if(cp[0] && (unsigned char)cp[0] < 0x80 && BV_TST(sp->data.bv, (unsigned char)cp[0])) {
+				/* get the next character in the input string */
+				cp++;
+				CONTINUE
+			}
+			goto fail;
+		CASE(REC): /* Start recording a submatch */
 #ifdef DEBUG_OUTPUT
-				printf("STP @ %d (%d)\n", st, sp->data.idx);
+			printf("REC @ %d (%d)\n", st, sp->data.idx);
 #endif
-				/* Store the current submatch ending in case we backtrack through here again */
-				if(sp->data.idx < nsm)
-					p = push(stk, op_rend, subm[sp->data.idx].end, sp->data.idx);
-				else
-					p = push(stk, op_rend, spare_sm[sp->data.idx - nsm].end, sp->data.idx);
-
-				if(p == 0 || p == -1)
-					THROW(p?WRX_STACK:WRX_MEMORY);
-
-				/* Record the ending of the submatch */
-				if(sp->data.idx < nsm)
-					subm[sp->data.idx].end = cp;
-				else
-					spare_sm[sp->data.idx - nsm].end = cp;
-				cont = 1;
-			} break;
-			case BRF:/* Match a backreference */
-			{
+			/* Store the current submatch beginning in case we backtrack through here again,
+			and record the beginning of the submatch */
+			if(sp->data.idx < nsm) {
+				PUSH(op_rbeg, subm[sp->data.idx].beg, sp->data.idx);
+				subm[sp->data.idx].beg = cp;
+			} else {
+				PUSH(op_rbeg, spare_sm[sp->data.idx - nsm].beg, sp->data.idx);
+				spare_sm[sp->data.idx - nsm].beg = cp;
+			}
+			CONTINUE
+		CASE(STP): /* Stop recording a submatch */
 #ifdef DEBUG_OUTPUT
-				printf("BRF @ %d (%d)\n", st, sp->data.idx);
+			printf("STP @ %d (%d)\n", st, sp->data.idx);
 #endif
-				i = sp->data.idx;
-
-				if(i >= nfa->n_subm) /* The specified backreference does not exist */
-					THROW(WRX_INV_BREF);
-
-				if(i < nsm)
-					sm = &subm[i];
-				else
-					sm = &spare_sm[i];
-
-				if(!sm->beg || !sm->end) /* The specified backreference or has not been matched */
-					THROW(WRX_INV_BREF);
-
-				for(cont = 1, b = sm->beg; b < sm->end; b++, cp++)
-					if(b[0] != cp[0]) {
-						cont = 0;
-						break;
-					}
-
-			} break;
-			case BRI:/* Match a (case insensitive) backreference */
-			{
+			/* Store the current submatch ending in case we backtrack through here again,
+			and record the ending of the submatch */
+			if(sp->data.idx < nsm) {
+				PUSH(op_rend, subm[sp->data.idx].end, sp->data.idx);
+				subm[sp->data.idx].end = cp;
+			} else {
+				PUSH(op_rend, spare_sm[sp->data.idx - nsm].end, sp->data.idx);
+				spare_sm[sp->data.idx - nsm].end = cp;
+			}
+			CONTINUE
+		CASE(BRF): /* Match a backreference */
+		CASE(BRI): /* Match a (case insensitive) backreference */
 #ifdef DEBUG_OUTPUT
-				printf("BRI @ %d (%d)\n", st, sp->data.idx);
+			printf("%s @ %d (%d)\n", sp->op == BRF ? "BRF" : "BRI", st, sp->data.idx);
 #endif
-				i = sp->data.idx;
-
-				if(i >= nfa->n_subm) /* The specified backreference does not exist */
-					THROW(WRX_INV_BREF);
+			i = sp->data.idx;
 
-				if(i < nsm)
-					sm = &subm[i];
-				else
-					sm = &spare_sm[i];
+			if(i >= nfa->n_subm) { /* The specified backreference does not exist */
+				rv = WRX_INV_BREF;
+				goto done;
+			}
 
-				if(!sm->beg || !sm->end) /* The specified backreference or has not been matched */
-					THROW(WRX_INV_BREF);
+			if(i < nsm)
+				sm = &subm[i];
+			else
+				sm = &spare_sm[i - nsm];
 
-				for(cont = 1, b = sm->beg; b < sm->end; b++, cp++)
-					if(tolower(b[0]) != tolower(cp[0])) {
-						cont = 0;
-						break;
-					}
+			if(!sm->beg || !sm->end) { /* The specified backreference or has not been matched */
+				rv = WRX_INV_BREF;
+				goto done;
+			}
 
-			} break;
-			case BOL: /* beginning of line */
-			{
+			for(b = sm->beg; b < sm->end; b++, cp++)
+				if(sp->op == BRF ? b[0] != cp[0] : tolower(b[0]) != tolower(cp[0]))
+					goto fail;
+			CONTINUE
+		CASE(BOL): /* beginning of line */
 #ifdef DEBUG_OUTPUT
-				printf("BOL @ %d\n", st);
+			printf("BOL @ %d\n", st);
 #endif
-				bol = 1;
-				if(cp == str) {
-					cont = 1;
-				} else {
-					assert(cp > str);
-					if(cp[-1] == '\r' || cp[-1] == '\n')
-						cont = 1;
-				}
-			} break;
-			case EOL: /* end of line */
-			{
+			if(cp == str) {
+				CONTINUE
+			}
+			assert(cp > str);
+			if(cp[-1] == '\r' || cp[-1] == '\n') {
+				CONTINUE
+			}
+			goto fail;
+		CASE(EOL): /* end of line */
 #ifdef DEBUG_OUTPUT
-				printf("EOL @ %d\n", st);
+			printf("EOL @ %d\n", st);
 #endif
-				if(cp[0] == '\r' || cp[0] == '\n' || cp[0] == '\0')
-					cont = 1;
-			} break;
-			case BOW: /* beginning of word */
-			{
+			if(cp[0] == '\r' || cp[0] == '\n' || cp[0] == '\0') {
+				CONTINUE
+			}
+			goto fail;
+		CASE(BOW): /* beginning of word */
 #ifdef DEBUG_OUTPUT
-				printf("BOW @ %d\n", st);
+			printf("BOW @ %d\n", st);
 #endif
-				if(cp == str) {
-					if(isalnum(cp[0]))
-						cont = 1; /* first char in string */
-				} else {
-					assert(cp > str);
-					if(isalnum(cp[0]) && !isalnum(cp[-1]))
-						cont = 1;
+			if(cp == str) {
+				if(isalnum(cp[0])) {
+					CONTINUE /* first char in string */
 				}
-			} break;
-			case EOW: /* end of word */
-			{
-#ifdef DEBUG_OUTPUT
-				printf("EOW @ %d\n", st);
-#endif
-				if(cp > str && isalnum(cp[-1]))
-					if(!isalnum(cp[0]))
-						cont = 1;
-			} break;
-			case BND:
-			{
-#ifdef DEBUG_OUTPUT
-				printf("BND @ %d\n", st);
-#endif
-				if(cp == str) {
-					if(isalnum(cp[0]))
-						cont = 1; /* first char in string */
-				} else {
-					assert(cp > str);
-					if(isalnum(cp[0]) ^ isalnum(cp[-1]))
-						cont = 1;
+			} else {
+				assert(cp > str);
+				if(isalnum(cp[0]) && !isalnum(cp[-1])) {
+					CONTINUE
 				}
-			} break;
-			case MEV:
-				/* Special case: Match everything (used with empty patterns) */
-				THROW(WRX_MATCH);
-			case MTC:
-			{
+			}
+			goto fail;
+		CASE(EOW): /* end of word */
 #ifdef DEBUG_OUTPUT
-				printf("MTC %c ?= %c @ %d\n", cp[0], sp->data.c, st);
+			printf("EOW @ %d\n", st);
 #endif
-				if(cp[0] == sp->data.c) {
-					cont = 1;
-					/* get the next character in the input string */
-					cp++;
-				}
-			} break;
-			case MCI: /* match case insensitive */
-			{
+			if(cp > str && isalnum(cp[-1]) && !isalnum(cp[0])) {
+				CONTINUE
+			}
+			goto fail;
+		CASE(BND):
 #ifdef DEBUG_OUTPUT
-				printf("MCI %c ?= %c @ %d\n", cp[0], sp->data.c, st);
+			printf("BND @ %d\n", st);
 #endif
-				if(tolower(cp[0]) == tolower(sp->data.c)) {
-					cont = 1;
-					/* get the next character in the input string */
-					cp++;
+			if(cp == str) {
+				if(isalnum(cp[0])) {
+					CONTINUE /* first char in string */
 				}
-			} break;
-			default: THROW(WRX_OPCODE);
-			} /* switch sp->op */
-
-			/* Continue along this path? */
-			if(cont) {
-				/* move to the next state */
-				st = sp->s[0];
+			} else {
+				assert(cp > str);
+				if(isalnum(cp[0]) ^ isalnum(cp[-1])) {
+					CONTINUE
+				}
+			}
+			goto fail;
+		CASE(MEV):
+			/* Special case: Match everything (used with empty patterns) */
+			rv = WRX_MATCH;
+			goto done;
+		CASE(MTC):
 #ifdef DEBUG_OUTPUT
-				printf("moving to state %d ('%c')\n", st, cp[0]);
+			printf("MTC %c ?= %c @ %d\n", cp[0], sp->data.c, st);
 #endif
-				assert(st < nfa->n_states);
-				sp = &nfa->states[st];
+			if(cp[0] == sp->data.c) {
+				/* get the next character in the input string */
+				cp++;
+				CONTINUE
 			}
-
-			/*
-			 *	count the number of op_pos operators on the stack for what
-			 *	we're going to do next:
-			 */
-			ctr = 0;
-			for(i = 0; i < stk->ts; i++)
-				if(stk->els[i].op == op_pos) ctr++;
-
-			/*
-			 *	If we don't have a beginning-of-line '^' (BOL) and if our
-			 *	stack will be empty after the next pop(),
-			 *	we push the next starting character as a start state onto the
-			 *	stack so that a pattern like "abc" can match against "xasxabc"
-			 */
+			goto fail;
+		CASE(MCI): /* match case insensitive */
 #ifdef DEBUG_OUTPUT
-			printf("bol %d; ctr %d; s[1] %d\n", bol, ctr, s[1]);
+			printf("MCI %c ?= %c @ %d\n", cp[0], sp->data.c, st);
 #endif
-			if(bol) {
-				/* We have an '^' anchor, push every character that follows
-				a newline to the stack */
-				if(bol == 1 && ctr == 0) {
-					while(s[0]) {
-						if((s[0] == '\r' || s[0] == '\n') && s[1]) {
-#ifdef DEBUG_OUTPUT
-							printf("pushing '%c' start\n", s[1]);
+			if(tolower(cp[0]) == tolower(sp->data.c)) {
+				/* get the next character in the input string */
+				cp++;
+				CONTINUE
+			}
+			goto fail;
+#ifndef THREADED_DISPATCH
+		default:
+			rv = WRX_OPCODE;
+			goto done;
 #endif
-							p = push(stk, op_pos, ++s, nfa->start);
-							if(p == 0 || p == -1)
-								THROW(p?WRX_STACK:WRX_MEMORY);
-						}
-						s++;
-					}
-
-					bol++;
-				}
-			} else if(ctr == 0 && s[1]) {
-#ifdef DEBUG_OUTPUT
-				printf("pushing '%c' start\n", s[1]);
+		} /* switch sp->op */
+
+#ifndef THREADED_DISPATCH
+next:
+		/* move to the next state */
+		st = sp->s[0];
+		MOVED
+		assert(st < nfa->n_states);
+		sp = &nfa->states[st];
+		RETRY
+		goto step;
 #endif
-				p = push(stk, op_pos, ++s, nfa->start);
-				if(p == 0 || p == -1)
-					THROW(p?WRX_STACK:WRX_MEMORY);
-			}
-		} while(cont);
+
+fail:
+		/* Abandon this path, and pop the next alternative */
+		RETRY
 	}
 
-	/* Error or No match */
+	/* No match */
+
+done:
+	if(memo != mbuf)
+		free(memo);
 	free_stack(stk);
 	free(spare_sm);
 	return rv;
+}
+
+#ifdef THREADED_DISPATCH
+#	pragma GCC diagnostic pop
+#endif
+
+#undef DISPATCH
+#undef CASE
+#undef CONTINUE
+#undef MOVED
+#undef STEP
+#undef RETRY
+#undef PUSH
+
+int wrx_backtrack(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	return backtrack(nfa, str, subm, nsm, 0);
+}
+
+/*
+ *	Returns the first line start from cp onwards at which a match can begin,
+ *	for patterns that begin with '^'. The line breaks are found with
+ *	strpbrk(), which the C library usually implements with vector
+ *	instructions, so that the lines are visited one at a time as the
+ *	matchers need them.
+ */
+static const char *next_line(const wregex_t *nfa, const char *str, const char *cp) {
+	const struct _wrx_first *f = nfa->first;
+
+	for(;;) {
+		if(cp > str && cp[-1] != '\r' && cp[-1] != '\n') {
+			cp = strpbrk(cp, "\r\n");
+			if(!cp)
+				return NULL;
+			cp++;
+		}
+		if(!cp[0])
+			return NULL;
+		if(!f || BV_TST(f->bv, (unsigned char)cp[0]))
+			return cp;
+		cp++;
+	}
+}
 
-#undef THROW
+const char *wrx_next_start(const wregex_t *nfa, const char *str, const char *cp) {
+	const struct _wrx_first *f = nfa->first;
+
+	if(nfa->bol)
+		return next_line(nfa, str, cp);
+
+	if(!f)
+		return cp[0] ? cp : NULL;
+
+	if(nfa->lits)
+		return wrx_lits_find(nfa->lits, cp);
+	if(nfa->bndm)
+		return wrx_bndm_find(nfa->bndm, cp);
+
+	/* The C library's searches are usually much faster than a loop */
+	if(f->n == 1)
+		return strchr(cp, f->set[0]);
+	if(f->n <= 3)
+		return strpbrk(cp, f->set);
+
+	while(cp[0] && !BV_TST(f->bv, (unsigned char)cp[0]))
+		cp++;
+	return cp[0] ? cp : NULL;
+}
+
+const char *wrx_retry(const wregex_t *nfa, const char *beg) {
+	if(!beg[0])
+		return NULL;
+
+	/* A match that begins right after a byte of the loop would also begin
+	before it, so it would have been found */
+	for(beg++; beg[0] && nfa->loop && BV_TST(nfa->loop, (unsigned char)beg[-1]); beg++)
+		;
+	return beg[0] ? beg : NULL;
+}
+
+const char *wrx_find_req(const wregex_t *nfa, const char *str) {
+	return wrx_strstr(str, nfa->req, nfa->req_ci);
+}
+
+/*
+ *	Finds the first occurrence of the NFA's literal string in str
+ */
+static int literal(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const char *cp;
+	int i;
+
+	cp = wrx_strstr(str, nfa->lit, nfa->lit_ci);
+	if(!cp)
+		return WRX_NOMATCH;
+
+	for(i = 0; i < nsm; i++) {
+		subm[i].beg = NULL;
+		subm[i].end = NULL;
+	}
+	if(nsm > 0) {
+		subm[0].beg = cp;
+		subm[0].end = cp + strlen(nfa->lit);
+	}
+	return WRX_MATCH;
+}
+
+/*
+ *	Matches the NFA outward from the occurrences of nfa->req, beginning with
+ *	the first one at lit. The part of a match before req can't contain the
+ *	first byte of req, so a match that passes req at lit begins after the
+ *	previous occurrence, and somewhere in the run of bytes from
+ *	nfa->req_pre that ends at lit. wrx_thom_range() then finds the match
+ *	with the leftmost beginning in that run. Matches that pass req at a
+ *	later occurrence begin after lit, so the first match found is the one
+ *	that matching the whole string would have found.
+ */
+static int inner(const wregex_t *nfa, const char *str, const char *lit, wregmatch_t subm[], int nsm) {
+	const char *beg;
+	int rv;
+
+	for(; lit; lit = wrx_find_req(nfa, lit + 1)) {
+		for(beg = lit; beg > str && BV_TST(nfa->req_pre, (unsigned char)beg[-1]); beg--)
+			;
+		rv = wrx_thom_range(nfa, str, beg, lit, subm, nsm);
+		if(rv != WRX_NOMATCH)
+			return rv;
+	}
+	return WRX_NOMATCH;
+}
+
+/*
+ *	Matches an NFA that ends with '$' by searching back from the ends of the
+ *	lines, in order, with nfa->rev. A match can't span more than one line,
+ *	so the first line with a match has the leftmost one, and it begins at
+ *	the leftmost position from which the reverse NFA reaches its end. Most
+ *	lines are rejected after a few bytes. wrx_thom_at() then finds the
+ *	submatches from there.
+ */
+static int backward(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const char *lim, *end, *beg;
+	short *work;
+
+	work = calloc(6 * nfa->rev->ns, sizeof *work);
+	if(!work) return WRX_MEMORY;
+
+	for(lim = str; ; lim = end + 1) {
+		end = strpbrk(lim, "\r\n");
+		if(!end)
+			end = lim + strlen(lim);
+		beg = wrx_rev_start(nfa->rev, str, end, lim, work);
+		if(beg || !end[0])
+			break;
+	}
+	free(work);
+
+	if(!beg)
+		return WRX_NOMATCH;
+	return wrx_thom_at(nfa, str, beg, subm, nsm);
+}
+
+/*
+ *	Matches the string str with the engine that wrx_comp() chose for the NFA
+ */
+int wrx_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const char *lit = NULL;
+	int i, rv;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	/* The submatches are NULL unless a match is found */
+	for(i = 0; i < nsm; i++) {
+		subm[i].beg = NULL;
+		subm[i].end = NULL;
+	}
+
+	/* A string that doesn't contain the required string can't match */
+	if(nfa->req && nfa->engine != WRX_ENG_LITERAL) {
+		lit = wrx_find_req(nfa, str);
+		if(!lit)
+			return WRX_NOMATCH;
+	}
+
+	if(nfa->engine == WRX_ENG_BACKTRACK || nfa->engine == WRX_ENG_PIKE
+		|| nfa->engine == WRX_ENG_ONEPASS || nfa->engine == WRX_ENG_BITPAR) {
+		/* Searching back from the ends of the lines usually rejects a line
+		after a few bytes, while req may occur many times on every line.
+		The same goes for skipping over the string with nfa->bndm */
+		if(nfa->rev)
+			return backward(nfa, str, subm, nsm);
+		if(nfa->req_pre && !nfa->bndm)
+			return inner(nfa, str, lit, subm, nsm);
+	}
+
+	switch(nfa->engine) {
+	case WRX_ENG_LITERAL:
+		if(nfa->lit)
+			return literal(nfa, str, subm, nsm);
+		break;
+	case WRX_ENG_BITPAR:
+		/* The bit-parallel matcher only tells whether there is a match.
+		wrx_comp() built it, unless it ran out of memory */
+		if(nsm > 0)
+			break;
+		if(nfa->bitpar)
+			return wrx_bitpar_exec(nfa->bitpar, str, NULL);
+		break;
+	case WRX_ENG_DFA: return wrx_dfa_match(nfa, str, subm, nsm);
+	case WRX_ENG_TDFA: return wrx_tdfa_exec(nfa, str, subm, nsm);
+	case WRX_ENG_ONEPASS: return wrx_onepass(nfa, str, subm, nsm);
+	case WRX_ENG_FIXED: return wrx_fixed(nfa, str, subm, nsm);
+	case WRX_ENG_JIT: return wrx_jit_exec(nfa, str, subm, nsm);
+	case WRX_ENG_PIKE: return wrx_thom(nfa, str, subm, nsm);
+	}
+
+	/* Back references can only be matched by backtracking */
+	if(wrx_has_bref(nfa))
+		return backtrack(nfa, str, subm, nsm, 0);
+
+	/*
+	 *	The backtracker is usually faster than wrx_thom(), but some patterns
+	 *	make it try the same states over and over for some strings. Its
+	 *	bitmap prevents that, but a string can be too long for the bitmap.
+	 *	The backtracker then gives up once it takes more steps than
+	 *	wrx_thom() would, and the string is matched with wrx_thom(). So is
+	 *	a string for which a loop like ".*" takes more alternatives than the
+	 *	stack holds. Later calls start with the backtracker again.
+	 */
+	rv = backtrack(nfa, str, subm, nsm, wrx_max_steps(nfa, str));
+	if(rv == GAVE_UP || rv == WRX_STACK)
+		rv = wrx_thom(nfa, str, subm, nsm);
+	return rv;
 }
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	The matcher for patterns whose matches all have the same length.
+ *
+ *	wrx_comp() stores the set of bytes that each position of the match
+ *	accepts. A match starts at the first position in the string where every
+ *	byte of the following len bytes is in its set and the assertions hold,
+ *	so there is nothing to choose and nothing to backtrack to.
+ *
+ *	Where SSE2 or AVX2 is available, VEC_WIDTH starting positions are tried
+ *	at once: For each position of the match, the bytes at that offset from
+ *	the starting positions are loaded into a vector and tested against the
+ *	ranges of bytes that the position accepts, giving a mask of the starting
+ *	positions that are still possible. The positions that accept the fewest
+ *	bytes are tested first, so most blocks are ruled out after a test or two.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define VEC_WIDTH		32
+typedef __m256i vec;
+#	define VEC_LOAD(p)		_mm256_loadu_si256((const __m256i *)(p))
+#	define VEC_SET1(c)		_mm256_set1_epi8((char)(c))
+#	define VEC_ZERO()		_mm256_setzero_si256()
+#	define VEC_SUB(a, b)	_mm256_sub_epi8(a, b)
+#	define VEC_MIN(a, b)	_mm256_min_epu8(a, b)
+#	define VEC_EQ(a, b)		_mm256_cmpeq_epi8(a, b)
+#	define VEC_OR(a, b)		_mm256_or_si256(a, b)
+#	define VEC_MASK(a)		(unsigned int)_mm256_movemask_epi8(a)
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
+#	define VEC_WIDTH		16
+typedef __m128i vec;
+#	define VEC_LOAD(p)		_mm_loadu_si128((const __m128i *)(p))
+#	define VEC_SET1(c)		_mm_set1_epi8((char)(c))
+#	define VEC_ZERO()		_mm_setzero_si128()
+#	define VEC_SUB(a, b)	_mm_sub_epi8(a, b)
+#	define VEC_MIN(a, b)	_mm_min_epu8(a, b)
+#	define VEC_EQ(a, b)		_mm_cmpeq_epi8(a, b)
+#	define VEC_OR(a, b)		_mm_or_si128(a, b)
+#	define VEC_MASK(a)		(unsigned int)_mm_movemask_epi8(a)
+#endif
+
+/*
+ *	Tests the zero-width assertions ('^', '$', '<', '>' and "\b") at
+ *	position cp in the string.
+ */
+static int check(char op, const char *str, const char *cp) {
+	switch(op) {
+	case BOL: return cp == str || cp[-1] == '\r' || cp[-1] == '\n';
+	case EOL: return cp[0] == '\r' || cp[0] == '\n' || cp[0] == '\0';
+	case BOW:
+		if(cp == str)
+			return IS_WORD(cp[0]);
+		return IS_WORD(cp[0]) && !IS_WORD(cp[-1]);
+	case EOW: return cp > str && IS_WORD(cp[-1]) && !IS_WORD(cp[0]);
+	case BND:
+		if(cp == str)
+			return IS_WORD(cp[0]);
+		return !IS_WORD(cp[0]) != !IS_WORD(cp[-1]);
+	}
+	assert(0);
+	return 0;
+}
+
+/*
+ *	Do the assertions hold for a match that starts at beg?
+ */
+static int passes(const wregex_t *nfa, const char *str, const char *beg) {
+	const struct _wrx_fixed *fx = nfa->fixed;
+	char op;
+	int i;
+
+	for(i = 0; i < fx->nop; i++) {
+		op = nfa->states[fx->ops[2 * i]].op;
+		if(op != REC && op != STP && !check(op, str, beg + fx->ops[2 * i + 1]))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ *	Does every byte from beg onwards fall in its position's set?
+ */
+static int accepts(const struct _wrx_fixed *fx, const char *beg) {
+	unsigned char c;
+	int i, k;
+
+	for(i = 0; i < fx->len; i++) {
+		k = fx->order[i];
+		c = beg[k];
+		if(!BV_TST(fx->cls[k], c))
+			return 0;
+	}
+	return 1;
+}
+
+#ifdef VEC_WIDTH
+/*
+ *	Returns a mask of the VEC_WIDTH starting positions from beg onwards at
+ *	which every byte falls in its position's ranges
+ */
+static unsigned int accepts_vec(const struct _wrx_fixed *fx, const char *beg) {
+	vec x, d, in;
+	unsigned int mask = ~0u;
+	int i, j, k;
+
+	for(i = 0; i < fx->len && mask; i++) {
+		k = fx->order[i];
+		x = VEC_LOAD(beg + k);
+		in = VEC_ZERO();
+		for(j = 0; j < fx->nr[k]; j++) {
+			/* lo <= x <= hi is tested as x - lo <= hi - lo, unsigned */
+			d = VEC_SUB(x, VEC_SET1(fx->lo[k][j]));
+			in = VEC_OR(in, VEC_EQ(VEC_MIN(d, VEC_SET1(fx->hi[k][j] - fx->lo[k][j])), d));
+		}
+		mask &= VEC_MASK(in);
+	}
+	return mask;
+}
+#endif
+
+int wrx_fixed(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const struct _wrx_fixed *fx;
+	const wrx_state *sp;
+	const char *beg = NULL;
+	size_t n, s, last;
+	int i, idx;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	/* The submatches are NULL unless a match is found */
+	for(i = 0; i < nsm; i++) {
+		subm[i].beg = NULL;
+		subm[i].end = NULL;
+	}
+
+	fx = nfa->fixed;
+	if(!fx)
+		return wrx_thom(nfa, str, subm, nsm);
+
+	/* The bytes past the end of the string are never read */
+	n = strlen(str);
+	if(n < (size_t)fx->len)
+		return WRX_NOMATCH;
+	last = n - fx->len;
+
+	s = 0;
+#ifdef VEC_WIDTH
+	if(fx->ranges) {
+		unsigned int mask;
+		for(; s + VEC_WIDTH - 1 <= last; s += VEC_WIDTH) {
+			for(mask = accepts_vec(fx, str + s); mask; mask &= mask - 1) {
+				i = __builtin_ctz(mask);
+				if(passes(nfa, str, str + s + i)) {
+					beg = str + s + i;
+					goto found;
+				}
+			}
+		}
+	}
+#endif
+	for(; s <= last; s++)
+		if(accepts(fx, str + s) && passes(nfa, str, str + s)) {
+			beg = str + s;
+			goto found;
+		}
+
+	return WRX_NOMATCH;
+
+found:
+	/* The REC and STP states are in the order in which the match passes them */
+	for(i = 0; i < fx->nop; i++) {
+		sp = &nfa->states[fx->ops[2 * i]];
+		if(sp->op != REC && sp->op != STP)
+			continue;
+		idx = sp->data.idx;
+		if(idx >= nsm)
+			continue;
+		if(sp->op == REC)
+			subm[idx].beg = beg + fx->ops[2 * i + 1];
+		else
+			subm[idx].end = beg + fx->ops[2 * i + 1];
+	}
+	return WRX_MATCH;
+}
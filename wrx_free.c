@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include "wregex.h"
 #include "wrxcfg.h"
+#include "wrx_pre.h"
 
 /*
  *	Deallocates an NFA
@@ -38,6 +39,25 @@ void wrx_free(wregex_t *nfa) {
 		if(nfa->states[i].op == SET)
 			free(nfa->states[i].data.bv);
 
+	free(nfa->dfa);
+	free(nfa->rdfa);
+	free(nfa->tdfa);
+	free(nfa->onepass);
+	free(nfa->lit);
+	free(nfa->fixed);
+	free(nfa->first);
+	free(nfa->lits);
+	free(nfa->bndm);
+	free(nfa->loop);
+	free(nfa->req);
+	free(nfa->req_pre);
+	if(nfa->rev) {
+		/* The reverse NFA shares the character sets */
+		free(nfa->rev->states);
+		free(nfa->rev);
+	}
+	wrx_bitpar_free(nfa->bitpar);
+	wrx_jit_free(nfa->jit);
 	free(nfa->p);
 	free(nfa->states);
 	free(nfa);
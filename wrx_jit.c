@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	A JIT compiler that translates the NFA to x86-64 machine code.
+ *
+ *	Every state becomes a piece of code that is entered with the current
+ *	position in the string in rbx, and returns 1 in eax if a match was
+ *	found from there or 0 if not. The states that consume a character
+ *	compare it inline and jump to the next state. A CHC calls the code of
+ *	its first choice and if that returns 0, jumps to its second choice, so
+ *	the machine stack takes the place of wrx_exec()'s backtracking stack.
+ *	REC and STP store the position in the array of submatch pointers and
+ *	call the next state, restoring the old pointer if that fails.
+ *
+ *	The code follows the same policy as wrx_exec()'s backtracker: Every CHC
+ *	marks itself at the current position in the bitmap from wrx_new_memo()
+ *	and fails straight away if it was there before, so the code takes time
+ *	linear in the length of the string. The bitmap is only set up once the
+ *	code has taken BACKTRACK_MEMO_STEPS steps; until then, and if it can't
+ *	be set up, every CHC counts down a budget of steps. The code runs on a
+ *	stack allocated for the call and sized to the string, up to JIT_STACK
+ *	bytes, rather than on whatever is left of the thread's stack, and its
+ *	depth is checked too. If either runs out the code returns 2, and the
+ *	string is matched with wrx_thom() instead.
+ *
+ *	The registers used by the generated code are:
+ *		rbx - The current position in the string
+ *		r12 - The beginning of the string
+ *		r13 - The array of submatch pointers
+ *		r14 - The number of steps left
+ *		r15 - The lowest address the stack may grow to
+ *		r8  - The bitmap, or NULL
+ *		rbp - The caller's stack pointer
+ */
+
+/* MAP_ANONYMOUS isn't POSIX, so glibc hides it under -std=c99 */
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <limits.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#	include <sys/mman.h>
+#	ifdef MAP_ANONYMOUS
+#		define HAVE_JIT
+#	endif
+#endif
+
+#ifdef HAVE_JIT
+
+/* What the generated code needs for a call, other than the string. The
+entry point depends on the order of the fields */
+typedef struct {
+	long steps;		/* The number of steps left */
+	char *lo;		/* The lowest address the stack may grow to */
+	char *top;		/* The top of the stack */
+} jit_run;
+
+/* The signature of the generated code's entry point */
+typedef int (*jit_fn)(const char *str, const char *cp, const char **cap, jit_run *run, unsigned char *memo);
+
+/* The bytes at the bottom of the stack that the code leaves to signal
+handlers */
+#define STACK_SLACK	8192
+
+struct _wrx_jit {
+	void *mem;		/* The mmap()'ed pages */
+	size_t size;
+	jit_fn fn;
+};
+
+/*
+ *	Internal data used while generating the code
+ */
+typedef struct {
+	unsigned char *code;	/* The code is written here, or NULL to count it */
+	size_t n, size;
+
+	int *at;		/* The offset of each state's code */
+
+	/* The rel32 operands that refer to states, patched once all the
+	states' offsets are known */
+	size_t *fix;
+	short *fix_st;
+	int nfix;
+
+	/* Offsets of the shared pieces of code and data */
+	size_t word, sets, ret0, ret, gave_up;
+} jit_data;
+
+/*
+ *	The code is generated twice: First with jd->code NULL, to count the
+ *	bytes, and then into pages of that size.
+ */
+static void emit(jit_data *jd, const char *bytes, int n) {
+	if(jd->code) {
+		assert(jd->n + n <= jd->size);
+		memcpy(jd->code + jd->n, bytes, n);
+	}
+	jd->n += n;
+}
+
+static void emit8(jit_data *jd, int v) {
+	char c = v;
+	emit(jd, &c, 1);
+}
+
+static void emit32(jit_data *jd, long v) {
+	unsigned long u = (unsigned long)v;
+	char b[4];
+	b[0] = u & 0xFF;
+	b[1] = (u >> 8) & 0xFF;
+	b[2] = (u >> 16) & 0xFF;
+	b[3] = (u >> 24) & 0xFF;
+	emit(jd, b, 4);
+}
+
+/* Emits the opcode of a jump or call followed by the rel32 to the offset to */
+static void emit_rel(jit_data *jd, const char *op, int n, size_t to) {
+	emit(jd, op, n);
+	emit32(jd, (long)to - (long)(jd->n + 4));
+}
+
+/* Emits the opcode of a jump or call to the state st, patched later */
+static void emit_to_state(jit_data *jd, const char *op, int n, short st) {
+	if(st < 0) {
+		/* A state that can't be reached anyway */
+		emit_rel(jd, op, n, jd->ret0);
+		return;
+	}
+	emit(jd, op, n);
+	jd->fix[jd->nfix] = jd->n;
+	jd->fix_st[jd->nfix++] = st;
+	emit32(jd, 0);
+}
+
+#define JE(jd, to)		emit_rel(jd, "\x0F\x84", 2, to)
+#define JNE(jd, to)		emit_rel(jd, "\x0F\x85", 2, to)
+#define JB(jd, to)		emit_rel(jd, "\x0F\x82", 2, to)
+#define JA(jd, to)		emit_rel(jd, "\x0F\x87", 2, to)
+#define JAE(jd, to)		emit_rel(jd, "\x0F\x83", 2, to)
+
+/* lea rdx, [rip + the offset to] */
+static void lea_rdx(jit_data *jd, size_t to) {
+	emit_rel(jd, "\x48\x8D\x15", 3, to);
+}
+
+/*
+ *	Generates the code of the state st
+ */
+static void gen_state(jit_data *jd, const wregex_t *nfa, short st, int *nset) {
+	const wrx_state *sp = &nfa->states[st];
+	unsigned char c;
+	long slot;
+
+	jd->at[st] = jd->n;
+
+	switch(sp->op) {
+	case MTC:
+		emit(jd, "\x80\x3B", 2);	/* cmp byte [rbx], c */
+		emit8(jd, (unsigned char)sp->data.c);
+		JNE(jd, jd->ret0);
+		emit(jd, "\x48\xFF\xC3", 3);	/* inc rbx */
+		break;
+	case MCI:
+		c = (unsigned char)sp->data.c;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		emit(jd, "\x0F\xB6\x03", 3);	/* movzx eax, byte [rbx] */
+		emit(jd, "\x8D\x50\xBF", 3);	/* lea edx, [rax - 'A'] */
+		emit(jd, "\x83\xFA\x19", 3);	/* cmp edx, 25 */
+		emit(jd, "\x77\x03", 2);		/* ja +3 */
+		emit(jd, "\x83\xC0\x20", 3);	/* add eax, 32 */
+		emit(jd, "\x3D", 1);			/* cmp eax, c */
+		emit32(jd, c);
+		JNE(jd, jd->ret0);
+		emit(jd, "\x48\xFF\xC3", 3);	/* inc rbx */
+		break;
+	case SET:
+		/* The bit vector was copied to the data before the code */
+		emit(jd, "\x0F\xB6\x03", 3);	/* movzx eax, byte [rbx] */
+		emit(jd, "\x83\xF8\x7F", 3);	/* cmp eax, 127 */
+		JA(jd, jd->ret0);
+		lea_rdx(jd, jd->sets + 16 * (*nset)++);
+		emit(jd, "\x0F\xA3\x02", 3);	/* bt [rdx], eax */
+		JAE(jd, jd->ret0);
+		emit(jd, "\x48\xFF\xC3", 3);	/* inc rbx */
+		break;
+	case CHC:
+		/* Fail if the bit for this state at this position is set, and set it */
+		emit(jd, "\x4D\x85\xC0", 3);	/* test r8, r8 */
+		emit(jd, "\x74\x1D", 2);		/* je +29 */
+		emit(jd, "\x48\x89\xD8", 3);	/* mov rax, rbx */
+		emit(jd, "\x4C\x29\xE0", 3);	/* sub rax, r12 */
+		emit(jd, "\x48\x69\xC0", 3);	/* imul rax, rax, ns */
+		emit32(jd, nfa->ns);
+		emit(jd, "\x48\x05", 2);		/* add rax, st */
+		emit32(jd, st);
+		emit(jd, "\x49\x0F\xAB\x00", 4);	/* bts [r8], rax */
+		JB(jd, jd->ret0);
+		emit(jd, "\x49\xFF\xCE", 3);	/* dec r14 */
+		JE(jd, jd->gave_up);
+		emit(jd, "\x4C\x39\xFC", 3);	/* cmp rsp, r15 */
+		JB(jd, jd->gave_up);
+		emit(jd, "\x53", 1);			/* push rbx */
+		emit_to_state(jd, "\xE8", 1, sp->s[0]);	/* call s[0] */
+		emit(jd, "\x5B", 1);			/* pop rbx */
+		emit(jd, "\x85\xC0", 2);		/* test eax, eax */
+		JNE(jd, jd->ret);
+		emit_to_state(jd, "\xE9", 1, sp->s[1]);	/* jmp s[1] */
+		return;
+	case REC:
+	case STP:
+		slot = 8 * (2 * sp->data.idx + (sp->op == STP));
+		emit(jd, "\x4C\x39\xFC", 3);	/* cmp rsp, r15 */
+		JB(jd, jd->gave_up);
+		emit(jd, "\x41\xFF\xB5", 3);	/* push qword [r13 + slot] */
+		emit32(jd, slot);
+		emit(jd, "\x49\x89\x9D", 3);	/* mov [r13 + slot], rbx */
+		emit32(jd, slot);
+		emit_to_state(jd, "\xE8", 1, sp->s[0]);	/* call s[0] */
+		emit(jd, "\x5A", 1);			/* pop rdx */
+		emit(jd, "\x85\xC0", 2);		/* test eax, eax */
+		JNE(jd, jd->ret);
+		emit(jd, "\x49\x89\x95", 3);	/* mov [r13 + slot], rdx */
+		emit32(jd, slot);
+		emit(jd, "\xC3", 1);			/* ret */
+		return;
+	case MOV:
+		break;
+	case EOM:
+	case MEV:
+		emit(jd, "\xB8\x01\x00\x00\x00\xC3", 6);	/* mov eax, 1; ret */
+		return;
+	case BOL:
+		emit(jd, "\x4C\x39\xE3", 3);	/* cmp rbx, r12 */
+		emit_to_state(jd, "\x0F\x84", 2, sp->s[0]);
+		emit(jd, "\x0F\xB6\x43\xFF", 4);	/* movzx eax, byte [rbx - 1] */
+		emit(jd, "\x83\xF8\x0D", 3);	/* cmp eax, '\r' */
+		emit_to_state(jd, "\x0F\x84", 2, sp->s[0]);
+		emit(jd, "\x83\xF8\x0A", 3);	/* cmp eax, '\n' */
+		JNE(jd, jd->ret0);
+		break;
+	case EOL:
+		emit(jd, "\x0F\xB6\x03", 3);	/* movzx eax, byte [rbx] */
+		emit(jd, "\x85\xC0", 2);		/* test eax, eax */
+		emit_to_state(jd, "\x0F\x84", 2, sp->s[0]);
+		emit(jd, "\x83\xF8\x0D", 3);	/* cmp eax, '\r' */
+		emit_to_state(jd, "\x0F\x84", 2, sp->s[0]);
+		emit(jd, "\x83\xF8\x0A", 3);	/* cmp eax, '\n' */
+		JNE(jd, jd->ret0);
+		break;
+	case BOW:
+	case EOW:
+	case BND:
+		/* ecx is set if the next character is a word character, and esi
+		if the previous one is */
+		lea_rdx(jd, jd->word);
+		emit(jd, "\x0F\xB6\x03", 3);	/* movzx eax, byte [rbx] */
+		emit(jd, "\x0F\xB6\x0C\x02", 4);	/* movzx ecx, byte [rdx + rax] */
+		emit(jd, "\x31\xF6", 2);		/* xor esi, esi */
+		emit(jd, "\x4C\x39\xE3", 3);	/* cmp rbx, r12 */
+		emit(jd, "\x74\x08", 2);		/* je +8 */
+		emit(jd, "\x0F\xB6\x43\xFF", 4);	/* movzx eax, byte [rbx - 1] */
+		emit(jd, "\x0F\xB6\x34\x02", 4);	/* movzx esi, byte [rdx + rax] */
+		if(sp->op == BOW) {
+			emit(jd, "\x85\xC9", 2);	/* test ecx, ecx */
+			JE(jd, jd->ret0);
+			emit(jd, "\x85\xF6", 2);	/* test esi, esi */
+			JNE(jd, jd->ret0);
+		} else if(sp->op == EOW) {
+			emit(jd, "\x85\xF6", 2);	/* test esi, esi */
+			JE(jd, jd->ret0);
+			emit(jd, "\x85\xC9", 2);	/* test ecx, ecx */
+			JNE(jd, jd->ret0);
+		} else {
+			emit(jd, "\x39\xF1", 2);	/* cmp ecx, esi */
+			JE(jd, jd->ret0);
+		}
+		break;
+	default:
+		assert(0);
+	}
+
+	emit_to_state(jd, "\xE9", 1, sp->s[0]);	/* jmp s[0] */
+}
+
+/*
+ *	Generates the data and the code, and returns the offset of the entry
+ *	point
+ */
+static size_t generate(jit_data *jd, const wregex_t *nfa) {
+	size_t entry;
+	int i, nset = 0;
+	short st;
+
+	jd->n = 0;
+	jd->nfix = 0;
+
+	/* The data (the word characters and the sets) comes before the code */
+	jd->word = jd->n;
+	for(i = 0; i < 256; i++)
+		emit8(jd, IS_WORD(i) != 0);
+
+	jd->sets = jd->n;
+	for(i = 0; i < nfa->ns; i++)
+		if(nfa->states[i].op == SET)
+			emit(jd, nfa->states[i].data.bv, 16);
+
+	/*
+	 *	The entry point: Saves the registers that the generated code uses,
+	 *	loads them from the arguments and the jit_run, switches to the
+	 *	stack in the jit_run, calls the start state, switches back and
+	 *	stores the number of steps left in the jit_run.
+	 */
+	entry = jd->n;
+	emit(jd, "\x53\x41\x54\x41\x55\x41\x56\x41\x57\x55", 10);	/* push rbx, r12, r13, r14, r15, rbp */
+	emit(jd, "\x51", 1);				/* push rcx */
+	emit(jd, "\x48\x89\xE5", 3);		/* mov rbp, rsp */
+	emit(jd, "\x49\x89\xFC", 3);		/* mov r12, rdi */
+	emit(jd, "\x48\x89\xF3", 3);		/* mov rbx, rsi */
+	emit(jd, "\x49\x89\xD5", 3);		/* mov r13, rdx */
+	emit(jd, "\x4C\x8B\x31", 3);		/* mov r14, [rcx] (steps) */
+	emit(jd, "\x4C\x8B\x79\x08", 4);	/* mov r15, [rcx + 8] (lo) */
+	emit(jd, "\x48\x8B\x61\x10", 4);	/* mov rsp, [rcx + 16] (top) */
+	emit_to_state(jd, "\xE8", 1, nfa->start);	/* call start */
+	emit(jd, "\x48\x89\xEC", 3);		/* mov rsp, rbp */
+	emit(jd, "\x59", 1);				/* pop rcx */
+	emit(jd, "\x4C\x89\x31", 3);		/* mov [rcx], r14 */
+	emit(jd, "\x5D\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5B", 10);	/* pop rbp, r15, r14, r13, r12, rbx */
+	emit(jd, "\xC3", 1);				/* ret */
+
+	jd->ret0 = jd->n;
+	emit(jd, "\x31\xC0", 2);			/* xor eax, eax */
+	jd->ret = jd->n;
+	emit(jd, "\xC3", 1);				/* ret */
+	jd->gave_up = jd->n;
+	emit(jd, "\xB8\x02\x00\x00\x00\xC3", 6);	/* mov eax, 2; ret */
+
+	for(st = 0; st < nfa->ns; st++)
+		gen_state(jd, nfa, st, &nset);
+
+	return entry;
+}
+
+int wrx_jit(wregex_t *nfa) {
+	jit_data jd;
+	struct _wrx_jit *jit;
+	unsigned char *mem;
+	size_t size, entry;
+	int i;
+
+	if(!nfa) return WRX_BAD_NFA;
+	if(nfa->jit) return WRX_SUCCESS;
+
+	/* Back references are left to the backtracker */
+	if(wrx_has_bref(nfa))
+		return WRX_NO_JIT;
+
+	jit = malloc(sizeof *jit);
+	jd.at = malloc(nfa->ns * sizeof *jd.at);
+	jd.fix = malloc((3 * nfa->ns + 1) * sizeof *jd.fix);
+	jd.fix_st = malloc((3 * nfa->ns + 1) * sizeof *jd.fix_st);
+	if(!jit || !jd.at || !jd.fix || !jd.fix_st) {
+		free(jit);
+		free(jd.at);
+		free(jd.fix);
+		free(jd.fix_st);
+		return WRX_MEMORY;
+	}
+
+	/* Count the bytes, and then generate them into pages of that size */
+	jd.code = NULL;
+	generate(&jd, nfa);
+	size = jd.n;
+
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED) {
+		free(jit);
+		free(jd.at);
+		free(jd.fix);
+		free(jd.fix_st);
+		return WRX_NO_JIT;
+	}
+	jd.code = mem;
+	jd.size = size;
+	entry = generate(&jd, nfa);
+	assert(jd.n == size);
+
+	for(i = 0; i < jd.nfix; i++) {
+		jd.n = jd.fix[i];
+		emit32(&jd, (long)jd.at[jd.fix_st[i]] - (long)(jd.fix[i] + 4));
+	}
+
+	free(jd.at);
+	free(jd.fix);
+	free(jd.fix_st);
+
+	if(mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(mem, size);
+		free(jit);
+		return WRX_NO_JIT;
+	}
+
+	jit->mem = mem;
+	jit->size = size;
+	/* ISO C doesn't allow a cast from void * to a function pointer */
+	mem += entry;
+	memcpy(&jit->fn, &mem, sizeof jit->fn);
+
+	nfa->jit = jit;
+	if(nfa->engine != WRX_ENG_LITERAL)
+		nfa->engine = WRX_ENG_JIT;
+
+	return WRX_SUCCESS;
+}
+
+int wrx_jit_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const char **cap, *cp;
+	char *stack;
+	unsigned char *memo = NULL, mbuf[256];
+	size_t len, size;
+	jit_run run;
+	int i, want, rv = 0;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	if(!nfa->jit)
+		return wrx_backtrack(nfa, str, subm, nsm);
+
+	/*
+	 *	Each CHC and each REC or STP takes 16 bytes of stack, and with the
+	 *	bitmap each CHC is entered once per position, so this is more than
+	 *	the code can use, unless JIT_STACK is less.
+	 */
+	len = strlen(str);
+	if(len + 1 < (JIT_STACK - STACK_SLACK) / 16 / nfa->ns)
+		size = STACK_SLACK + 16 * (len + 1) * nfa->ns;
+	else
+		size = JIT_STACK;
+
+	cap = calloc(2 * nfa->n_subm, sizeof *cap);
+	stack = malloc(size);
+	if(!cap || !stack) {
+		free(cap);
+		free(stack);
+		return WRX_MEMORY;
+	}
+	run.lo = stack + STACK_SLACK;
+	run.top = stack + size;
+
+	/* The same policy as wrx_exec()'s backtracker: The bitmap is set up
+	after a few steps, and until then, or if it can't be, the steps are
+	limited */
+	want = nfa->memo_max > 0;
+	run.steps = want ? BACKTRACK_MEMO_STEPS : wrx_max_steps(nfa, str);
+
+	/* As with wrx_exec(), a match may start at any character in the
+	string, but only starts at the terminating '\0' if the string is empty */
+	for(cp = str; !rv && cp; cp = wrx_retry(nfa, cp)) {
+		if((nfa->first || nfa->bol) && cp[0] && !(cp = wrx_next_start(nfa, str, cp)))
+			break;
+		rv = nfa->jit->fn(str, cp, cap, &run, memo);
+		if(rv == 2 && want && run.steps == 0) {
+			/* Set up the bitmap, and try this position again */
+			want = 0;
+			memo = wrx_new_memo(nfa, str, mbuf, sizeof mbuf);
+			run.steps = memo ? LONG_MAX : wrx_max_steps(nfa, str);
+			for(i = 0; i < 2 * nfa->n_subm; i++)
+				cap[i] = NULL;
+			rv = nfa->jit->fn(str, cp, cap, &run, memo);
+		}
+	}
+
+	for(i = 0; i < nsm; i++) {
+		subm[i].beg = rv == 1 && i < nfa->n_subm ? cap[2 * i] : NULL;
+		subm[i].end = rv == 1 && i < nfa->n_subm ? cap[2 * i + 1] : NULL;
+	}
+	if(memo != mbuf)
+		free(memo);
+	free(cap);
+	free(stack);
+
+	/* The code ran out of steps or stack */
+	if(rv == 2)
+		return wrx_thom(nfa, str, subm, nsm);
+
+	return rv ? WRX_MATCH : WRX_NOMATCH;
+}
+
+void wrx_jit_free(struct _wrx_jit *jit) {
+	if(!jit) return;
+	munmap(jit->mem, jit->size);
+	free(jit);
+}
+
+#else /* HAVE_JIT */
+
+int wrx_jit(wregex_t *nfa) {
+	if(!nfa) return WRX_BAD_NFA;
+	return WRX_NO_JIT;
+}
+
+int wrx_jit_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	return wrx_backtrack(nfa, str, subm, nsm);
+}
+
+void wrx_jit_free(struct _wrx_jit *jit) {
+	assert(!jit);
+}
+
+#endif /* HAVE_JIT */
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	A DFA that is built lazily, while the input is being matched.
+ *
+ *	A DFA state and its transition are only computed the first time they
+ *	are needed; after that the transition is a table lookup. The states are
+ *	kept in a cache of a fixed size. When the cache is full it is flushed
+ *	and the states that are needed are computed again. If that happens so
+ *	often that the DFA doesn't get much work done between flushes, the
+ *	string is rather matched with wrx_thom().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+
+/* Rounds a size up so that the next state in the cache is aligned */
+#define ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/*
+ *	A state in the cache. The transitions and the list of NFA states follow
+ *	the structure in memory.
+ */
+typedef struct _lstate {
+	struct _lstate *hnext;	/* Next state in the same hash bucket */
+	struct _lstate **next;	/* Transition for each byte class, NULL if not computed */
+	short *list;	/* The NFA states */
+	short n;		/* Number of NFA states */
+	unsigned char flags;	/* DS_* flags */
+} lstate;
+
+struct _wrx_lazy {
+	const wregex_t *nfa;
+	int nfa_only;	/* The NFA has back references */
+	wrx_subset ss;
+
+	char *mem;		/* The cache */
+	size_t size, used;
+
+	lstate **hash;	/* Hash table of the states in the cache */
+	unsigned int nhash;
+	int nstates;
+
+	lstate *start;	/* The start state, NULL if it is not in the cache */
+
+	short *buf;		/* The NFA states of the state being computed */
+
+	unsigned long hits, misses, flushes;
+};
+
+/*
+ *	Finds the state with the NFA states list[0..n-1] and flags in the cache,
+ *	or adds it if it isn't there.
+ *	Returns NULL if the cache is full.
+ */
+static lstate *find_state(wrx_lazy *dfa, const short *list, int n, int flags) {
+	unsigned int h = 2166136261u;
+	lstate *s;
+	size_t sz;
+	int i;
+
+	h = (h ^ flags) * 16777619u;
+	for(i = 0; i < n; i++)
+		h = (h ^ (unsigned short)list[i]) * 16777619u;
+	h &= dfa->nhash - 1;
+
+	for(s = dfa->hash[h]; s; s = s->hnext)
+		if(s->flags == flags && s->n == n && !memcmp(s->list, list, n * sizeof *list))
+			return s;
+
+	sz = ALIGN(sizeof *s + dfa->ss.nclass * sizeof *s->next + n * sizeof *list);
+	if(dfa->used + sz > dfa->size)
+		return NULL;
+
+	s = (lstate *)(dfa->mem + dfa->used);
+	dfa->used += sz;
+
+	s->next = (lstate **)(s + 1);
+	for(i = 0; i < dfa->ss.nclass; i++)
+		s->next[i] = NULL;
+	s->list = (short *)(s->next + dfa->ss.nclass);
+	memcpy(s->list, list, n * sizeof *list);
+	s->n = n;
+	s->flags = flags;
+
+	s->hnext = dfa->hash[h];
+	dfa->hash[h] = s;
+	dfa->nstates++;
+
+	return s;
+}
+
+/*
+ *	Empties the cache
+ */
+static void flush(wrx_lazy *dfa) {
+	memset(dfa->hash, 0, dfa->nhash * sizeof *dfa->hash);
+	dfa->used = 0;
+	dfa->nstates = 0;
+	dfa->start = NULL;
+	dfa->flushes++;
+}
+
+wrx_lazy *wrx_lazy_new(const wregex_t *nfa, size_t max_mem) {
+	wrx_lazy *dfa;
+
+	if(!nfa) return NULL;
+
+	dfa = calloc(1, sizeof *dfa);
+	if(!dfa) return NULL;
+
+	dfa->nfa = nfa;
+	if(wrx_has_bref(nfa)) {
+		dfa->nfa_only = 1;
+		return dfa;
+	}
+
+	if(wrx_subset_init(&dfa->ss, nfa) != WRX_SUCCESS) {
+		free(dfa);
+		return NULL;
+	}
+
+	if(!max_mem)
+		max_mem = LAZY_DFA_MEM;
+
+	/* A sixteenth of the memory goes to the hash table */
+	for(dfa->nhash = 16; dfa->nhash * sizeof *dfa->hash < max_mem / 16; dfa->nhash <<= 1);
+	dfa->size = max_mem > dfa->nhash * sizeof *dfa->hash ? max_mem - dfa->nhash * sizeof *dfa->hash : 0;
+
+	dfa->hash = calloc(dfa->nhash, sizeof *dfa->hash);
+	dfa->mem = malloc(dfa->size ? dfa->size : 1);
+	dfa->buf = malloc(nfa->ns * sizeof *dfa->buf);
+	if(!dfa->hash || !dfa->mem || !dfa->buf) {
+		wrx_lazy_free(dfa);
+		return NULL;
+	}
+
+	return dfa;
+}
+
+int wrx_lazy_exec(wrx_lazy *dfa, const char *str, const char **end) {
+	lstate *s, *ns;
+	const char *cp, *last = NULL, *flushed = NULL;
+	unsigned char c;
+	int k, n, flags;
+
+	if(!dfa) return WRX_BAD_NFA;
+
+	if(dfa->nfa_only)
+		return wrx_nfa_end(dfa->nfa, str, end);
+
+	if(!dfa->start) {
+		dfa->start = find_state(dfa, NULL, 0, CTX_EDGE | DS_LOOP);
+		if(!dfa->start)
+			return wrx_nfa_end(dfa->nfa, str, end); /* The cache is too small */
+	}
+
+	for(s = dfa->start, cp = str; ; cp++) {
+		c = cp[0];
+		k = dfa->ss.cls[c];
+
+		if((ns = s->next[k]) != NULL)
+			dfa->hits++;
+		else {
+			dfa->misses++;
+			flags = wrx_subset_step(&dfa->ss, s->list, s->n, s->flags, k, dfa->buf, &n);
+			ns = find_state(dfa, dfa->buf, n, flags);
+			if(ns)
+				s->next[k] = ns;
+			else {
+				/*
+				 *	The cache is full. If it was already flushed while
+				 *	matching this string and the states in it didn't get us
+				 *	far since then, the DFA is probably building a new state
+				 *	for nearly every character and we are better off with
+				 *	the NFA.
+				 */
+				if(flushed && cp - flushed < 10 * dfa->nstates)
+					return wrx_nfa_end(dfa->nfa, str, end);
+				flush(dfa);
+				flushed = cp;
+				ns = find_state(dfa, dfa->buf, n, flags);
+				if(!ns)
+					return wrx_nfa_end(dfa->nfa, str, end);
+			}
+		}
+		s = ns;
+
+		if(s->flags & DS_MATCH)
+			last = cp;
+
+		/* Stop at the end of the string or if no match is possible anymore */
+		if(!c || (!s->n && !(s->flags & DS_LOOP)))
+			break;
+	}
+
+	if(!last)
+		return WRX_NOMATCH;
+
+	if(end) *end = last;
+	return WRX_MATCH;
+}
+
+void wrx_lazy_stats(const wrx_lazy *dfa, unsigned long *hits, unsigned long *misses, unsigned long *flushes) {
+	if(hits) *hits = dfa->hits;
+	if(misses) *misses = dfa->misses;
+	if(flushes) *flushes = dfa->flushes;
+}
+
+void wrx_lazy_free(wrx_lazy *dfa) {
+	if(!dfa) return;
+	if(!dfa->nfa_only)
+		wrx_subset_done(&dfa->ss);
+	free(dfa->hash);
+	free(dfa->mem);
+	free(dfa->buf);
+	free(dfa);
+}
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	Finds the next occurrence of any of a set of strings, for patterns such
+ *	as "timeout|refused|reset by peer" where every match begins with one of
+ *	a few strings.
+ *
+ *	A single string is found with strstr(). Otherwise an Aho-Corasick
+ *	automaton reads the string one byte at a time, and is in the state of
+ *	the longest prefix of one of the strings that the bytes read so far end
+ *	with, so it notices every occurrence in a single pass.
+ *
+ *	Where SSE2 or AVX2 is available and there are only a few strings, the
+ *	first two bytes of each are compared against VEC_WIDTH positions at
+ *	once, and the positions where one of the pairs occurs are checked with
+ *	the automaton. Blocks of the string without any of the pairs are passed
+ *	over with a handful of instructions.
+ *
+ *	Patterns like "[Ee]rror: [0-9]" begin with a window of positions that
+ *	each accept a single byte or a few bytes. wrx_bndm_find() looks for the
+ *	window with backward nondeterministic DAWG matching (BNDM), the
+ *	bit-parallel form of the Horspool-like skip loop that works for sets of
+ *	bytes: The window is read from its end, and as soon as the bytes read
+ *	can't be part of a match, it is moved past them. Most windows are moved
+ *	by nearly their whole length after reading a byte or two, so only a
+ *	fraction of the string is read.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_pre.h"
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define VEC_WIDTH		32
+typedef __m256i vec;
+#	define VEC_LOAD(p)		_mm256_loadu_si256((const __m256i *)(p))
+#	define VEC_SET1(c)		_mm256_set1_epi8((char)(c))
+#	define VEC_ZERO()		_mm256_setzero_si256()
+#	define VEC_EQ(a, b)		_mm256_cmpeq_epi8(a, b)
+#	define VEC_OR(a, b)		_mm256_or_si256(a, b)
+#	define VEC_AND(a, b)	_mm256_and_si256(a, b)
+#	define VEC_MASK(a)		(unsigned int)_mm256_movemask_epi8(a)
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
+#	define VEC_WIDTH		16
+typedef __m128i vec;
+#	define VEC_LOAD(p)		_mm_loadu_si128((const __m128i *)(p))
+#	define VEC_SET1(c)		_mm_set1_epi8((char)(c))
+#	define VEC_ZERO()		_mm_setzero_si128()
+#	define VEC_EQ(a, b)		_mm_cmpeq_epi8(a, b)
+#	define VEC_OR(a, b)		_mm_or_si128(a, b)
+#	define VEC_AND(a, b)	_mm_and_si128(a, b)
+#	define VEC_MASK(a)		(unsigned int)_mm_movemask_epi8(a)
+#endif
+
+/* The vector instructions look for the '\0' at the end of the string in
+chunks of this many bytes, so that they never read past it */
+#define CHUNK	4096
+
+static int compare(const void *a, const void *b) {
+	return strcmp((const char *)a, (const char *)b);
+}
+
+struct _wrx_lits *wrx_lits_new(char (*str)[LITS_LEN + 1], int n, int ci) {
+	struct _wrx_lits *lt;
+	short *fail = NULL, *queue = NULL, st, t;
+	int i, j, k, c, len, maxst, nclass, head, tail;
+	unsigned char cls[256];
+
+	/* Drop the strings that begin with another one: Their occurrences
+	are found anyway */
+	for(i = 0; i < n; i++)
+		for(j = 0; ci && str[i][j]; j++)
+			str[i][j] = tolower((unsigned char)str[i][j]);
+	qsort(str, n, sizeof *str, compare);
+	for(i = j = 0; i < n; i++)
+		if(j == 0 || strncmp(str[i], str[j - 1], strlen(str[j - 1])))
+			memmove(str[j++], str[i], sizeof *str);
+	n = j;
+
+	memset(cls, 0, sizeof cls);
+	for(i = 0, nclass = 1, maxst = 1; i < n; i++) {
+		for(j = 0; str[i][j]; j++) {
+			c = (unsigned char)str[i][j];
+			if(cls[c])
+				continue;
+			cls[c] = nclass;
+			if(ci)
+				cls[toupper(c)] = nclass;
+			nclass++;
+		}
+		maxst += j;
+	}
+
+	len = n == 1 ? strlen(str[0]) + 1 : 0;
+	lt = calloc(1, sizeof *lt + maxst * nclass * sizeof *lt->delta + 2 * maxst + len);
+	fail = malloc(maxst * sizeof *fail);
+	queue = malloc(maxst * sizeof *queue);
+	if(!lt || !fail || !queue)
+		goto error;
+
+	lt->n = n;
+	lt->ci = ci;
+	lt->nclass = nclass;
+	memcpy(lt->cls, cls, sizeof cls);
+	lt->delta = (short *)(lt + 1);
+	lt->depth = (unsigned char *)(lt->delta + maxst * nclass);
+	lt->end = lt->depth + maxst;
+	if(len) {
+		lt->str = (char *)(lt->end + maxst);
+		memcpy((char *)lt->str, str[0], len);
+	}
+
+	/* The trie of the strings */
+	for(i = 0; i < maxst * nclass; i++)
+		lt->delta[i] = -1;
+	lt->nstates = 1;
+	for(i = 0; i < n; i++) {
+		for(j = 0, st = 0; str[i][j]; j++) {
+			k = st * nclass + cls[(unsigned char)str[i][j]];
+			if(lt->delta[k] < 0) {
+				lt->depth[lt->nstates] = lt->depth[st] + 1;
+				lt->delta[k] = lt->nstates++;
+			}
+			st = lt->delta[k];
+		}
+		lt->end[st] = 2;
+	}
+
+	/* Fill in the missing transitions, a level of the trie at a time, from
+	the state of the longest proper suffix of each state's prefix */
+	head = tail = 0;
+	for(k = 0; k < nclass; k++) {
+		t = lt->delta[k];
+		if(t < 0)
+			lt->delta[k] = 0;
+		else {
+			fail[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+	while(head < tail) {
+		st = queue[head++];
+		if(!lt->end[st] && lt->end[fail[st]])
+			lt->end[st] = 1;
+		for(k = 0; k < nclass; k++) {
+			t = lt->delta[st * nclass + k];
+			if(t < 0)
+				lt->delta[st * nclass + k] = lt->delta[fail[st] * nclass + k];
+			else {
+				fail[t] = lt->delta[fail[st] * nclass + k];
+				queue[tail++] = t;
+			}
+		}
+	}
+
+	/* The pairs of first bytes. Ignoring case is done by setting the 0x20
+	bit, which only works if that is what toupper() changes */
+	if(n <= LITS_PACKED) {
+		for(i = 0; i < n; i++) {
+			for(j = 0; j < lt->npair; j++)
+				if(!memcmp(lt->pair[j], str[i], 2))
+					break;
+			if(j < lt->npair)
+				continue;
+			for(k = 0; k < 2; k++) {
+				c = (unsigned char)str[i][k];
+				lt->pair[j][k] = c;
+				if(ci && toupper(c) != c) {
+					if(toupper(c) != (c ^ 0x20))
+						break;
+					lt->fold[j][k] = 0x20;
+				}
+			}
+			if(k < 2)
+				break;
+			lt->npair++;
+		}
+		if(i < n)
+			lt->npair = 0;
+	}
+
+	free(fail);
+	free(queue);
+	return lt;
+
+error:
+	free(lt);
+	free(fail);
+	free(queue);
+	return NULL;
+}
+
+/*
+ *	Does one of the strings begin at cp? Only follows the transitions that
+ *	lead deeper into the trie.
+ */
+static int starts(const struct _wrx_lits *lt, const char *cp) {
+	int st = 0, t;
+
+	for(;; cp++) {
+		t = lt->delta[st * lt->nclass + lt->cls[(unsigned char)cp[0]]];
+		if(lt->depth[t] != lt->depth[st] + 1)
+			return 0;
+		if(lt->end[t] == 2)
+			return 1;
+		st = t;
+	}
+}
+
+/*
+ *	Runs the automaton from cp. When one of the strings ends, any string
+ *	that begins earlier is still in progress, so the first string begins
+ *	somewhere in the prefix of the state the automaton is in.
+ */
+static const char *scan(const struct _wrx_lits *lt, const char *cp) {
+	const char *beg;
+	int st = 0;
+
+	for(; cp[0]; cp++) {
+		st = lt->delta[st * lt->nclass + lt->cls[(unsigned char)cp[0]]];
+		if(lt->end[st]) {
+			for(beg = cp + 1 - lt->depth[st]; !starts(lt, beg); beg++)
+				;
+			return beg;
+		}
+	}
+	return NULL;
+}
+
+#ifdef VEC_WIDTH
+/*
+ *	Looks for the pairs of first bytes at VEC_WIDTH positions at a time,
+ *	until fewer than VEC_WIDTH + 1 bytes are left in the string. Returns
+ *	the first occurrence of one of the strings, or NULL with *pcp set to
+ *	the position from which the rest of the string has to be searched.
+ */
+static const char *packed(const struct _wrx_lits *lt, const char **pcp) {
+	const char *cp = *pcp, *nul;
+	vec x0, x1, in, pair[LITS_PACKED][2], fold[LITS_PACKED][2];
+	unsigned int mask;
+	size_t n, s;
+	int i;
+
+	for(i = 0; i < lt->npair; i++) {
+		pair[i][0] = VEC_SET1(lt->pair[i][0]);
+		pair[i][1] = VEC_SET1(lt->pair[i][1]);
+		fold[i][0] = VEC_SET1(lt->fold[i][0]);
+		fold[i][1] = VEC_SET1(lt->fold[i][1]);
+	}
+
+	for(;;) {
+		/* memchr() stops reading at the '\0' */
+		nul = memchr(cp, '\0', CHUNK);
+		n = nul ? (size_t)(nul - cp) : CHUNK;
+		if(n < VEC_WIDTH + 1)
+			break;
+		for(s = 0; s + VEC_WIDTH + 1 <= n; s += VEC_WIDTH) {
+			x0 = VEC_LOAD(cp + s);
+			x1 = VEC_LOAD(cp + s + 1);
+			in = VEC_ZERO();
+			for(i = 0; i < lt->npair; i++)
+				in = VEC_OR(in, VEC_AND(VEC_EQ(VEC_OR(x0, fold[i][0]), pair[i][0]),
+					VEC_EQ(VEC_OR(x1, fold[i][1]), pair[i][1])));
+			for(mask = VEC_MASK(in); mask; mask &= mask - 1) {
+				i = __builtin_ctz(mask);
+				if(starts(lt, cp + s + i))
+					return cp + s + i;
+			}
+		}
+		cp += s;
+	}
+	*pcp = cp;
+	return NULL;
+}
+#endif
+
+/*
+ *	Does lit occur at cp, ignoring case? lit is in lower case.
+ */
+static int same_ci(const char *cp, const char *lit) {
+	for(; lit[0] && tolower((unsigned char)cp[0]) == lit[0]; cp++, lit++)
+		;
+	return !lit[0];
+}
+
+#ifdef VEC_WIDTH
+/*
+ *	Looks for lit, ignoring case, by comparing its first and last bytes
+ *	against VEC_WIDTH positions at a time, until fewer than
+ *	VEC_WIDTH + len - 1 bytes are left in the string. Returns the first
+ *	occurrence, or NULL with *pcp set to the position from which the rest
+ *	of the string has to be searched.
+ */
+static const char *first_last(const char *lit, const char **pcp) {
+	const char *cp = *pcp, *nul, *beg;
+	vec first, last, fold0, fold1, in;
+	unsigned int mask;
+	size_t len, n, s;
+	int i, c, fold[2];
+
+	len = strlen(lit);
+	if(len < 2)
+		return NULL;
+
+	/* Ignoring case is done by setting the 0x20 bit, as in packed() */
+	for(i = 0; i < 2; i++) {
+		c = (unsigned char)lit[i ? len - 1 : 0];
+		fold[i] = 0;
+		if(toupper(c) != c) {
+			if(toupper(c) != (c ^ 0x20))
+				return NULL;
+			fold[i] = 0x20;
+		}
+	}
+	first = VEC_SET1(lit[0]);
+	last = VEC_SET1(lit[len - 1]);
+	fold0 = VEC_SET1(fold[0]);
+	fold1 = VEC_SET1(fold[1]);
+
+	for(;;) {
+		nul = memchr(cp, '\0', CHUNK);
+		n = nul ? (size_t)(nul - cp) : CHUNK;
+		if(n < VEC_WIDTH + len - 1)
+			break;
+		for(s = 0; s + VEC_WIDTH + len - 1 <= n; s += VEC_WIDTH) {
+			in = VEC_AND(VEC_EQ(VEC_OR(VEC_LOAD(cp + s), fold0), first),
+				VEC_EQ(VEC_OR(VEC_LOAD(cp + s + len - 1), fold1), last));
+			for(mask = VEC_MASK(in); mask; mask &= mask - 1) {
+				beg = cp + s + __builtin_ctz(mask);
+				if(same_ci(beg + 1, lit + 1))
+					return beg;
+			}
+		}
+		cp += s;
+	}
+	*pcp = cp;
+	return NULL;
+}
+#endif
+
+const char *wrx_strstr(const char *str, const char *lit, int ci) {
+	const char *cp;
+	char set[3];
+
+	/* The C library's strstr() is usually vectorized already */
+	if(!ci)
+		return strstr(str, lit);
+
+#ifdef VEC_WIDTH
+	cp = first_last(lit, &str);
+	if(cp)
+		return cp;
+#endif
+
+	/* Look for either case of the first character, and compare the rest */
+	set[0] = lit[0];
+	set[1] = toupper((unsigned char)lit[0]);
+	set[2] = '\0';
+	for(cp = str; (cp = strpbrk(cp, set)) != NULL; cp++)
+		if(same_ci(cp + 1, lit + 1))
+			return cp;
+	return NULL;
+}
+
+const char *wrx_lits_find(const struct _wrx_lits *lt, const char *cp) {
+	if(lt->str)
+		return wrx_strstr(cp, lt->str, lt->ci);
+#ifdef VEC_WIDTH
+	if(lt->npair) {
+		const char *beg = packed(lt, &cp);
+		if(beg)
+			return beg;
+	}
+#endif
+	return scan(lt, cp);
+}
+
+const char *wrx_bndm_find(const struct _wrx_bndm *bn, const char *cp) {
+	const char *end = cp, *nul = NULL;
+	unsigned long d, hi = 1UL << (bn->m - 1);
+	int j, last;
+
+	for(;;) {
+		/* The string is known to go on up to end. memchr() stops reading
+		at the '\0' */
+		while(!nul && end - cp < bn->m) {
+			nul = memchr(end, '\0', CHUNK);
+			end = nul ? nul : end + CHUNK;
+		}
+		if(end - cp < bn->m)
+			return NULL;
+
+		/*
+		 *	Read the window at cp from right to left. Bit m - 1 - i of d
+		 *	is set while the bytes read so far are accepted by the positions
+		 *	of the window from i onwards, so bit m - 1 is set when they are
+		 *	accepted by its first positions, and the window may begin there.
+		 *	The leftmost such place after cp is where the next window begins.
+		 */
+		last = bn->m;
+		d = ~0UL;
+		for(j = bn->m - 1; d; j--) {
+			d &= bn->mask[(unsigned char)cp[j]];
+			if(d & hi) {
+				if(j == 0)
+					return cp;
+				last = j;
+			}
+			d <<= 1;
+		}
+		cp += last;
+	}
+}
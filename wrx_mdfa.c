@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	A DFA that is compiled in full ahead of time.
+ *
+ *	All the states reachable from the start state are built with the
+ *	subset construction in wrx_dfa.c, after which Hopcroft's algorithm
+ *	merges the states that can't be told apart by any input. The result is
+ *	stored in the wregex_t as a dense table with a row for every state and
+ *	a column for every byte class, so matching a character costs two table
+ *	lookups and a compare.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
+
+/*
+ *	Internal data used while building the DFA
+ */
+typedef struct {
+	wrx_subset ss;
+
+	int max;		/* Maximum number of states */
+	int n, size;	/* Number of states, and the number allocated */
+
+	/* The NFA states of state i are pool[off[i]..off[i]+len[i]-1] */
+	int *off;
+	short *len;
+	unsigned char *flags;
+	short *pool;
+	int npool, spool;
+
+	int *hash;		/* Open addressing hash table of state numbers */
+	unsigned int nhash;
+
+	int *trans;		/* trans[i * nclass + k] is state i's transition on class k */
+} dfa_builder;
+
+/*
+ *	Finds the state with the NFA states list[0..n-1] and flags, or adds it.
+ *	Returns the state's number, -1 if there are too many states or
+ *	-2 if it runs out of memory.
+ */
+static int find_state(dfa_builder *b, const short *list, int n, int flags) {
+	unsigned int h = 2166136261u;
+	int i, j;
+	void *p;
+
+	h = (h ^ flags) * 16777619u;
+	for(i = 0; i < n; i++)
+		h = (h ^ (unsigned short)list[i]) * 16777619u;
+
+	for(h &= b->nhash - 1; (j = b->hash[h]) >= 0; h = (h + 1) & (b->nhash - 1))
+		if(b->flags[j] == flags && b->len[j] == n && !memcmp(b->pool + b->off[j], list, n * sizeof *list))
+			return j;
+
+	if(b->n >= b->max)
+		return -1;
+
+	if(b->n >= b->size) {
+		b->size = b->size * 2 < b->max ? b->size * 2 : b->max;
+		if(!(p = realloc(b->off, b->size * sizeof *b->off))) return -2;
+		b->off = p;
+		if(!(p = realloc(b->len, b->size * sizeof *b->len))) return -2;
+		b->len = p;
+		if(!(p = realloc(b->flags, b->size * sizeof *b->flags))) return -2;
+		b->flags = p;
+		if(!(p = realloc(b->trans, b->size * b->ss.nclass * sizeof *b->trans))) return -2;
+		b->trans = p;
+	}
+
+	while(b->npool + n > b->spool) {
+		b->spool *= 2;
+		if(!(p = realloc(b->pool, b->spool * sizeof *b->pool))) return -2;
+		b->pool = p;
+	}
+
+	j = b->n++;
+	b->off[j] = b->npool;
+	b->len[j] = n;
+	b->flags[j] = flags;
+	memcpy(b->pool + b->npool, list, n * sizeof *list);
+	b->npool += n;
+	b->hash[h] = j;
+
+	return j;
+}
+
+/*
+ *	Minimizes the DFA with Hopcroft's algorithm.
+ *	The states are partitioned into blocks of states that can't be
+ *	distinguished; blk[i] receives the block of state i.
+ *	Returns the number of blocks, or -1 if it runs out of memory.
+ */
+static int minimize(int n, int nclass, const int *trans, const unsigned char *flags, int *blk) {
+	int *elems, *loc, *first, *last, *marked, *work, *touched, *snap, *inv, *ivs;
+	char *inwork;
+	int i, j, k, s, t, u, na, nb = 0, nw = 0, ns, nt, x, y, z;
+
+	elems = malloc(8 * n * sizeof *elems);
+	inv = malloc(n * nclass * sizeof *inv);
+	ivs = calloc(n * nclass + 1, sizeof *ivs);
+	inwork = calloc(n, 1);
+	if(!elems || !inv || !ivs || !inwork) {
+		free(elems);
+		free(inv);
+		free(ivs);
+		free(inwork);
+		return -1;
+	}
+	loc = elems + n;
+	first = loc + n;
+	last = first + n;
+	marked = last + n;
+	work = marked + n;
+	touched = work + n;
+	snap = touched + n;
+
+	/* The inverse transitions: The states that go to state t on class k
+	are inv[ivs[k * n + t]..ivs[k * n + t + 1] - 1] */
+	for(s = 0; s < n; s++)
+		for(k = 0; k < nclass; k++)
+			ivs[k * n + trans[s * nclass + k] + 1]++;
+	for(i = 0; i < n * nclass; i++)
+		ivs[i + 1] += ivs[i];
+	for(s = 0; s < n; s++)
+		for(k = 0; k < nclass; k++) {
+			j = k * n + trans[s * nclass + k];
+			inv[ivs[j]++] = s;
+		}
+	for(i = n * nclass; i > 0; i--)
+		ivs[i] = ivs[i - 1];
+	ivs[0] = 0;
+
+	/* Start with the match states in one block and the rest in another */
+	for(s = 0, na = 0; s < n; s++)
+		if(flags[s] & DS_MATCH)
+			elems[na++] = s;
+	for(s = 0, i = na; s < n; s++)
+		if(!(flags[s] & DS_MATCH))
+			elems[i++] = s;
+	if(na > 0) {
+		first[nb] = 0;
+		last[nb++] = na;
+	}
+	if(na < n) {
+		first[nb] = na;
+		last[nb++] = n;
+	}
+	for(x = 0; x < nb; x++) {
+		marked[x] = 0;
+		for(i = first[x]; i < last[x]; i++) {
+			blk[elems[i]] = x;
+			loc[elems[i]] = i;
+		}
+	}
+	if(nb == 2) {
+		work[nw++] = na < n - na ? 0 : 1;
+		inwork[work[0]] = 1;
+	}
+
+	while(nw > 0) {
+		x = work[--nw];
+		inwork[x] = 0;
+
+		/* Blocks may be split below, including this one */
+		for(ns = 0, i = first[x]; i < last[x]; i++)
+			snap[ns++] = elems[i];
+
+		for(k = 0; k < nclass; k++) {
+			/* Move the states that go into the splitter on class k to the
+			front of their blocks */
+			nt = 0;
+			for(i = 0; i < ns; i++) {
+				t = snap[i];
+				for(j = ivs[k * n + t]; j < ivs[k * n + t + 1]; j++) {
+					s = inv[j];
+					y = blk[s];
+					if(loc[s] < first[y] + marked[y])
+						continue; /* already moved */
+					u = elems[first[y] + marked[y]];
+					elems[loc[s]] = u;
+					loc[u] = loc[s];
+					elems[first[y] + marked[y]] = s;
+					loc[s] = first[y] + marked[y];
+					if(marked[y]++ == 0)
+						touched[nt++] = y;
+				}
+			}
+
+			/* Split the blocks of which only some states moved */
+			for(i = 0; i < nt; i++) {
+				y = touched[i];
+				if(marked[y] == last[y] - first[y]) {
+					marked[y] = 0;
+					continue;
+				}
+				z = nb++;
+				first[z] = first[y];
+				last[z] = first[y] + marked[y];
+				first[y] = last[z];
+				marked[y] = marked[z] = 0;
+				inwork[z] = 0;
+				for(j = first[z]; j < last[z]; j++)
+					blk[elems[j]] = z;
+
+				if(inwork[y] || last[z] - first[z] <= last[y] - first[y])
+					u = z;
+				else
+					u = y;
+				work[nw++] = u;
+				inwork[u] = 1;
+			}
+		}
+	}
+
+	free(elems);
+	free(inv);
+	free(ivs);
+	free(inwork);
+	return nb;
+}
+
+/*
+ *	Builds the minimal DFA for the NFA. Returns NULL if it needs more than
+ *	max_states states, and sets *e to WRX_MEMORY if it runs out of memory.
+ *	If reverse is set, the NFA is one built by wrx_reverse_nfa(); its
+ *	match must start where the DFA starts, and every position where a
+ *	match ends is reported.
+ */
+static struct _wrx_dfa *build_dfa(const wregex_t *nfa, int reverse, int max_states, int *e) {
+	dfa_builder b;
+	struct _wrx_dfa *dfa = NULL;
+	short *buf = NULL;
+	int *blk = NULL, *rep = NULL, *id = NULL;
+	int i, k, n, s, t, f, nb, nm, sid[4];
+
+	*e = WRX_SUCCESS;
+
+	memset(&b, 0, sizeof b);
+	if(wrx_subset_init(&b.ss, nfa) != WRX_SUCCESS) {
+		*e = WRX_MEMORY;
+		return NULL;
+	}
+
+	b.max = max_states;
+	b.size = max_states < 64 ? max_states : 64;
+	b.spool = 256;
+	for(b.nhash = 16; b.nhash < 2 * (unsigned int)max_states; b.nhash <<= 1);
+
+	b.off = malloc(b.size * sizeof *b.off);
+	b.len = malloc(b.size * sizeof *b.len);
+	b.flags = malloc(b.size * sizeof *b.flags);
+	b.trans = malloc(b.size * b.ss.nclass * sizeof *b.trans);
+	b.pool = malloc(b.spool * sizeof *b.pool);
+	b.hash = malloc(b.nhash * sizeof *b.hash);
+	buf = malloc(nfa->ns * sizeof *buf);
+	if(!b.off || !b.len || !b.flags || !b.trans || !b.pool || !b.hash || !buf)
+		goto nomem;
+	memset(b.hash, 0xFF, b.nhash * sizeof *b.hash);
+
+	/*
+	 *	The start states, one for each context that the character before
+	 *	the starting position can have. A forward DFA starts a new thread at
+	 *	every position; a reverse DFA only at the position where it starts.
+	 */
+	b.ss.all = reverse;
+	sid[0] = sid[1] = sid[2] = sid[3] = -1;
+	for(k = 0; k < b.ss.nclass; k++) {
+		i = b.ss.ctx[k];
+		if(sid[i] >= 0)
+			continue;
+		if(reverse)
+			sid[i] = find_state(&b, &nfa->start, 1, i);
+		else
+			sid[i] = find_state(&b, NULL, 0, i | DS_LOOP);
+		if(sid[i] == -1)
+			goto done;
+		else if(sid[i] < 0)
+			goto nomem;
+	}
+
+	/* The states are numbered in the order in which they are found, so
+	this visits every state once */
+	for(s = 0; s < b.n; s++)
+		for(k = 0; k < b.ss.nclass; k++) {
+			f = wrx_subset_step(&b.ss, b.pool + b.off[s], b.len[s], b.flags[s], k, buf, &n);
+			t = find_state(&b, buf, n, f);
+			if(t == -1)
+				goto done; /* Too many states */
+			else if(t < 0)
+				goto nomem;
+			b.trans[s * b.ss.nclass + k] = t;
+		}
+
+	blk = malloc(3 * b.n * sizeof *blk);
+	if(!blk) goto nomem;
+	rep = blk + b.n;
+	id = rep + b.n;
+
+	nb = minimize(b.n, b.ss.nclass, b.trans, b.flags, blk);
+	if(nb < 0) goto nomem;
+
+	/* Number the blocks so that the match states come first */
+	for(s = b.n - 1; s >= 0; s--)
+		rep[blk[s]] = s;
+	for(i = 0, nm = 0; i < nb; i++)
+		if(b.flags[rep[i]] & DS_MATCH)
+			id[i] = nm++;
+	for(i = 0, k = nm; i < nb; i++)
+		if(!(b.flags[rep[i]] & DS_MATCH))
+			id[i] = k++;
+
+	dfa = malloc(sizeof *dfa + nb * b.ss.nclass * sizeof *dfa->trans);
+	if(!dfa) goto nomem;
+
+	dfa->nstates = nb;
+	dfa->nclass = b.ss.nclass;
+	memcpy(dfa->cls, b.ss.cls, sizeof dfa->cls);
+	for(i = 0; i < 256; i++)
+		dfa->ctx[i] = b.ss.ctx[b.ss.cls[i]];
+	dfa->trans = (int *)(dfa + 1);
+	for(i = 0; i < 4; i++)
+		dfa->start[i] = sid[i] >= 0 ? id[blk[sid[i]]] * dfa->nclass : -1;
+	dfa->mlim = nm * dfa->nclass;
+	dfa->dead = -1;
+
+	/* The entries in the table are the offsets of the rows of the states */
+	for(i = 0; i < nb; i++) {
+		for(k = 0, f = 1; k < dfa->nclass; k++) {
+			t = id[blk[b.trans[rep[i] * dfa->nclass + k]]];
+			dfa->trans[id[i] * dfa->nclass + k] = t * dfa->nclass;
+			if(t != id[i])
+				f = 0;
+		}
+
+		/* A state that can't be left and isn't a match state can never
+		lead to a match. There is at most one, since they're equivalent */
+		if(f && id[i] >= nm)
+			dfa->dead = id[i] * dfa->nclass;
+	}
+
+	goto done;
+
+nomem:
+	*e = WRX_MEMORY;
+done:
+	wrx_subset_done(&b.ss);
+	free(b.off);
+	free(b.len);
+	free(b.flags);
+	free(b.trans);
+	free(b.pool);
+	free(b.hash);
+	free(buf);
+	free(blk);
+	return dfa;
+}
+
+wregex_t *wrx_comp_dfa(const char *p, int *e, int *ep, int max_states) {
+	wregex_t *nfa, *rev;
+	int i, ex;
+
+	nfa = wrx_comp(p, e, ep);
+	if(!nfa) return NULL;
+
+	/* Patterns with back references are left to the NFA engines */
+	if(wrx_has_bref(nfa))
+		return nfa;
+
+	if(max_states <= 0)
+		max_states = DFA_MAX_STATES;
+
+	/* If there are too many states, nfa->dfa is left NULL */
+	nfa->dfa = build_dfa(nfa, 0, max_states, &ex);
+	if(ex != WRX_SUCCESS)
+		goto error;
+
+	/*
+	 *	The reverse DFA finds where the match starts. It is only needed if
+	 *	the pattern starts by recording submatch 0, so "^" and the patterns
+	 *	that match everything are left out.
+	 */
+	if(nfa->dfa && nfa->states[nfa->start].op == REC && nfa->states[nfa->start].data.idx == 0) {
+		for(i = 0; i < nfa->ns; i++)
+			if(nfa->states[i].op == MEV)
+				return nfa;
+
+		/* wrx_comp() has already reversed the patterns that end with '$' */
+		rev = nfa->rev ? nfa->rev : wrx_reverse_nfa(nfa);
+		if(!rev) {
+			ex = WRX_MEMORY;
+			goto error;
+		}
+		nfa->rdfa = build_dfa(rev, 1, max_states, &ex);
+		if(rev != nfa->rev) {
+			free(rev->states);
+			free(rev);
+		}
+		if(ex != WRX_SUCCESS)
+			goto error;
+	}
+
+	if(nfa->rdfa && nfa->engine != WRX_ENG_LITERAL)
+		nfa->engine = WRX_ENG_DFA;
+
+	return nfa;
+
+error:
+	wrx_free(nfa);
+	if(e) *e = ex;
+	if(ep) *ep = 0;
+	return NULL;
+}
+
+int wrx_dfa_exec(const wregex_t *nfa, const char *str, const char **end) {
+	const struct _wrx_dfa *dfa;
+	const unsigned char *cls;
+	const int *trans;
+	const char *cp, *last = NULL;
+	int s, mlim, dead;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	dfa = nfa->dfa;
+	if(!dfa)
+		return wrx_nfa_end(nfa, str, end);
+
+	cls = dfa->cls;
+	trans = dfa->trans;
+	mlim = dfa->mlim;
+	dead = dfa->dead;
+
+	for(s = dfa->start[CTX_EDGE], cp = str; ; cp++) {
+		s = trans[s + cls[(unsigned char)cp[0]]];
+		if(s < mlim)
+			last = cp;
+		if(!cp[0] || s == dead)
+			break;
+	}
+
+	if(!last)
+		return WRX_NOMATCH;
+
+	if(end) *end = last;
+	return WRX_MATCH;
+}
+
+int wrx_dfa_match(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const struct _wrx_dfa *dfa;
+	const unsigned char *cls;
+	const int *trans;
+	const char *cp, *beg = NULL, *end;
+	int i, rv, s, mlim, dead;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	/* The submatches are NULL unless a match is found */
+	for(i = 0; i < nsm; i++) {
+		subm[i].beg = NULL;
+		subm[i].end = NULL;
+	}
+
+	if(!nfa->dfa || !nfa->rdfa)
+		return wrx_thom(nfa, str, subm, nsm);
+
+	/* Phase 1: The forward DFA finds where the match ends */
+	rv = wrx_dfa_exec(nfa, str, &end);
+	if(rv != WRX_MATCH || nsm == 0)
+		return rv;
+
+	/*
+	 *	Phase 2: The reverse DFA runs backwards from the end. The match
+	 *	starts at the leftmost position where the reverse DFA has a match,
+	 *	because no match could start any further to the left
+	 */
+	dfa = nfa->rdfa;
+	cls = dfa->cls;
+	trans = dfa->trans;
+	mlim = dfa->mlim;
+	dead = dfa->dead;
+
+	s = dfa->start[dfa->ctx[(unsigned char)end[0]]];
+	for(cp = end - 1; ; cp--) {
+		/* The beginning of the string is treated like its end: as a '\0' */
+		s = trans[s + cls[cp >= str ? (unsigned char)cp[0] : 0]];
+		if(s < mlim)
+			beg = cp + 1;
+		if(cp < str || s == dead)
+			break;
+	}
+	assert(beg);
+
+	/* Phase 3: Only the match itself is run through the NFA to get the submatches */
+	if(nsm == 1) {
+		subm[0].beg = beg;
+		subm[0].end = end;
+		return WRX_MATCH;
+	}
+
+	rv = wrx_thom_at(nfa, str, beg, subm, nsm);
+	assert(rv == WRX_MATCH && subm[0].end == end);
+	return rv;
+}
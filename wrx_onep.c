@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	The matcher for one-pass NFAs.
+ *
+ *	For every state where the matcher can find itself, wrx_comp() lists the
+ *	paths that lead to the states that consume the next character, in the
+ *	order in which wrx_exec() would try them. In a one-pass NFA no two of
+ *	these paths consume the same character, so the next character alone
+ *	decides which one to take, and there is never anything to backtrack to.
+ *	The one exception is a path that ends the match after the one taken:
+ *	wrx_exec() would have fallen back on it had the rest of the match
+ *	failed, so the submatches at that point are remembered.
+ *
+ *	A single pass only finds the match that begins at one position, so the
+ *	matcher is only used for patterns that begin with '^', which are tried
+ *	once for every line. Trying every position in the string would make the
+ *	search quadratic, so the other patterns are matched with wrx_thom().
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_pre.h"
+
+/*
+ *	Tests the zero-width assertions ('^', '$', '<', '>' and "\b") at
+ *	position cp in the string.
+ */
+static int check(char op, const char *str, const char *cp) {
+	switch(op) {
+	case BOL: return cp == str || cp[-1] == '\r' || cp[-1] == '\n';
+	case EOL: return cp[0] == '\r' || cp[0] == '\n' || cp[0] == '\0';
+	case BOW:
+		if(cp == str)
+			return IS_WORD(cp[0]);
+		return IS_WORD(cp[0]) && !IS_WORD(cp[-1]);
+	case EOW: return cp > str && IS_WORD(cp[-1]) && !IS_WORD(cp[0]);
+	case BND:
+		if(cp == str)
+			return IS_WORD(cp[0]);
+		return !IS_WORD(cp[0]) != !IS_WORD(cp[-1]);
+	}
+	assert(0);
+	return 0;
+}
+
+/*
+ *	Can the path p be followed at position cp?
+ */
+static int passes(const wregex_t *nfa, const wrx_path *p, const char *str, const char *cp) {
+	const short *ops = nfa->onepass->ops + p->op;
+	char op;
+	int i;
+
+	for(i = 0; i < p->nop; i++) {
+		op = nfa->states[ops[i]].op;
+		if(op != REC && op != STP && !check(op, str, cp))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ *	Records the submatches along the path p in cap[]
+ */
+static void record(const wregex_t *nfa, const wrx_path *p, const char *cp, const char **cap, int ncap) {
+	const short *ops = nfa->onepass->ops + p->op;
+	const wrx_state *sp;
+	int i, slot;
+
+	for(i = 0; i < p->nop; i++) {
+		sp = &nfa->states[ops[i]];
+		if(sp->op == REC || sp->op == STP) {
+			slot = 2 * sp->data.idx + (sp->op == STP);
+			if(slot < ncap)
+				cap[slot] = cp;
+		}
+	}
+}
+
+int wrx_onepass(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const struct _wrx_onepass *op;
+	const wrx_path *p, *next;
+	const wrx_state *sp;
+	const char *beg, *cp, **cap, **match;
+	unsigned char c;
+	int i, ncap, matched = 0;
+	short st;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	op = nfa->onepass;
+	if(!op || !nfa->bol)
+		return wrx_thom(nfa, str, subm, nsm);
+
+	/* The submatches that the caller isn't interested in need not be tracked */
+	ncap = 2 * (nsm < nfa->n_subm ? nsm : nfa->n_subm);
+	cap = malloc((2 * ncap + 1) * sizeof *cap);
+	if(!cap) return WRX_MEMORY;
+	match = cap + ncap;
+
+	/*
+	 *	A match may start at the beginning of any line in the string, but
+	 *	only starts at the terminating '\0' if the string is empty. Each
+	 *	try takes a single pass.
+	 */
+	for(beg = str; beg; beg = wrx_retry(nfa, beg)) {
+		if(beg[0]) {
+			/* Skip to the next line where a match can begin */
+			beg = wrx_next_start(nfa, str, beg);
+			if(!beg)
+				break;
+		}
+
+		for(i = 0; i < ncap; i++)
+			cap[i] = NULL;
+
+		for(st = nfa->start, cp = beg; ; cp++) {
+			c = cp[0];
+			next = NULL;
+			for(p = &op->path[op->node[st]]; p->leaf >= 0; p++) {
+				if(!passes(nfa, p, str, cp))
+					continue;
+				sp = &nfa->states[p->leaf];
+				if(sp->op == EOM || sp->op == MEV) {
+					/*
+					 *	A match. If a path before this one consumed c, the
+					 *	match is only used if that path fails later on.
+					 */
+					matched = 1;
+					memcpy(match, cap, ncap * sizeof *cap);
+					record(nfa, p, cp, match, ncap);
+					break;
+				}
+				if(!next && c) {
+					switch(sp->op) {
+					case MTC: if(c == (unsigned char)sp->data.c) next = p; break;
+					case MCI: if(tolower(c) == tolower((unsigned char)sp->data.c)) next = p; break;
+					case SET: if(c < 0x80 && BV_TST(sp->data.bv, c)) next = p; break;
+					}
+				}
+			}
+			if(!next)
+				break;
+
+			record(nfa, next, cp, cap, ncap);
+			st = nfa->states[next->leaf].s[0];
+		}
+
+		if(matched)
+			break;
+	}
+
+	for(i = 0; i < nsm; i++) {
+		if(matched && 2 * i < ncap) {
+			subm[i].beg = match[2 * i];
+			subm[i].end = match[2 * i + 1];
+		} else {
+			subm[i].beg = NULL;
+			subm[i].end = NULL;
+		}
+	}
+
+	free(cap);
+
+	return matched ? WRX_MATCH : WRX_NOMATCH;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	Runs the DFA built by wrx_comp_dfa() over a long string on several
+ *	threads at once.
+ *
+ *	The string is divided into chunks, one for each thread. Only the first
+ *	chunk knows the state in which it begins, so the others are run from
+ *	every state of the DFA at the same time, as if each state had a thread
+ *	of its own. These paths soon run into each other: Two paths that reach
+ *	the same state will never part again, so from there on only one of them
+ *	is followed, and the other one remembers where it joined it. Usually a
+ *	chunk is down to a single path after a few characters, and costs no more
+ *	than wrx_dfa_exec() would.
+ *
+ *	Once all the chunks are done, the state at the end of each chunk tells
+ *	in which state the next one begins, so the results are stitched together
+ *	in order. This gives the same match as wrx_dfa_exec().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#	define HAVE_PTHREAD
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+/* Chunks shorter than this aren't worth a thread of their own */
+#define MIN_CHUNK	65536
+
+/* With no more paths than this, a path that reaches the state of another
+one is found by comparing it with each of them */
+#define FEW_PATHS	8
+
+/* The most threads that will be used */
+#define MAX_THREADS	256
+
+/*
+ *	A chunk of the string, and the paths through the DFA from each state in
+ *	which it may begin
+ */
+typedef struct {
+	const struct _wrx_dfa *dfa;
+	const char *beg, *lim;	/* The chunk is beg[0..lim-beg-1] */
+
+	int npath;	/* The number of paths: 1 for the first chunk, else nstates */
+	int *state;	/* The state that each path is in */
+	const char **last;	/* Where the last match on each path ended, or NULL */
+	int *into;	/* The path that each path joined, or -1 */
+	const char **at;	/* Where each path joined the other one */
+
+	int *act;	/* The paths that are still being followed */
+	int *who;	/* The path that has reached each state at this character */
+} chunk;
+
+/*
+ *	Follows the paths through the chunk
+ */
+static void run_chunk(chunk *c) {
+	const struct _wrx_dfa *dfa = c->dfa;
+	const unsigned char *cls = dfa->cls;
+	const int *trans = dfa->trans;
+	const char *cp = c->beg, *last;
+	int i, j, n, na, p, q, s, k, mlim = dfa->mlim, dead = dfa->dead, nclass = dfa->nclass;
+
+	for(na = 0, p = 0; p < c->npath; p++)
+		if(c->state[p] != dead)
+			c->act[na++] = p;
+
+	while(na > 1 && cp < c->lim) {
+		k = cls[(unsigned char)cp[0]];
+		for(i = 0, n = 0; i < na; i++) {
+			p = c->act[i];
+			s = trans[c->state[p] + k];
+			c->state[p] = s;
+			if(s < mlim)
+				c->last[p] = cp;
+			if(s == dead)
+				continue;	/* Nothing more can happen on this path */
+			if(na <= FEW_PATHS) {
+				for(j = 0; j < n && c->state[c->act[j]] != s; j++)
+					;
+				q = j < n ? c->act[j] : -1;
+			} else if((q = c->who[s / nclass]) < 0)
+				c->who[s / nclass] = p;
+			if(q >= 0) {
+				/* Another path got here first; this one follows it from now on */
+				c->into[p] = q;
+				c->at[p] = cp;
+				continue;
+			}
+			c->act[n++] = p;
+		}
+		if(na > FEW_PATHS)
+			for(i = 0; i < n; i++)
+				c->who[c->state[c->act[i]] / nclass] = -1;
+		na = n;
+		cp++;
+	}
+
+	if(na == 0) return;
+
+	/* Down to a single path, which is followed like wrx_dfa_exec() does */
+	p = c->act[0];
+	s = c->state[p];
+	last = c->last[p];
+	for(; cp < c->lim && s != dead; cp++) {
+		s = trans[s + cls[(unsigned char)cp[0]]];
+		if(s < mlim)
+			last = cp;
+	}
+	c->state[p] = s;
+	c->last[p] = last;
+}
+
+#ifdef HAVE_PTHREAD
+static void *chunk_thread(void *arg) {
+	run_chunk(arg);
+	return NULL;
+}
+#endif
+
+/*
+ *	Finds out where the path that began in state s ends up, and where the
+ *	last match on it ended. Each path that it joined along the way counts
+ *	only from the point where it was joined.
+ */
+static int end_state(const chunk *c, int s, const char **last) {
+	int p = c->npath > 1 ? s / c->dfa->nclass : 0;
+
+	*last = c->last[p];
+	while(c->into[p] >= 0) {
+		const char *at = c->at[p];
+		p = c->into[p];
+		if(c->last[p] && c->last[p] >= at)
+			*last = c->last[p];
+	}
+	return c->state[p];
+}
+
+int wrx_dfa_pexec(const wregex_t *nfa, const char *str, int nthreads, const char **end) {
+	const struct _wrx_dfa *dfa;
+	chunk chunks[MAX_THREADS];
+	const char *last = NULL, *l;
+	size_t len, size;
+	int i, j, s, ns;
+	char *mem;
+#ifdef HAVE_PTHREAD
+	pthread_t tid[MAX_THREADS];
+	char started[MAX_THREADS];
+
+	if(nthreads <= 0)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	dfa = nfa->dfa;
+	len = strlen(str);
+
+	if(nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+	if((size_t)nthreads > len / MIN_CHUNK)
+		nthreads = (int)(len / MIN_CHUNK);
+	if(!dfa || nthreads < 2)
+		return wrx_dfa_exec(nfa, str, end);
+
+	/* The terminating '\0' is part of the last chunk */
+	ns = dfa->nstates;
+	size = ns * (3 * sizeof(int) + 2 * sizeof(char *)) + ns * sizeof(int);
+	for(i = 0; i < nthreads; i++) {
+		chunk *c = &chunks[i];
+		c->dfa = dfa;
+		c->beg = str + len / nthreads * i;
+		c->lim = i + 1 < nthreads ? str + len / nthreads * (i + 1) : str + len + 1;
+		c->npath = i ? ns : 1;
+
+		mem = malloc(size);
+		if(!mem) {
+			for(j = 0; j < i; j++)
+				free(chunks[j].last);
+			return WRX_MEMORY;
+		}
+		/* The pointers are placed first so that they're properly aligned */
+		c->last = (const char **)mem;
+		c->at = c->last + ns;
+		c->state = (int *)(c->at + ns);
+		c->into = c->state + ns;
+		c->act = c->into + ns;
+		c->who = c->act + ns;
+
+		for(j = 0; j < c->npath; j++) {
+			c->state[j] = i ? j * dfa->nclass : dfa->start[CTX_EDGE];
+			c->last[j] = NULL;
+			c->into[j] = -1;
+		}
+		for(j = 0; j < ns; j++)
+			c->who[j] = -1;
+	}
+
+#ifdef HAVE_PTHREAD
+	/* The first chunk is done on this thread while the others run */
+	for(i = 1; i < nthreads; i++)
+		started[i] = !pthread_create(&tid[i], NULL, chunk_thread, &chunks[i]);
+	run_chunk(&chunks[0]);
+	for(i = 1; i < nthreads; i++) {
+		if(started[i])
+			pthread_join(tid[i], NULL);
+		else
+			run_chunk(&chunks[i]);
+	}
+#else
+	for(i = 0; i < nthreads; i++)
+		run_chunk(&chunks[i]);
+#endif
+
+	/* Stitch the chunks together, starting where wrx_dfa_exec() does */
+	s = dfa->start[CTX_EDGE];
+	for(i = 0; i < nthreads; i++) {
+		s = end_state(&chunks[i], s, &l);
+		if(l) last = l;
+		if(s == dfa->dead)
+			break;
+	}
+
+	for(i = 0; i < nthreads; i++)
+		free(chunks[i].last);
+
+	if(!last)
+		return WRX_NOMATCH;
+
+	if(end) *end = last;
+	return WRX_MATCH;
+}
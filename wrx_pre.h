@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	Header file for the search helpers that the matchers share: the
+ *	prefilters that find where a match can begin, or the string every match
+ *	contains, and the ways of matching from a given position.
+ *	These functions are defined in wrx_exec.c, wrx_thom.c, wrx_lits.c and
+ *	wrx_jit.c.
+ */
+
+#ifndef _WRX_PRE_H
+#define _WRX_PRE_H
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/*
+ *	The backtracking matcher that wrx_exec() uses when the engine is
+ *	WRX_ENG_BACKTRACK. Takes the same parameters and returns the same
+ *	values as wrx_exec().
+ */
+int wrx_backtrack(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm);
+
+/*
+ *	The number of steps after which the backtracker, and the code generated
+ *	by wrx_jit(), give up on str and leave it to wrx_thom(), when they have
+ *	no bitmap of the states they have tried
+ */
+size_t wrx_max_steps(const wregex_t *nfa, const char *str);
+
+/*
+ *	Sets up that bitmap for str, with a bit for each state at each position:
+ *	in mbuf if the string is short enough, or on the heap if it fits in
+ *	nfa->memo_max bytes. Returns NULL if it doesn't, or if there is no
+ *	memory for it. A bitmap other than mbuf must be free()'d.
+ */
+unsigned char *wrx_new_memo(const wregex_t *nfa, const char *str, unsigned char *mbuf, size_t mbuf_size);
+
+/*
+ *	Frees the code generated by wrx_jit()
+ */
+void wrx_jit_free(struct _wrx_jit *jit);
+
+/*
+ *	Matches the string str like wrx_thom() does, but the match has to begin
+ *	at beg. The rest of str is still used for the '^', '$', '<', '>' and
+ *	"\b" assertions.
+ */
+int wrx_thom_at(const wregex_t *nfa, const char *str, const char *beg, wregmatch_t subm[], int nsm);
+
+/*
+ *	Matches the string str like wrx_thom() does, but the match has to begin
+ *	somewhere from beg up to last. Finds the same match as wrx_thom() if no
+ *	match begins before beg.
+ */
+int wrx_thom_range(const wregex_t *nfa, const char *str, const char *beg, const char *last, wregmatch_t subm[], int nsm);
+
+/*
+ *	Returns the first position from cp onwards where a match can begin,
+ *	going by nfa->bol, the strings in nfa->lits, the window in nfa->bndm or
+ *	the bytes in nfa->first, or NULL if there is none before the end of the string.
+ *	cp points into str, which is needed to find the beginnings of lines.
+ *	Matches that begin at the terminating '\0' of an empty string are left
+ *	to the caller.
+ */
+const char *wrx_next_start(const wregex_t *nfa, const char *str, const char *cp);
+
+/*
+ *	Returns the next position after beg at which a match may begin, given
+ *	that none begins at beg, or NULL if there is none before the end of the
+ *	string. Skips the positions that follow the bytes of nfa->loop.
+ */
+const char *wrx_retry(const wregex_t *nfa, const char *beg);
+
+/*
+ *	Builds the tables for finding the n strings in str[], which
+ *	wrx_lits_find() looks for. Ignores case if ci is set. The strings are
+ *	sorted and may be changed. Returns NULL if there is no memory.
+ *	The result is freed with free().
+ */
+struct _wrx_lits *wrx_lits_new(char (*str)[LITS_LEN + 1], int n, int ci);
+
+/*
+ *	Returns the first position from cp onwards where one of the strings
+ *	begins, or NULL if there is none
+ */
+const char *wrx_lits_find(const struct _wrx_lits *lt, const char *cp);
+
+/*
+ *	Returns the first position from cp onwards where the window of bn
+ *	occurs, or NULL if there is none
+ */
+const char *wrx_bndm_find(const struct _wrx_bndm *bn, const char *cp);
+
+/*
+ *	Returns the first occurrence of lit in str, like strstr(), but ignores
+ *	case if ci is set, in which case lit must be in lower case. Ignoring
+ *	case, it compares the first and last bytes of lit against many
+ *	positions at once where vector instructions are available.
+ */
+const char *wrx_strstr(const char *str, const char *lit, int ci);
+
+/*
+ *	Returns the first occurrence in str of nfa->req, which every match
+ *	contains, or NULL if there is none
+ */
+const char *wrx_find_req(const wregex_t *nfa, const char *str);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+} /* extern "C" */
+#endif
+
+#endif /*_WRX_PRE_H*/
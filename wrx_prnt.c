@@ -24,6 +24,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <assert.h>
 
 #include "wregex.h"
@@ -194,3 +197,323 @@ void wrx_print_dot(wregex_t *nfa, const char *filename)
 	fprintf(f, "}\n");
 	fclose(f);
 }
+
+/*
+ *	Writes the character c to f as a C character constant
+ */
+static void c_char(FILE *f, int c) {
+	c &= 0xFF;
+	if(c == '\'' || c == '\\')
+		fprintf(f, "'\\%c'", c);
+	else if(c >= START_OF_PRINT && c < 127)
+		fprintf(f, "'%c'", c);
+	else
+		fprintf(f, "'\\%03o'", c);
+}
+
+/*
+ *	Writes the characters of the chain of n MTC states starting at st to f
+ *	as a C string literal. '?' is escaped so that it can't form a trigraph
+ */
+static void c_string(FILE *f, const wregex_t *nfa, int st, int n) {
+	int c;
+	fputc('"', f);
+	for(; n > 0; n--, st = nfa->states[st].s[0]) {
+		c = nfa->states[st].data.c & 0xFF;
+		if(c == '"' || c == '\\' || c == '?')
+			fprintf(f, "\\%c", c);
+		else if(c >= START_OF_PRINT && c < 127)
+			fputc(c, f);
+		else
+			fprintf(f, "\\%03o", c);
+	}
+	fputc('"', f);
+}
+
+/*
+ *	Generates a C function called name that matches strings against the NFA,
+ *	and writes it to the file filename. See wrx_prnt.h
+ *
+ *	Each reachable state becomes a block of code behind a label, and the
+ *	transitions become gotos. A run of MTC states that can only be entered
+ *	at its first state is matched with a single strncmp(). CHC, REC and STP
+ *	states push the alternative, or the submatch pointer to restore, on an
+ *	explicit stack and the code under the fail label pops it, as in
+ *	wrx_exec(). Without back references a bitmap of the (state, position)
+ *	pairs tried so far bounds the work; only the states that can be entered
+ *	in more than one way need to check it.
+ */
+/* Writes the #define of one of the library's return codes */
+#define CODE(f, code)	fprintf(f, "#define " #code "\t%d\n", code)
+
+int wrx_codegen(const wregex_t *nfa, const char *name, const char *filename) {
+	FILE *f;
+	short *refs, *from, *stk;
+	char *reach;
+	const wrx_state *sp;
+	int i, j, n, ts, c, slot;
+	int bref = 0, push = 0, alts = 0, seen = 0, fails = 0, used;
+
+	assert(nfa->start < nfa->ns);
+
+	refs = calloc(nfa->ns, 3 * sizeof *refs + 1);
+	if(!refs) return WRX_MEMORY;
+	from = refs + nfa->ns;
+	stk = from + nfa->ns;
+	reach = (char *)(stk + nfa->ns);
+
+	/* Find the reachable states and count the transitions into them */
+	ts = 0;
+	stk[ts++] = nfa->start;
+	reach[nfa->start] = 1;
+	refs[nfa->start] = 1;
+	from[nfa->start] = -1;
+	while(ts > 0) {
+		sp = &nfa->states[stk[--ts]];
+		if(sp->op == BRF || sp->op == BRI)
+			bref = 1;
+		if(sp->op == CHC || sp->op == REC || sp->op == STP)
+			push = 1;
+		if(sp->op == CHC)
+			alts = 1;
+		for(i = 0; i < 2; i++) {
+			if((j = sp->s[i]) < 0 || sp->op == EOM || sp->op == MEV || (i && sp->op != CHC))
+				continue;
+			refs[j]++;
+			from[j] = sp - nfa->states;
+			if(!reach[j]) {
+				reach[j] = 1;
+				stk[ts++] = j;
+			}
+		}
+	}
+
+	/* The states inside a run of MTC states are matched by the first one */
+	for(i = 0; i < nfa->ns; i++) {
+		if(!reach[i]) continue;
+		sp = &nfa->states[i];
+		if(sp->op == MTC && refs[i] == 1 && from[i] >= 0 && nfa->states[from[i]].op == MTC)
+			reach[i] = 2;
+		else if(refs[i] > 1 && !bref)
+			seen = 1;
+		/* Everything but these can fail */
+		if(sp->op != CHC && sp->op != MOV && sp->op != REC && sp->op != STP && sp->op != EOM && sp->op != MEV)
+			fails = 1;
+	}
+
+	/* Patterns like "" that always match don't need most of the code */
+	used = push || seen || fails;
+
+	f = fopen(filename, "w");
+	if(!f) {
+		free(refs);
+		return WRX_MEMORY;
+	}
+
+	fprintf(f, "/* Generated by wrx_codegen(). Do not edit. */\n");
+	fprintf(f, "#include <stdlib.h>\n#include <string.h>\n#include <ctype.h>\n\n#include \"wregex.h\"\n\n");
+
+	/* The return codes are written out from the library's own, so that the
+	generated code gives the same ones */
+	fprintf(f, "/* The return codes of wrx_exec() */\n");
+	CODE(f, WRX_MATCH);
+	CODE(f, WRX_NOMATCH);
+	CODE(f, WRX_MEMORY);
+	CODE(f, WRX_SMALL_NSM);
+	CODE(f, WRX_INV_BREF);
+	CODE(f, WRX_STACK);
+	CODE(f, WRX_OPCODE);
+	fprintf(f, "\n");
+
+	fprintf(f, "#define NS\t%d\t/* Number of states */\n", nfa->ns);
+	fprintf(f, "#define NCAP\t%d\t/* Number of submatch pointers */\n", 2 * nfa->n_subm);
+	fprintf(f, "#define IS_WORD(c)\tisalnum((unsigned char)(c))\n");
+	fprintf(f, "#define IN_SET(s, c)\t((s)[(unsigned char)(c) >> 3] & 1 << ((c) & 7))\n");
+	if(push) {
+		fprintf(f, "#define STACK_MAX\t0x100000\n\n");
+		fprintf(f, "/* An alternative to try next, or a submatch pointer to restore */\n");
+		fprintf(f, "typedef struct {\n\tint st;\t/* The state, or -1 to restore cap[slot] */\n");
+		fprintf(f, "\tint slot;\n\tconst char *p;\n} item;\n\n");
+		fprintf(f, "/* Doubles the size of the stack, which starts out in buf */\n");
+		fprintf(f, "static item *grow(item *stk, item *buf, size_t *max) {\n");
+		fprintf(f, "\titem *n = *max < STACK_MAX ? malloc(2 * *max * sizeof *n) : NULL;\n");
+		fprintf(f, "\tif(n) memcpy(n, stk, *max * sizeof *n);\n");
+		fprintf(f, "\tif(stk != buf) free(stk);\n");
+		fprintf(f, "\t*max *= 2;\n\treturn n;\n}\n\n");
+		fprintf(f, "#define PUSH(s, l, q) \\\n");
+		fprintf(f, "\tif(ts == max && !(stk = grow(stk, buf, &max))) { \\\n");
+		fprintf(f, "\t\trv = max > STACK_MAX ? WRX_STACK : WRX_MEMORY; \\\n");
+		fprintf(f, "\t\tgoto done; \\\n\t} \\\n");
+		fprintf(f, "\tstk[ts].st = (s); stk[ts].slot = (l); stk[ts].p = (q); ts++\n");
+	}
+	if(seen) {
+		fprintf(f, "\n/* Fails if the state has been tried at this position before */\n");
+		fprintf(f, "#define SEEN(st) \\\n");
+		fprintf(f, "\tk = (size_t)(cp - str) * NS + (st); \\\n");
+		fprintf(f, "\tif(memo[k >> 3] & (1 << (k & 7))) goto fail; \\\n");
+		fprintf(f, "\tmemo[k >> 3] |= 1 << (k & 7)\n");
+	}
+	fprintf(f, "\n");
+
+	/* The character sets. '\0' is left out so that it never matches */
+	for(i = 0; i < nfa->ns; i++) {
+		if(!reach[i] || nfa->states[i].op != SET) continue;
+		fprintf(f, "static const unsigned char set%d[32] = {", i);
+		for(j = 0; j < 32; j++) {
+			c = j < 16 ? nfa->states[i].data.bv[j] & 0xFF : 0;
+			if(j == 0) c &= 0xFE;
+			fprintf(f, "%s0x%02X", j % 8 ? ", " : j ? ",\n\t" : "\n\t", c);
+		}
+		fprintf(f, "\n};\n");
+	}
+
+	fprintf(f, "\nint %s(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {\n", name);
+	fprintf(f, "\tconst char *cap[NCAP]%s;\n", used ? ", *cp, *beg = str" : "");
+	if(bref)
+		fprintf(f, "\tconst char *b;\n");
+	if(push)
+		fprintf(f, "\titem buf[64], *stk = buf;\n\tsize_t ts = 0, max = 64;\n");
+	if(seen)
+		fprintf(f, "\tunsigned char mbuf[128], *memo = mbuf;\n\tsize_t k, sz;\n");
+	fprintf(f, "\tint i, rv = WRX_NOMATCH;\n\n");
+	fprintf(f, used ? "\t(void)nfa;\n" : "\t(void)nfa;\n\t(void)str;\n");
+	fprintf(f, "\tif(!subm) nsm = 0;\n");
+	fprintf(f, "\tif(nsm < 0) return WRX_SMALL_NSM;\n\n");
+	fprintf(f, "\tfor(i = 0; i < nsm; i++)\n\t\tsubm[i].beg = subm[i].end = NULL;\n");
+	fprintf(f, "\tfor(i = 0; i < NCAP; i++)\n\t\tcap[i] = NULL;\n\n");
+	if(seen) {
+		fprintf(f, "\tsz = ((strlen(str) + 1) * NS + 7) / 8;\n");
+		fprintf(f, "\tif(sz > sizeof mbuf) {\n");
+		fprintf(f, "\t\tmemo = calloc(sz, 1);\n\t\tif(!memo) return WRX_MEMORY;\n");
+		fprintf(f, "\t} else\n\t\tmemset(mbuf, 0, sz);\n\n");
+	}
+	if(used)
+		fprintf(f, "\tcp = beg;\n");
+	fprintf(f, "\tgoto s%d;\n", nfa->start);
+
+	for(i = 0; i < nfa->ns; i++) {
+		sp = &nfa->states[i];
+		if(reach[i] != 1) continue;
+
+		fprintf(f, "\ns%d:\n", i);
+		if(seen && refs[i] > 1)
+			fprintf(f, "\tSEEN(%d);\n", i);
+
+		switch(sp->op) {
+		case MTC:
+			for(n = 1, j = sp->s[0]; reach[j] == 2; n++)
+				j = nfa->states[j].s[0];
+			if(n == 1) {
+				fprintf(f, "\tif(cp[0] != ");
+				c_char(f, sp->data.c);
+				fprintf(f, ") goto fail;\n\tcp++;\n");
+			} else {
+				fprintf(f, "\tif(strncmp(cp, ");
+				c_string(f, nfa, i, n);
+				fprintf(f, ", %d)) goto fail;\n\tcp += %d;\n", n, n);
+			}
+			fprintf(f, "\tgoto s%d;\n", j);
+			break;
+		case MCI:
+			fprintf(f, "\tif(tolower((unsigned char)cp[0]) != ");
+			c_char(f, tolower((unsigned char)sp->data.c));
+			fprintf(f, ") goto fail;\n\tcp++;\n\tgoto s%d;\n", sp->s[0]);
+			break;
+		case SET:
+			fprintf(f, "\tif(!IN_SET(set%d, cp[0])) goto fail;\n\tcp++;\n\tgoto s%d;\n", i, sp->s[0]);
+			break;
+		case CHC:
+			fprintf(f, "\tPUSH(%d, 0, cp);\n\tgoto s%d;\n", sp->s[1], sp->s[0]);
+			break;
+		case MOV:
+			fprintf(f, "\tgoto s%d;\n", sp->s[0]);
+			break;
+		case REC:
+		case STP:
+			slot = 2 * sp->data.idx + (sp->op == STP);
+			fprintf(f, "\tPUSH(-1, %d, cap[%d]);\n\tcap[%d] = cp;\n\tgoto s%d;\n", slot, slot, slot, sp->s[0]);
+			break;
+		case BRF:
+		case BRI:
+			j = sp->data.idx;
+			if(j >= nfa->n_subm) {
+				fprintf(f, "\trv = WRX_INV_BREF;\n\tgoto done;\n");
+				break;
+			}
+			fprintf(f, "\tif(!cap[%d] || !cap[%d]) {\n\t\trv = WRX_INV_BREF;\n\t\tgoto done;\n\t}\n", 2 * j, 2 * j + 1);
+			fprintf(f, "\tfor(b = cap[%d]; b < cap[%d]; b++, cp++)\n", 2 * j, 2 * j + 1);
+			if(sp->op == BRF)
+				fprintf(f, "\t\tif(b[0] != cp[0]) goto fail;\n");
+			else
+				fprintf(f, "\t\tif(tolower((unsigned char)b[0]) != tolower((unsigned char)cp[0])) goto fail;\n");
+			fprintf(f, "\tgoto s%d;\n", sp->s[0]);
+			break;
+		case BOL:
+			fprintf(f, "\tif(cp > str && cp[-1] != '\\r' && cp[-1] != '\\n') goto fail;\n\tgoto s%d;\n", sp->s[0]);
+			break;
+		case EOL:
+			fprintf(f, "\tif(cp[0] && cp[0] != '\\r' && cp[0] != '\\n') goto fail;\n\tgoto s%d;\n", sp->s[0]);
+			break;
+		case BOW:
+			fprintf(f, "\tif(!IS_WORD(cp[0]) || (cp > str && IS_WORD(cp[-1]))) goto fail;\n\tgoto s%d;\n", sp->s[0]);
+			break;
+		case EOW:
+			fprintf(f, "\tif(cp == str || !IS_WORD(cp[-1]) || IS_WORD(cp[0])) goto fail;\n\tgoto s%d;\n", sp->s[0]);
+			break;
+		case BND:
+			fprintf(f, "\tif(cp == str ? !IS_WORD(cp[0]) : !IS_WORD(cp[0]) == !IS_WORD(cp[-1])) goto fail;\n\tgoto s%d;\n", sp->s[0]);
+			break;
+		case EOM:
+		case MEV:
+			fprintf(f, "\tgoto match;\n");
+			break;
+		default:
+			fprintf(f, "\trv = WRX_OPCODE;\n\tgoto done;\n");
+		}
+	}
+
+	/* Backtrack, or try the next starting position */
+	if(fails || seen) {
+		fprintf(f, "\nfail:\n");
+		if(push) {
+			fprintf(f, "\twhile(ts > 0) {\n\t\tts--;\n");
+			fprintf(f, "\t\tif(stk[ts].st < 0) {\n\t\t\tcap[stk[ts].slot] = stk[ts].p;\n\t\t\tcontinue;\n\t\t}\n");
+			if(alts) {
+				/* stk[] marks the alternatives, so that each gets a single case */
+				memset(stk, 0, nfa->ns * sizeof *stk);
+				fprintf(f, "\t\tcp = stk[ts].p;\n\t\tswitch(stk[ts].st) {\n");
+				for(i = 0; i < nfa->ns; i++) {
+					sp = &nfa->states[i];
+					if(reach[i] == 1 && sp->op == CHC && !stk[sp->s[1]]++)
+						fprintf(f, "\t\tcase %d: goto s%d;\n", sp->s[1], sp->s[1]);
+				}
+				fprintf(f, "\t\t}\n");
+			}
+			fprintf(f, "\t}\n");
+		}
+		fprintf(f, "\tif(beg[0] && beg[1]) {\n\t\tcp = ++beg;\n\t\tgoto s%d;\n\t}\n", nfa->start);
+		fprintf(f, "\tgoto done;\n");
+	}
+
+	fprintf(f, "\nmatch:\n");
+	fprintf(f, "\tfor(i = 0; i < nsm; i++) {\n");
+	fprintf(f, "\t\tsubm[i].beg = 2 * i < NCAP ? cap[2 * i] : NULL;\n");
+	fprintf(f, "\t\tsubm[i].end = 2 * i < NCAP ? cap[2 * i + 1] : NULL;\n\t}\n");
+	fprintf(f, "\trv = WRX_MATCH;\n");
+
+	if(used)
+		fprintf(f, "\ndone:\n");
+	else
+		fprintf(f, "\n");
+	if(push)
+		fprintf(f, "\tif(stk != buf) free(stk);\n");
+	if(seen)
+		fprintf(f, "\tif(memo != mbuf) free(memo);\n");
+	fprintf(f, "\treturn rv;\n}\n");
+
+	fclose(f);
+	free(refs);
+	return WRX_SUCCESS;
+}
+
+#undef CODE
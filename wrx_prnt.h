@@ -50,6 +50,18 @@ void wrx_print_nfa(wregex_t *nfa);
  */
 void wrx_print_dot(wregex_t *nfa, const char *filename);
 
+/*
+ *	Writes a C source file that defines a function called name, which
+ *	matches strings against the NFA without interpreting it:
+ *	>int name(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm);
+ *	It takes the same parameters and returns the same values as wrx_exec(),
+ *	but its nfa parameter is ignored and may be NULL. The generated file
+ *	only needs wregex.h and the standard library, and #defines the return
+ *	codes it uses with the library's values when it was generated.
+ *	Returns 0 on success, or an error code if the file can't be written.
+ */
+int wrx_codegen(const wregex_t *nfa, const char *name, const char *filename);
+
 #if defined(__cplusplus) || defined(c_plusplus)
 } /* extern "C" */
 #endif
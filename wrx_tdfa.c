@@ -0,0 +1,590 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	A tagged DFA, as described by Ville Laurikari, that extracts the
+ *	submatches while it matches.
+ *
+ *	A state of the DFA is the list of threads that wrx_thom() would have
+ *	at a point in the string, in the same order. Instead of the positions
+ *	recorded by the REC and STP states, each thread holds the numbers of
+ *	the registers in which the positions are kept at run time (or -2 if the
+ *	submatch pointer is still NULL). A transition copies registers and sets
+ *	some to the current position, which is all that following the REC and
+ *	STP states amounts to. If a thread reaches the end of the match, the
+ *	transition also copies the thread's registers to the submatches.
+ *
+ *	The registers are numbered in the order in which the threads use them,
+ *	so that the lists that only differ in where the positions are stored
+ *	become the same state, and the number of states stays finite.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+
+/* Special values in place of a register number */
+#define V_POS	-1	/* The current position */
+#define V_NULL	-2	/* NULL */
+#define V_TMP	-3	/* The temporary used to swap registers */
+
+/* An item on the stack used while following the transitions that don't
+consume input */
+typedef struct {
+	short st;	/* State to visit, or -1 to restore a submatch's register */
+	short slot;	/* The submatch pointer to restore */
+	short old;	/* The register to restore it to */
+} job;
+
+/*
+ *	Internal data used while building the DFA
+ */
+typedef struct {
+	const wregex_t *nfa;
+	wrx_subset ss;	/* Used only for its byte classes */
+	int ncap;		/* Number of submatch pointers */
+
+	int max;		/* Maximum number of states */
+	int n, size;	/* Number of states, and the number allocated */
+
+	/* The NFA states of state i are pool[off[i]..off[i]+len[i]-1], and
+	they are followed by the registers of each of them */
+	int *off;
+	short *len;
+	unsigned char *flags;
+	short *pool;
+	int npool, spool;
+
+	int *hash;		/* Open addressing hash table of state numbers */
+	unsigned int nhash;
+
+	wrx_tdfa_trans *trans;	/* trans[i * nclass + k] is state i's transition on class k */
+	short *ops;		/* The operations of the transitions, in pairs */
+	int nops, sops;
+	int nreg;		/* The most registers any state uses */
+
+	/* Work space for step() */
+	unsigned int gen, *mark, *omark;
+	job *stk;
+	short *cur, *out, *regs, *mvec, *map, *src;
+} tdfa_builder;
+
+/*
+ *	Does the state sp consume the character c?
+ */
+static int consumes(const wrx_state *sp, unsigned char c) {
+	switch(sp->op) {
+	case MTC: return c && c == (unsigned char)sp->data.c;
+	case MCI: return c && tolower(c) == tolower((unsigned char)sp->data.c);
+	case SET: return c && c < 0x80 && BV_TST(sp->data.bv, c);
+	}
+	return 0;
+}
+
+/*
+ *	Tests the zero-width assertions, given the contexts of the characters
+ *	before and after the position.
+ */
+static int check(char op, int prev, int next) {
+	switch(op) {
+	case BOL: return prev == CTX_EDGE || prev == CTX_NL;
+	case EOL: return next == CTX_EDGE || next == CTX_NL;
+	case BOW: return next == CTX_WORD && prev != CTX_WORD;
+	case EOW: return prev == CTX_WORD && next != CTX_WORD;
+	case BND: return (prev == CTX_WORD) != (next == CTX_WORD);
+	}
+	assert(0);
+	return 0;
+}
+
+/*
+ *	Finds the state with the NFA states list[0..n-1], followed by their
+ *	registers, and flags, or adds it.
+ *	Returns the state's number, -1 if there are too many states or
+ *	-2 if it runs out of memory.
+ */
+static int find_state(tdfa_builder *b, const short *list, int n, int flags) {
+	unsigned int h = 2166136261u;
+	int i, j, len = n * (1 + b->ncap);
+	void *p;
+
+	h = (h ^ flags) * 16777619u;
+	for(i = 0; i < len; i++)
+		h = (h ^ (unsigned short)list[i]) * 16777619u;
+
+	for(h &= b->nhash - 1; (j = b->hash[h]) >= 0; h = (h + 1) & (b->nhash - 1))
+		if(b->flags[j] == flags && b->len[j] == n && !memcmp(b->pool + b->off[j], list, len * sizeof *list))
+			return j;
+
+	if(b->n >= b->max)
+		return -1;
+
+	if(b->n >= b->size) {
+		b->size = b->size * 2 < b->max ? b->size * 2 : b->max;
+		if(!(p = realloc(b->off, b->size * sizeof *b->off))) return -2;
+		b->off = p;
+		if(!(p = realloc(b->len, b->size * sizeof *b->len))) return -2;
+		b->len = p;
+		if(!(p = realloc(b->flags, b->size * sizeof *b->flags))) return -2;
+		b->flags = p;
+		if(!(p = realloc(b->trans, b->size * b->ss.nclass * sizeof *b->trans))) return -2;
+		b->trans = p;
+	}
+
+	while(b->npool + len > b->spool) {
+		b->spool *= 2;
+		if(!(p = realloc(b->pool, b->spool * sizeof *b->pool))) return -2;
+		b->pool = p;
+	}
+
+	j = b->n++;
+	b->off[j] = b->npool;
+	b->len[j] = n;
+	b->flags[j] = flags;
+	memcpy(b->pool + b->npool, list, len * sizeof *list);
+	b->npool += len;
+	b->hash[h] = j;
+
+	return j;
+}
+
+/*
+ *	Appends the operation "register d = value v" to the transitions' operations
+ */
+static int add_op(tdfa_builder *b, short d, short v) {
+	void *p;
+	if(b->nops + 2 > b->sops) {
+		b->sops *= 2;
+		if(!(p = realloc(b->ops, b->sops * sizeof *b->ops))) return 0;
+		b->ops = p;
+	}
+	b->ops[b->nops++] = d;
+	b->ops[b->nops++] = v;
+	return 1;
+}
+
+/*
+ *	Computes state s's transition on byte class k, as wrx_subset_step()
+ *	does, but keeping track of the registers of each thread.
+ *	Returns 1 on success, -1 if there are too many states and -2 if it runs
+ *	out of memory.
+ */
+static int step(tdfa_builder *b, int s, int k) {
+	const wregex_t *nfa = b->nfa;
+	const wrx_state *sp;
+	const short *in = b->pool + b->off[s];
+	wrx_tdfa_trans *tr;
+	job *stk = b->stk;
+	short *cur = b->cur;
+	int nin = b->len[s], flags = b->flags[s];
+	int prev = flags & DS_PREV, next = b->ss.ctx[k];
+	unsigned char c = b->ss.rep[k];
+	int i, j, ts, st, slot, v, no = 0, nr = 0, matched = 0, cut = 0, pos = -1;
+	int ncap = b->ncap;
+
+	if(++b->gen == 0) {
+		memset(b->mark, 0, 2 * nfa->ns * sizeof *b->mark);
+		b->gen = 1;
+	}
+
+	for(i = 0; i <= nin && !cut; i++) {
+		if(i < nin) {
+			st = in[i];
+			memcpy(cur, in + nin + i * ncap, ncap * sizeof *cur);
+		} else if((flags & DS_LOOP) && (next != CTX_EDGE || prev == CTX_EDGE)) {
+			/* Start a new thread, as wrx_thom() does */
+			st = nfa->start;
+			for(j = 0; j < ncap; j++)
+				cur[j] = V_NULL;
+		} else
+			break;
+
+		stk[0].st = st;
+		ts = 1;
+		while(ts > 0) {
+			ts--;
+			if(stk[ts].st < 0) {
+				cur[stk[ts].slot] = stk[ts].old;
+				continue;
+			}
+
+			st = stk[ts].st;
+			assert(st >= 0 && st < nfa->ns);
+
+			if(b->mark[st] == b->gen)
+				continue;
+			b->mark[st] = b->gen;
+
+			sp = &nfa->states[st];
+			switch(sp->op) {
+			case CHC:
+				stk[ts++].st = sp->s[1];
+				stk[ts++].st = sp->s[0];
+				break;
+			case MOV:
+				stk[ts++].st = sp->s[0];
+				break;
+			case REC:
+			case STP:
+				slot = 2 * sp->data.idx + (sp->op == STP);
+				stk[ts].st = -1;
+				stk[ts].slot = slot;
+				stk[ts].old = cur[slot];
+				ts++;
+				cur[slot] = V_POS;
+				stk[ts++].st = sp->s[0];
+				break;
+			case BOL:
+			case EOL:
+			case BOW:
+			case EOW:
+			case BND:
+				if(check(sp->op, prev, next))
+					stk[ts++].st = sp->s[0];
+				break;
+			case EOM:
+			case MEV:
+				/* The threads that follow would only have been tried
+				after this match */
+				matched = 1;
+				memcpy(b->mvec, cur, ncap * sizeof *cur);
+				cut = 1;
+				ts = 0;
+				break;
+			default:
+				if(consumes(sp, c) && b->omark[sp->s[0]] != b->gen) {
+					b->omark[sp->s[0]] = b->gen;
+					b->out[no] = sp->s[0];
+					memcpy(b->regs + no * ncap, cur, ncap * sizeof *cur);
+					no++;
+				}
+			}
+		}
+	}
+
+	/* Renumber the registers in the order in which the new threads use them.
+	src[] receives the value that each new register takes */
+	for(i = 0; i < b->nreg; i++)
+		b->map[i] = -1;
+	for(i = 0; i < no * ncap; i++) {
+		v = b->regs[i];
+		if(v == V_NULL)
+			continue;
+		if(v == V_POS) {
+			if(pos < 0) {
+				b->src[nr] = V_POS;
+				pos = nr++;
+			}
+			b->regs[i] = pos;
+		} else {
+			if(b->map[v] < 0) {
+				b->src[nr] = v;
+				b->map[v] = nr++;
+			}
+			b->regs[i] = b->map[v];
+		}
+	}
+	if(nr > b->nreg)
+		b->nreg = nr;
+
+	memcpy(b->out + no, b->regs, no * ncap * sizeof *b->regs);
+	flags = (flags & DS_LOOP) && !cut && next != CTX_EDGE ? next | DS_LOOP : next;
+	i = find_state(b, b->out, no, flags);
+	if(i < 0)
+		return i;
+	tr = &b->trans[s * b->ss.nclass + k];
+	tr->next = i;
+
+	/* The submatches are copied before the registers change */
+	tr->op = b->nops;
+	tr->match = matched;
+	if(matched)
+		for(i = 0; i < ncap; i++)
+			if(!add_op(b, i, b->mvec[i]))
+				return -2;
+
+	/*
+	 *	The registers all change at once, so the copies have to be put in an
+	 *	order in which no register is overwritten before it is read. A cycle
+	 *	of copies is broken by saving one of the registers in a temporary.
+	 */
+	for(i = 0; i < nr; i++)
+		if(b->src[i] == i)
+			b->src[i] = V_NULL; /* Nothing to do */
+	for(;;) {
+		for(i = 0, j = -1; i < nr; i++) {
+			if(b->src[i] < 0 && b->src[i] != V_TMP)
+				continue;
+			if(j < 0)
+				j = i;
+			for(v = 0; v < nr; v++)
+				if(v != i && b->src[v] == i)
+					break;
+			if(v == nr)
+				break; /* No other copy reads register i */
+		}
+		if(j < 0)
+			break; /* Only the V_POS and V_NULL ones are left */
+		if(i == nr) {
+			/* Every register left is in a cycle */
+			if(!add_op(b, V_TMP, j))
+				return -2;
+			for(v = 0; v < nr; v++)
+				if(b->src[v] == j)
+					b->src[v] = V_TMP;
+			continue;
+		}
+		if(!add_op(b, i, b->src[i]))
+			return -2;
+		b->src[i] = V_NULL;
+	}
+	for(i = 0; i < nr; i++)
+		if(b->src[i] == V_POS && !add_op(b, i, V_POS))
+			return -2;
+
+	tr->nop = (b->nops - tr->op) / 2;
+	return 1;
+}
+
+/*
+ *	Builds the tagged DFA for the NFA.
+ *	Returns NULL if there are more than max_states states; *e is set to
+ *	WRX_MEMORY if it runs out of memory.
+ */
+static struct _wrx_tdfa *build_tdfa(const wregex_t *nfa, int max_states, int *e) {
+	tdfa_builder b;
+	struct _wrx_tdfa *tdfa = NULL;
+	wrx_tdfa_trans *tr;
+	int i, k, s, r, nv;
+
+	*e = WRX_SUCCESS;
+
+	memset(&b, 0, sizeof b);
+	if(wrx_subset_init(&b.ss, nfa) != WRX_SUCCESS) {
+		*e = WRX_MEMORY;
+		return NULL;
+	}
+
+	b.nfa = nfa;
+	b.ncap = 2 * nfa->n_subm;
+	nv = nfa->ns * b.ncap;
+
+	b.max = max_states;
+	b.size = max_states < 64 ? max_states : 64;
+	b.spool = 256;
+	b.sops = 256;
+	for(b.nhash = 16; b.nhash < 2 * (unsigned int)max_states; b.nhash <<= 1);
+
+	b.off = malloc(b.size * sizeof *b.off);
+	b.len = malloc(b.size * sizeof *b.len);
+	b.flags = malloc(b.size * sizeof *b.flags);
+	b.trans = malloc(b.size * b.ss.nclass * sizeof *b.trans);
+	b.pool = malloc(b.spool * sizeof *b.pool);
+	b.ops = malloc(b.sops * sizeof *b.ops);
+	b.hash = malloc(b.nhash * sizeof *b.hash);
+	b.mark = calloc(2 * nfa->ns, sizeof *b.mark);
+	b.stk = malloc((3 * nfa->ns + 3) * sizeof *b.stk);
+	b.cur = malloc((2 * b.ncap + nfa->ns + 4 * nv + 2) * sizeof *b.cur);
+	if(!b.off || !b.len || !b.flags || !b.trans || !b.pool || !b.ops || !b.hash || !b.mark || !b.stk || !b.cur)
+		goto nomem;
+	memset(b.hash, 0xFF, b.nhash * sizeof *b.hash);
+	b.omark = b.mark + nfa->ns;
+	b.mvec = b.cur + b.ncap;
+	b.out = b.mvec + b.ncap;
+	b.regs = b.out + nfa->ns + nv;
+	b.map = b.regs + nv;
+	b.src = b.map + nv + 1;
+
+	/* The start state has no threads yet; a new one is started at every position */
+	if((s = find_state(&b, NULL, 0, CTX_EDGE | DS_LOOP)) == -1)
+		goto done;
+	else if(s < 0)
+		goto nomem;
+
+	/* The states are numbered in the order in which they are found, so
+	this visits every state once */
+	for(s = 0; s < b.n; s++)
+		for(k = 0; k < b.ss.nclass; k++) {
+			r = step(&b, s, k);
+			if(r == -1)
+				goto done; /* Too many states */
+			else if(r < 0)
+				goto nomem;
+		}
+
+	tdfa = malloc(sizeof *tdfa + b.n * b.ss.nclass * sizeof *tdfa->trans + b.nops * sizeof *tdfa->ops);
+	if(!tdfa) goto nomem;
+
+	tdfa->nstates = b.n;
+	tdfa->nclass = b.ss.nclass;
+	tdfa->nreg = b.nreg;
+	tdfa->ncap = b.ncap;
+	memcpy(tdfa->cls, b.ss.cls, sizeof tdfa->cls);
+	tdfa->trans = (wrx_tdfa_trans *)(tdfa + 1);
+	tdfa->ops = (short *)(tdfa->trans + b.n * b.ss.nclass);
+	memcpy(tdfa->ops, b.ops, b.nops * sizeof *b.ops);
+
+	/* The entries in the table point to the rows of the states.
+	A state without threads that can't start new ones is a dead end */
+	for(i = 0; i < b.n * b.ss.nclass; i++) {
+		tr = &tdfa->trans[i];
+		*tr = b.trans[i];
+		s = tr->next;
+		tr->next = b.len[s] == 0 && !(b.flags[s] & DS_LOOP) ? -1 : s * b.ss.nclass;
+	}
+
+	goto done;
+
+nomem:
+	*e = WRX_MEMORY;
+done:
+	wrx_subset_done(&b.ss);
+	free(b.off);
+	free(b.len);
+	free(b.flags);
+	free(b.trans);
+	free(b.pool);
+	free(b.ops);
+	free(b.hash);
+	free(b.mark);
+	free(b.stk);
+	free(b.cur);
+	return tdfa;
+}
+
+wregex_t *wrx_comp_tdfa(const char *p, int *e, int *ep, int max_states) {
+	wregex_t *nfa;
+	int i, ex;
+
+	nfa = wrx_comp(p, e, ep);
+	if(!nfa) return NULL;
+
+	/* Patterns with back references are left to the NFA engines */
+	if(wrx_has_bref(nfa))
+		return nfa;
+
+	if(max_states <= 0)
+		max_states = DFA_MAX_STATES;
+
+	/* If there are too many states, nfa->tdfa is left NULL */
+	nfa->tdfa = build_tdfa(nfa, max_states, &ex);
+	if(ex != WRX_SUCCESS) {
+		wrx_free(nfa);
+		if(e) *e = ex;
+		if(ep) *ep = 0;
+		return NULL;
+	}
+
+	/* wrx_comp() leaves the patterns with MEV to the backtracker, since
+	it doesn't record submatch 0 for them */
+	for(i = 0; i < nfa->ns; i++)
+		if(nfa->states[i].op == MEV)
+			return nfa;
+
+	if(nfa->tdfa && nfa->engine != WRX_ENG_LITERAL)
+		nfa->engine = WRX_ENG_TDFA;
+
+	return nfa;
+}
+
+int wrx_tdfa_exec(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	const struct _wrx_tdfa *tdfa;
+	const wrx_tdfa_trans *tr;
+	const unsigned char *cls;
+	const short *op;
+	const char *cp, **reg, **match, *tmp = NULL, *v;
+	int i, s, matched = 0;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	/* The submatches are NULL unless a match is found */
+	for(i = 0; i < nsm; i++) {
+		subm[i].beg = NULL;
+		subm[i].end = NULL;
+	}
+
+	tdfa = nfa->tdfa;
+	if(!tdfa)
+		return wrx_thom(nfa, str, subm, nsm);
+
+	reg = malloc((tdfa->nreg + tdfa->ncap) * sizeof *reg);
+	if(!reg) return WRX_MEMORY;
+	match = reg + tdfa->nreg;
+	cls = tdfa->cls;
+
+	for(s = 0, cp = str; ; cp++) {
+		tr = &tdfa->trans[s + cls[(unsigned char)cp[0]]];
+
+		/* Copy the registers; if the transition ends a match, the first
+		operations copy them to the submatches */
+		op = tdfa->ops + tr->op;
+		for(i = 0; i < tr->nop; i++, op += 2) {
+			switch(op[1]) {
+			case V_POS: v = cp; break;
+			case V_NULL: v = NULL; break;
+			case V_TMP: v = tmp; break;
+			default: v = reg[op[1]];
+			}
+			if(tr->match && i < tdfa->ncap)
+				match[op[0]] = v;
+			else if(op[0] == V_TMP)
+				tmp = v;
+			else
+				reg[op[0]] = v;
+		}
+		if(tr->match)
+			matched = 1;
+
+		s = tr->next;
+		if(!cp[0] || s < 0)
+			break;
+	}
+
+	if(matched) {
+		for(i = 0; i < nsm; i++) {
+			if(i < nfa->n_subm) {
+				subm[i].beg = match[2 * i];
+				subm[i].end = match[2 * i + 1];
+			} else {
+				subm[i].beg = NULL;
+				subm[i].end = NULL;
+			}
+		}
+	}
+
+	free(reg);
+
+	return matched ? WRX_MATCH : WRX_NOMATCH;
+}
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2007-2015 Werner Stoop
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ *	Thompson's NFA simulation, with submatch extraction as described
+ *	by Rob Pike (the "Pike VM").
+ *
+ *	Instead of following one path through the NFA and backtracking when
+ *	it fails, every path is followed at the same time. The set of states
+ *	that are active at a position in the input string is kept in a list,
+ *	in the order in which wrx_exec() would have tried them. Each of these
+ *	"threads" carries its own copy of the submatches recorded along its
+ *	path. When two paths reach the same state, the one that comes first
+ *	in the list wins, which is exactly the path that the backtracker would
+ *	have found first, so the submatches are the same as wrx_exec()'s.
+ *
+ *	Since a state can be in the list only once, the time taken is bounded
+ *	by the length of the string times the number of states.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+
+#include "wregex.h"
+#include "wrxcfg.h"
+#include "wrx_dfa.h"
+#include "wrx_pre.h"
+
+#ifdef DEBUG_OUTPUT
+#	include <stdio.h>
+#endif
+
+/*
+ *	A list of threads.
+ *	Every state that is visited while adding threads is recorded in dense[]
+ *	so that it won't be visited twice. sparse[] maps a state back to its
+ *	index in dense[], so that we can test for membership in constant time.
+ *	Only the states that consume input (or end the match) are of any use in
+ *	the next step, so they are also recorded in leaf[] along with their
+ *	submatches.
+ */
+typedef struct {
+	short *sparse;
+	short *dense;
+	int n;
+
+	short *leaf;
+	int nl;
+
+	const char **caps;	/* ncap submatch pointers for each leaf */
+} thread_list;
+
+/* An item on the stack used by addthread() */
+typedef struct {
+	short st;	/* State to visit, or -1 to restore a submatch pointer */
+	short slot;	/* The submatch pointer to restore */
+	const char *old;	/* The value to restore it to */
+} job;
+
+/*
+ *	Internal data used while matching
+ */
+typedef struct {
+	const wregex_t *nfa;
+	const char *str;	/* The beginning of the string */
+
+	int ncap;	/* Number of submatch pointers tracked per thread */
+	job *stk;	/* Stack for addthread() */
+} thom_data;
+
+/*
+ *	Tests the zero-width assertions ('^', '$', '<', '>' and "\b") at
+ *	position cp in the string.
+ */
+static int check(char op, const char *str, const char *cp) {
+	switch(op) {
+	case BOL: return cp == str || cp[-1] == '\r' || cp[-1] == '\n';
+	case EOL: return cp[0] == '\r' || cp[0] == '\n' || cp[0] == '\0';
+	case BOW:
+		if(cp == str)
+			return IS_WORD(cp[0]);
+		return IS_WORD(cp[0]) && !IS_WORD(cp[-1]);
+	case EOW: return cp > str && IS_WORD(cp[-1]) && !IS_WORD(cp[0]);
+	case BND:
+		if(cp == str)
+			return IS_WORD(cp[0]);
+		return !IS_WORD(cp[0]) != !IS_WORD(cp[-1]);
+	}
+	assert(0);
+	return 0;
+}
+
+/*
+ *	Adds the thread at state st to the list l, following all the
+ *	transitions that don't consume input.
+ *	cap contains the thread's submatches. It is modified while following
+ *	REC and STP states, but its contents are restored before we return.
+ */
+static void addthread(thom_data *td, thread_list *l, short st, const char **cap, const char *cp) {
+	const wrx_state *sp;
+	job *stk = td->stk;
+	int ts = 0, slot;
+
+	stk[ts].st = st;
+	ts++;
+
+	while(ts > 0) {
+		ts--;
+		if(stk[ts].st < 0) {
+			/* Done with the path through a REC/STP */
+			cap[stk[ts].slot] = stk[ts].old;
+			continue;
+		}
+
+		st = stk[ts].st;
+		assert(st >= 0 && st < td->nfa->ns);
+
+		if(l->sparse[st] < l->n && l->dense[l->sparse[st]] == st)
+			continue; /* Already on the list */
+
+		l->sparse[st] = l->n;
+		l->dense[l->n++] = st;
+
+		sp = &td->nfa->states[st];
+		switch(sp->op) {
+		case CHC:
+			/* s[0] must be followed before s[1], so it is pushed last */
+			stk[ts++].st = sp->s[1];
+			stk[ts++].st = sp->s[0];
+			break;
+		case MOV:
+			stk[ts++].st = sp->s[0];
+			break;
+		case REC:
+		case STP:
+			slot = 2 * sp->data.idx + (sp->op == STP);
+			if(slot < td->ncap) {
+				/* Restore the old value once the path has been followed */
+				stk[ts].st = -1;
+				stk[ts].slot = slot;
+				stk[ts].old = cap[slot];
+				ts++;
+				cap[slot] = cp;
+			}
+			stk[ts++].st = sp->s[0];
+			break;
+		case BOL:
+		case EOL:
+		case BOW:
+		case EOW:
+		case BND:
+			if(check(sp->op, td->str, cp))
+				stk[ts++].st = sp->s[0];
+			break;
+		default:
+			/* MTC, MCI, SET, EOM and MEV: These are handled by the caller */
+			if(td->ncap > 0)
+				memcpy(l->caps + l->nl * td->ncap, cap, td->ncap * sizeof *cap);
+			l->leaf[l->nl++] = st;
+			break;
+		}
+	}
+}
+
+/*
+ *	Matches the string str against the NFA without backtracking.
+ *	The match may begin anywhere from beg up to last, or anywhere from beg
+ *	onwards if last is NULL.
+ */
+static int thom(const wregex_t *nfa, const char *str, const char *beg, const char *last, wregmatch_t subm[], int nsm) {
+	thom_data td;
+	thread_list lists[2], *clist, *nlist, *t;
+	const char **cap, **match, **scratch;
+	const wrx_state *sp;
+	const char *cp;
+	unsigned char c;
+	int i, nleaf, matched = 0;
+	char *mem;
+	size_t sz;
+
+	if(!nfa) return WRX_BAD_NFA;
+
+	assert(nfa->start < nfa->ns);
+
+	/* Handle NULL as a valid value for subm */
+	if(!subm) nsm = 0;
+
+	if(nsm < 0) return WRX_SMALL_NSM;
+
+	/* Back references can't be matched this way; leave them to the backtracker */
+	if(wrx_has_bref(nfa)) {
+		assert(!last);
+		return wrx_backtrack(nfa, str, subm, nsm);
+	}
+
+	/* The submatches that the caller isn't interested in need not be tracked */
+	td.nfa = nfa;
+	td.str = str;
+	td.ncap = 2 * (nsm < nfa->n_subm ? nsm : nfa->n_subm);
+
+	for(nleaf = 0, i = 0; i < nfa->ns; i++)
+		switch(nfa->states[i].op) {
+			case MTC: case MCI: case SET: case EOM: case MEV: nleaf++;
+		}
+
+	/* Get all the memory we need in one go */
+	sz = 2 * (2 * nfa->ns * sizeof(short) + nleaf * sizeof(short) + nleaf * td.ncap * sizeof *cap)
+		+ (2 * nfa->ns + 2) * sizeof(job) + 2 * td.ncap * sizeof *cap;
+	mem = calloc(1, sz);
+	if(!mem) return WRX_MEMORY;
+
+	/* The pointers are placed first so that they're properly aligned */
+	lists[0].caps = (const char **)mem;
+	lists[1].caps = lists[0].caps + nleaf * td.ncap;
+	match = lists[1].caps + nleaf * td.ncap;
+	scratch = match + td.ncap;
+	td.stk = (job *)(scratch + td.ncap);
+	lists[0].sparse = (short *)(td.stk + 2 * nfa->ns + 2);
+	lists[0].dense = lists[0].sparse + nfa->ns;
+	lists[0].leaf = lists[0].dense + nfa->ns;
+	lists[1].sparse = lists[0].leaf + nleaf;
+	lists[1].dense = lists[1].sparse + nfa->ns;
+	lists[1].leaf = lists[1].dense + nfa->ns;
+
+	clist = &lists[0];
+	nlist = &lists[1];
+	clist->n = clist->nl = 0;
+	nlist->n = nlist->nl = 0;
+
+	for(cp = beg; ; cp++) {
+		/* With no threads running, skip to where the next match can begin.
+		A range of starting positions is short, and the next one may be far
+		beyond it, so it is tried byte by byte */
+		if(clist->nl == 0 && !last && cp[0] && (nfa->bol || nfa->lits || nfa->bndm
+			|| (nfa->first && !BV_TST(nfa->first->bv, (unsigned char)cp[0])))) {
+			cp = wrx_next_start(nfa, str, cp);
+			if(!cp)
+				break;
+			clist->n = 0;
+		}
+
+		/*
+		 *	Start a new thread at this position, unless we already have a
+		 *	match. As with wrx_exec(), a match may start at any character
+		 *	in the string, but only starts at the terminating '\0' if the
+		 *	string is empty. The new thread has a lower priority than all
+		 *	the threads started before it.
+		 */
+		if(!matched && (last ? cp <= last : cp[0] || cp == str)) {
+			for(i = 0; i < td.ncap; i++)
+				scratch[i] = NULL;
+			addthread(&td, clist, nfa->start, scratch, cp);
+		}
+
+		c = cp[0];
+
+		if(clist->nl == 0) {
+			/* No threads left. Stop, unless a match can still start later */
+			if(matched || (last && cp >= last) || !c)
+				break;
+			clist->n = 0;
+			continue;
+		}
+
+#ifdef DEBUG_OUTPUT
+		printf("wrx_thom: %d threads at '%c'\n", clist->nl, c);
+#endif
+		for(i = 0; i < clist->nl; i++) {
+			sp = &nfa->states[clist->leaf[i]];
+			cap = clist->caps + i * td.ncap;
+			switch(sp->op) {
+			case MTC:
+				if(c && c == (unsigned char)sp->data.c)
+					addthread(&td, nlist, sp->s[0], cap, cp + 1);
+				break;
+			case MCI:
+				if(c && tolower(c) == tolower((unsigned char)sp->data.c))
+					addthread(&td, nlist, sp->s[0], cap, cp + 1);
+				break;
+			case SET:
+				if(c && c < 0x80 && BV_TST(sp->data.bv, c))
+					addthread(&td, nlist, sp->s[0], cap, cp + 1);
+				break;
+			case EOM:
+			case MEV:
+				/*
+				 *	We have a match. The threads that follow this one in
+				 *	the list would have been tried after it by the
+				 *	backtracker, so they're discarded. The threads before it
+				 *	are still running and may yet find a better match.
+				 */
+				matched = 1;
+				if(td.ncap > 0)
+					memcpy(match, cap, td.ncap * sizeof *cap);
+				i = clist->nl;
+				break;
+			default:
+				assert(0);
+			}
+		}
+
+		if(!c) break;
+
+		t = clist;
+		clist = nlist;
+		nlist = t;
+		nlist->n = nlist->nl = 0;
+	}
+
+	/* The submatches are NULL unless a match is found */
+	for(i = 0; i < nsm; i++) {
+		if(matched && 2 * i < td.ncap) {
+			subm[i].beg = match[2 * i];
+			subm[i].end = match[2 * i + 1];
+		} else {
+			subm[i].beg = NULL;
+			subm[i].end = NULL;
+		}
+	}
+
+	free(mem);
+
+	return matched ? WRX_MATCH : WRX_NOMATCH;
+}
+
+int wrx_thom(const wregex_t *nfa, const char *str, wregmatch_t subm[], int nsm) {
+	return thom(nfa, str, str, NULL, subm, nsm);
+}
+
+int wrx_thom_at(const wregex_t *nfa, const char *str, const char *beg, wregmatch_t subm[], int nsm) {
+	return thom(nfa, str, beg, beg, subm, nsm);
+}
+
+int wrx_thom_range(const wregex_t *nfa, const char *str, const char *beg, const char *last, wregmatch_t subm[], int nsm) {
+	return thom(nfa, str, beg, last, subm, nsm);
+}
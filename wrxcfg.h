@@ -68,6 +68,8 @@ typedef enum {
 #define WRX_MANY_STATES		-17	/* Too many states */
 #define WRX_STACK			-18	/* Can't grow stack any further */
 #define WRX_OPCODE			-19 /* Unknown opcode */
+#define WRX_NO_JIT			-20	/* The JIT compiler is not available */
+#define WRX_APPROX			-21	/* The pattern can't be matched approximately */
 
 /* Start of printable characters */
 #define START_OF_PRINT 0x20
@@ -94,12 +96,183 @@ typedef enum {
 /* Tests the bit in bv corresponding to c */
 #define BV_TST(bv, c) (bv[c>>3] & 1 << (c & 0x07))
 
+/* Is c a "word" character for the purposes of '<', '>' and "\b"? */
+#define IS_WORD(c) isalnum((unsigned char)(c))
+
+/*
+ *	A path through the states that don't consume input, from a state of a
+ *	one-pass NFA to the state that consumes the next character or ends the
+ *	match. Used by wrx_onepass().
+ */
+typedef struct {
+	short leaf;	/* The MTC, MCI, SET, EOM or MEV state at the end, or -1 after the last path */
+	short nop;	/* The number of REC, STP and assertion states along the path */
+	int op;		/* The index of the first of them in ops[] */
+} wrx_path;
+
+/*
+ *	The tables that wrx_comp() builds for a one-pass NFA.
+ *	Each state where the matcher can find itself, which is the start state
+ *	and every state that follows a MTC, MCI or SET, has a list of the paths
+ *	that leave it, in the order in which wrx_exec() would try them.
+ *	The structure and its tables are allocated as a single block.
+ */
+struct _wrx_onepass {
+	int *node;	/* The index in path[] of each state's first path, or -1 */
+	wrx_path *path;
+	short *ops;
+};
+
+/*
+ *	The bytes with which a match can begin, found by wrx_comp(). The matchers
+ *	use wrx_next_start() to skip the positions where no match can begin.
+ */
+struct _wrx_first {
+	unsigned char bv[32];	/* The bytes, as a bit vector */
+	int n;			/* The number of bytes */
+	char set[4];	/* The bytes as a string, if there are no more than 3 */
+};
+
+/* The longest string with which wrx_comp() records that a match begins */
+#define LITS_LEN	8
+
+/* The most strings with which a match can begin that wrx_comp() records */
+#define LITS_MAX	64
+
+/* The most strings that wrx_lits_find() looks for with vector instructions
+instead of the Aho-Corasick automaton */
+#define LITS_PACKED	8
+
+/*
+ *	The strings with which every match begins, found by wrx_comp() for
+ *	patterns like "timeout|refused|reset by peer". wrx_next_start() uses
+ *	wrx_lits_find() to skip to the next occurrence of any of them.
+ *	The strings are found with an Aho-Corasick automaton: The bytes are
+ *	divided into classes, and the state after byte c in state s is
+ *	delta[s * nclass + cls[c]]. The states are the prefixes of the strings.
+ *	For a few strings, the first two bytes of each are also stored for the
+ *	vector instructions to compare against many positions at once.
+ *	The structure and its tables are allocated as a single block.
+ */
+struct _wrx_lits {
+	int n;			/* The number of strings */
+	int ci;			/* Set if they are compared without regard to case */
+	const char *str;	/* The string, if there is only one, for wrx_strstr() */
+
+	int nclass;		/* The number of byte classes */
+	unsigned char cls[256];	/* The class of each byte */
+	int nstates;	/* The number of states. The start state is 0 */
+	short *delta;	/* The transition table */
+	unsigned char *depth;	/* The length of each state's prefix */
+	unsigned char *end;		/* 2 if one of the strings ends in the state,
+							1 if one of them ends in a suffix of it, else 0 */
+
+	int npair;		/* The number of different pairs of first bytes */
+	unsigned char pair[LITS_PACKED][2];	/* The pairs, in lower case if ci */
+	unsigned char fold[LITS_PACKED][2];	/* 0x20 for the letters if ci, else 0 */
+};
+
+/* The shortest window for which wrx_comp() builds a struct _wrx_bndm */
+#define BNDM_MIN	4
+
+/* The longest window, which has to fit in the bits of an unsigned long */
+#define BNDM_MAX	32
+
+/* The most bytes that a position in the window may accept. Larger sets
+make the shifts so short that nfa->first does better */
+#define BNDM_SET	16
+
+/*
+ *	The window of characters with which every match begins, found by
+ *	wrx_comp() for patterns like "[Ee]rror: [0-9]" where each of the first
+ *	few characters is a single byte or a small set of bytes.
+ *	wrx_next_start() uses wrx_bndm_find() to look for the window with
+ *	backward nondeterministic DAWG matching, which reads the window from
+ *	right to left and usually shifts it by most of its length.
+ */
+struct _wrx_bndm {
+	int m;			/* The length of the window */
+	unsigned long mask[256];	/* Bit m - 1 - i is set if position i accepts the byte */
+};
+
+/* The most ranges of bytes that a position of a fixed-length pattern may
+accept for wrx_fixed() to test it on many starting positions at once */
+#define FIXED_RANGES	4
+
+/*
+ *	The tables that wrx_comp() builds for a pattern without alternatives or
+ *	repetition, such as "\d{4}-\d{2}-\d{2}", whose matches all have the same
+ *	length. Used by wrx_fixed().
+ *	Each position of the match accepts a set of bytes. If none of them
+ *	accepts more than FIXED_RANGES ranges of bytes, the ranges are also
+ *	stored for the vector instructions to test.
+ *	The REC, STP and assertion states are stored in ops[] as pairs of shorts:
+ *	The state, and its offset from the beginning of the match.
+ *	The structure and its tables are allocated as a single block.
+ */
+struct _wrx_fixed {
+	int len;		/* The length of every match */
+	unsigned char (*cls)[32];	/* The bytes that each position accepts, as a bit vector */
+	short *order;	/* The positions, starting with the ones that accept the fewest bytes */
+
+	int ranges;		/* Set if the ranges of every position are stored */
+	unsigned char *nr;	/* The number of ranges of each position */
+	unsigned char (*lo)[FIXED_RANGES], (*hi)[FIXED_RANGES];	/* The ranges */
+
+	int nop;		/* The number of REC, STP and assertion states */
+	short *ops;
+};
+
+/* Default limit on the size of the bitmap wrx_exec() uses to avoid trying
+the same state at the same position twice */
+#define EXEC_MEMO_MAX	(1 << 20)
+
+/* wrx_exec() only sets up that bitmap once the backtracker has taken this
+many steps, since most strings match or fail well before then. The search
+then begins again with the bitmap, so this many steps may be repeated */
+#define BACKTRACK_MEMO_STEPS	256
+
+/* wrx_comp() has wrx_exec() match NFAs with at least this many states with
+wrx_thom(), since the backtracker's bitmap would be too large for most strings */
+#define PIKE_MIN_STATES	1024
+
+/* When a string is too long for the bitmap, wrx_exec() stops backtracking
+and matches it with wrx_thom() once it has taken this many steps per state
+for each character, */
+#define BACKTRACK_STEPS	4
+
+/* or this many steps in all, whichever is fewer. Without it, the backtracker
+could spend far longer on a long string than wrx_thom() before giving up */
+#define BACKTRACK_MAX	(1 << 16)
+
+/* The most stack that the code generated by wrx_jit() runs on. It is
+allocated for each call and sized to the string, up to this, and once the
+code has used it up the string is rather matched with wrx_thom() */
+#define JIT_STACK	(1 << 20)
+
+/* wrx_comp() only looks for a string that every match must contain in
+NFAs with fewer states than this, since the search takes quadratic time */
+#define REQ_MAX_STATES	2048
+
+/* Default size of the cache of a lazy DFA created by wrx_lazy_new() */
+#define LAZY_DFA_MEM	(1 << 20)
+
+/* Default limit on the number of states built by wrx_comp_dfa() */
+#define DFA_MAX_STATES	10000
+
 /* Enable my small type of optimization: Remove all nodes marked MOV,
 since they're redundant (but useful for debugging) */
 #define OPTIMIZE
 
+/* Have the code of each opcode in wrx_exec()'s backtracker jump straight to
+the code of the next state's opcode with GCC's computed gotos (labels as
+values), instead of going back to a switch statement */
+#if defined(__GNUC__) && !defined(__STRICT_ANSI__)
+#define THREADED_DISPATCH
+#endif
+
 /* Define DEBUG_OUTPUT to print details about the internals of the
 system to stdout */
 #if !defined(NDEBUG) && 0
 #define DEBUG_OUTPUT
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wregex.h"
+#include "wrx_prnt.h"
+
+/*
+ *	Compiles a pattern and writes a C function that matches it with
+ *	wrx_codegen(), so that the pattern needn't be compiled at run time.
+ *	The Makefile uses it to build name.c from a file name.re that
+ *	contains the pattern.
+ */
+int main(int argc, char *argv[]) {
+    wregex_t *r;
+    int e, ep;
+
+    if(argc != 4) {
+        printf("Usage:\n  %s name pattern outfile\n", argv[0]);
+        printf("Writes a C function called name that matches pattern to outfile\n");
+        return 1;
+    }
+
+    r = wrx_comp(argv[2], &e, &ep);
+    if(!r) {
+        fprintf(stderr, "Error: %d\n%s\n%*c: %s\n", e, argv[2], ep, '^', wrx_error(e));
+        return 1;
+    }
+
+    e = wrx_codegen(r, argv[1], argv[3]);
+    wrx_free(r);
+    if(e) {
+        fprintf(stderr, "Error: Unable to write %s\n", argv[3]);
+        return 1;
+    }
+
+    return 0;
+}